@@ -0,0 +1,132 @@
+// Compares the merge I/O backends: copies a large file through MediaIO and
+// MediaWriter, the way Remuxer reads and writes, once with pread/pwrite and
+// once with io_uring. The input is dropped from the page cache before every
+// run and the copy is committed (synced and renamed) before the clock stops.
+//
+// Usage: iobench <input file> [output directory] [buffer MB]
+
+#include "mediaio.h"
+#include "mediawriter.h"
+#include "uringqueue.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const int RUNS = 3;
+
+struct RunResult {
+    bool ok = false;
+    qint64 bytes = 0;
+    qint64 elapsedMs = 0;
+};
+
+static void dropFromCache(const QString &filePath)
+{
+    int fd = ::open(filePath.toUtf8().constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+static RunResult copyFile(const QString &inputFile, const QString &outputFile, int bufferSize, bool ioUring)
+{
+    MediaIO::Options readOptions;
+    readOptions.bufferSize = bufferSize;
+    readOptions.readahead = true;
+    readOptions.sequential = true;
+    readOptions.ioUring = ioUring;
+    
+    MediaWriter::Options writeOptions;
+    writeOptions.bufferSize = bufferSize;
+    writeOptions.queueDepth = readOptions.readaheadBlocks;
+    writeOptions.ioUring = ioUring;
+    writeOptions.preallocateBytes = QFileInfo(inputFile).size();
+    
+    RunResult result;
+    dropFromCache(inputFile);
+    
+    QElapsedTimer timer;
+    timer.start();
+    
+    MediaIO input(readOptions);
+    MediaWriter output(writeOptions);
+    if (!input.open(inputFile) || !output.open(outputFile)) {
+        return result;
+    }
+    
+    QByteArray buffer(bufferSize, Qt::Uninitialized);
+    unsigned char *data = reinterpret_cast<unsigned char *>(buffer.data());
+    int bytes;
+    while ((bytes = avio_read(input.context(), data, bufferSize)) > 0) {
+        avio_write(output.context(), data, bytes);
+        result.bytes += bytes;
+    }
+    
+    // commit() syncs the copy before renaming it into place
+    result.ok = bytes == AVERROR_EOF && output.commit();
+    result.elapsedMs = timer.elapsed();
+    
+    dropFromCache(outputFile);
+    QFile::remove(outputFile);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+    if (argc < 2) {
+        out << "Usage: iobench <input file> [output directory] [buffer MB]\n";
+        return 1;
+    }
+    
+    const QString inputFile = QString::fromLocal8Bit(argv[1]);
+    const QString outputDir = argc > 2 ? QString::fromLocal8Bit(argv[2]) : QFileInfo(inputFile).absolutePath();
+    const int bufferMB = argc > 3 ? qBound(1, QString::fromLocal8Bit(argv[3]).toInt(), 64) : 4;
+    const QString outputFile = QDir(outputDir).filePath(".iobench-" + QFileInfo(inputFile).fileName());
+    
+    if (!QFileInfo(inputFile).isFile()) {
+        out << "Not a file: " << inputFile << "\n";
+        return 1;
+    }
+    
+    out << "Input:  " << inputFile << " (" << QFileInfo(inputFile).size() / 1048576 << " MB)\n";
+    out << "Output: " << outputFile << "\n";
+    out << "Buffer: " << bufferMB << " MB, best of " << RUNS << " runs\n\n";
+    out.flush();
+    
+    if (!UringQueue::isAvailable()) {
+        out << "io_uring is not available in this build or kernel; measuring pread/pwrite only\n\n";
+    }
+    
+    for (bool ioUring : {false, true}) {
+        if (ioUring && !UringQueue::isAvailable()) {
+            continue;
+        }
+        
+        const QString backend = ioUring ? "io_uring" : "pread/pwrite";
+        double best = 0.0;
+        for (int run = 0; run < RUNS; ++run) {
+            RunResult result = copyFile(inputFile, outputFile, bufferMB * 1024 * 1024, ioUring);
+            if (!result.ok) {
+                out << backend << ": copy failed\n";
+                return 1;
+            }
+            
+            const double throughput = result.elapsedMs > 0
+                ? (result.bytes / 1048576.0) / (result.elapsedMs / 1000.0) : 0.0;
+            best = qMax(best, throughput);
+            out << backend << " run " << run + 1 << ": " << QString::number(throughput, 'f', 1) << " MB/s ("
+                << QString::number(result.elapsedMs / 1000.0, 'f', 2) << " s)\n";
+            out.flush();
+        }
+        out << backend << " best: " << QString::number(best, 'f', 1) << " MB/s\n\n";
+    }
+    
+    return 0;
+}
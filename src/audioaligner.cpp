@@ -0,0 +1,297 @@
+#include "audioaligner.h"
+#include "crosscorrelation.h"
+#include <QDebug>
+#include <QThreadPool>
+#include <QtMath>
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+#include <libavutil/channel_layout.h>
+}
+
+static const int ANALYSIS_SAMPLE_RATE = 8000;
+static const int HOP_SAMPLES = 80; // 10 ms at 8 kHz
+static const qint64 HOP_MS = 1000 * HOP_SAMPLES / ANALYSIS_SAMPLE_RATE;
+
+// Band edges of the onset envelope: low < 300 Hz < mid < 1500 Hz < high
+static const double LOW_BAND_HZ = 300.0;
+static const double MID_BAND_HZ = 1500.0;
+
+namespace {
+
+// Splits the signal into three bands with one-pole low-passes and turns the
+// per-hop band energies into an onset strength (sum of log-energy rises)
+class OnsetEnvelope
+{
+public:
+    explicit OnsetEnvelope(QVector<double> &envelope)
+        : m_envelope(envelope)
+        , m_lowCoefficient(1.0 - std::exp(-2.0 * M_PI * LOW_BAND_HZ / ANALYSIS_SAMPLE_RATE))
+        , m_midCoefficient(1.0 - std::exp(-2.0 * M_PI * MID_BAND_HZ / ANALYSIS_SAMPLE_RATE))
+        , m_low(0.0)
+        , m_mid(0.0)
+        , m_hopSamples(0)
+        , m_hasPrevious(false)
+    {
+        for (int band = 0; band < 3; ++band) {
+            m_energy[band] = 0.0;
+            m_previousLogEnergy[band] = 0.0;
+        }
+    }
+    
+    void addSamples(const float *samples, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            double x = samples[i];
+            m_low += m_lowCoefficient * (x - m_low);
+            m_mid += m_midCoefficient * (x - m_mid);
+            
+            double bands[3] = { m_low, m_mid - m_low, x - m_mid };
+            for (int band = 0; band < 3; ++band) {
+                m_energy[band] += bands[band] * bands[band];
+            }
+            
+            if (++m_hopSamples == HOP_SAMPLES) {
+                finishHop();
+            }
+        }
+    }
+
+private:
+    void finishHop()
+    {
+        double onset = 0.0;
+        for (int band = 0; band < 3; ++band) {
+            double logEnergy = std::log(m_energy[band] / HOP_SAMPLES + 1e-10);
+            if (m_hasPrevious) {
+                onset += qMax(0.0, logEnergy - m_previousLogEnergy[band]);
+            }
+            m_previousLogEnergy[band] = logEnergy;
+            m_energy[band] = 0.0;
+        }
+        
+        m_envelope.append(onset);
+        m_hasPrevious = true;
+        m_hopSamples = 0;
+    }
+    
+    QVector<double> &m_envelope;
+    double m_lowCoefficient;
+    double m_midCoefficient;
+    double m_low;
+    double m_mid;
+    double m_energy[3];
+    double m_previousLogEnergy[3];
+    int m_hopSamples;
+    bool m_hasPrevious;
+};
+
+}
+
+AudioAligner::AudioAligner()
+    : m_maxOffsetMs(5 * 60 * 1000)
+    , m_analysisWindowMs(10 * 60 * 1000)
+    , m_cancelFlag(nullptr)
+{
+}
+
+AudioAligner::Result AudioAligner::align(const QString &filePathA, const QString &filePathB)
+{
+    Result result;
+    result.valid = false;
+    result.offsetMs = 0;
+    result.confidence = 0.0;
+    
+    const qint64 durationMs = m_analysisWindowMs + m_maxOffsetMs;
+    
+    QVector<double> envelopeA;
+    QVector<double> envelopeB;
+    qint64 startA = 0;
+    qint64 startB = 0;
+    bool okA = false;
+    bool okB = false;
+    std::atomic<int> progressA(0);
+    std::atomic<int> progressB(0);
+    
+    auto reportProgress = [this, &progressA, &progressB]() {
+        if (m_progressCallback) {
+            m_progressCallback((progressA + progressB) / 2);
+        }
+    };
+    
+    // Both files are decoded at the same time; audio decoding is single threaded
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+    pool.start([&]() {
+        okA = decodeEnvelope(filePathA, durationMs, envelopeA, startA, [&](int percentage) {
+            progressA = percentage;
+            reportProgress();
+        });
+    });
+    pool.start([&]() {
+        okB = decodeEnvelope(filePathB, durationMs, envelopeB, startB, [&](int percentage) {
+            progressB = percentage;
+            reportProgress();
+        });
+    });
+    pool.waitForDone();
+    
+    if (isCancelled() || !okA || !okB) {
+        return result;
+    }
+    
+    CrossCorrelation::normalize(envelopeA);
+    CrossCorrelation::normalize(envelopeB);
+    
+    // At least 5 seconds, and a quarter of the shorter envelope, must overlap
+    int maxLag = static_cast<int>(m_maxOffsetMs / HOP_MS);
+    int minOverlap = qMax(static_cast<int>(5000 / HOP_MS), static_cast<int>(qMin(envelopeA.size(), envelopeB.size()) / 4));
+    
+    QVector<double> correlation = CrossCorrelation::correlate(envelopeA, envelopeB, maxLag, minOverlap);
+    CrossCorrelation::Peak peak = CrossCorrelation::findPeak(correlation, maxLag, static_cast<int>(1000 / HOP_MS));
+    if (!peak.valid || peak.value <= 0.0) {
+        return result;
+    }
+    
+    // B(t + lag) sounds like A(t); offsets are expressed as A(t) == B(t - offset)
+    qint64 lagMs = qRound64(peak.lag * HOP_MS) + startB - startA;
+    double separation = qBound(0.0, (peak.value - qMax(0.0, peak.secondValue)) / peak.value, 1.0);
+    
+    result.valid = true;
+    result.offsetMs = -lagMs;
+    result.confidence = qMin(1.0, peak.value) * 0.5 + separation * 0.5;
+    
+    qDebug() << "Audio alignment: offset" << result.offsetMs << "ms, correlation" << peak.value
+             << "runner-up" << peak.secondValue << "confidence" << result.confidence;
+    return result;
+}
+
+bool AudioAligner::decodeEnvelope(const QString &filePath, qint64 durationMs, QVector<double> &envelope,
+                                  qint64 &startMs, const std::function<void(int)> &progress) const
+{
+    envelope.clear();
+    startMs = 0;
+    
+    AVFormatContext *formatContext = nullptr;
+    if (avformat_open_input(&formatContext, filePath.toUtf8().constData(), nullptr, nullptr) != 0) {
+        return false;
+    }
+    
+    if (avformat_find_stream_info(formatContext, nullptr) < 0) {
+        avformat_close_input(&formatContext);
+        return false;
+    }
+    
+    const AVCodec *codec = nullptr;
+    int streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    if (streamIndex < 0 || !codec) {
+        qDebug() << "No audio stream to align in" << filePath;
+        avformat_close_input(&formatContext);
+        return false;
+    }
+    
+    // Only the main audio stream is decoded
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
+        if (static_cast<int>(i) != streamIndex) {
+            formatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    
+    AVStream *stream = formatContext->streams[streamIndex];
+    AVCodecContext *codecContext = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codecContext, stream->codecpar);
+    codecContext->pkt_timebase = stream->time_base;
+    
+    if (avcodec_open2(codecContext, codec, nullptr) < 0) {
+        avcodec_free_context(&codecContext);
+        avformat_close_input(&formatContext);
+        return false;
+    }
+    
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    SwrContext *swrContext = nullptr;
+    
+    const qint64 formatStartMs = (formatContext->start_time != AV_NOPTS_VALUE)
+                                     ? formatContext->start_time / 1000 : 0;
+    const qint64 targetSamples = durationMs * ANALYSIS_SAMPLE_RATE / 1000;
+    qint64 outputSamples = 0;
+    bool haveStart = false;
+    bool endOfFile = false;
+    int lastReported = -1;
+    
+    OnsetEnvelope onsets(envelope);
+    std::vector<float> buffer;
+    envelope.reserve(static_cast<int>(targetSamples / HOP_SAMPLES) + 1);
+    
+    while (outputSamples < targetSamples && !isCancelled()) {
+        int ret = avcodec_receive_frame(codecContext, frame);
+        if (ret == AVERROR(EAGAIN)) {
+            if (endOfFile) {
+                break;
+            }
+            if (av_read_frame(formatContext, packet) < 0) {
+                // End of file - drain the frames still buffered in the decoder
+                avcodec_send_packet(codecContext, nullptr);
+                endOfFile = true;
+                continue;
+            }
+            if (packet->stream_index == streamIndex) {
+                avcodec_send_packet(codecContext, packet);
+            }
+            av_packet_unref(packet);
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        
+        // The resampler is set up from the first frame, whose layout is authoritative
+        if (!swrContext) {
+            AVChannelLayout monoLayout = AV_CHANNEL_LAYOUT_MONO;
+            if (swr_alloc_set_opts2(&swrContext, &monoLayout, AV_SAMPLE_FMT_FLT, ANALYSIS_SAMPLE_RATE,
+                                    &frame->ch_layout, static_cast<AVSampleFormat>(frame->format),
+                                    frame->sample_rate, 0, nullptr) < 0 || swr_init(swrContext) < 0) {
+                qWarning() << "Cannot resample audio of" << filePath;
+                break;
+            }
+        }
+        
+        if (!haveStart) {
+            int64_t pts = frame->best_effort_timestamp;
+            if (pts != AV_NOPTS_VALUE) {
+                startMs = av_rescale_q(pts, stream->time_base, AVRational{1, 1000}) - formatStartMs;
+            }
+            haveStart = true;
+        }
+        
+        int capacity = swr_get_out_samples(swrContext, frame->nb_samples);
+        buffer.resize(static_cast<size_t>(qMax(capacity, 0)));
+        uint8_t *output = reinterpret_cast<uint8_t *>(buffer.data());
+        int converted = swr_convert(swrContext, &output, capacity,
+                                    const_cast<const uint8_t **>(frame->extended_data), frame->nb_samples);
+        if (converted > 0) {
+            onsets.addSamples(buffer.data(), converted);
+            outputSamples += converted;
+        }
+        
+        int percentage = static_cast<int>(qMin<qint64>(100, outputSamples * 100 / qMax<qint64>(1, targetSamples)));
+        if (progress && percentage != lastReported) {
+            lastReported = percentage;
+            progress(percentage);
+        }
+    }
+    
+    // Cleanup
+    swr_free(&swrContext);
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codecContext);
+    avformat_close_input(&formatContext);
+    
+    return !isCancelled() && !envelope.isEmpty();
+}
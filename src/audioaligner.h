@@ -0,0 +1,45 @@
+#ifndef AUDIOALIGNER_H
+#define AUDIOALIGNER_H
+
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+// Finds the time offset between two files from their main audio track.
+// Both tracks are downmixed to 8 kHz mono, reduced to a band-energy onset
+// envelope with a 10 ms hop, and cross-correlated with an FFT.
+class AudioAligner
+{
+public:
+    struct Result {
+        bool valid;
+        qint64 offsetMs;   // A(t) matches B(t - offsetMs), like VideoComparator offsets
+        double confidence; // 0..1
+    };
+    
+    AudioAligner();
+    
+    // Only the first analysisWindowMs + maxOffsetMs of each file are decoded
+    void setMaxOffset(qint64 maxOffsetMs) { m_maxOffsetMs = maxOffsetMs; }
+    void setAnalysisWindow(qint64 analysisWindowMs) { m_analysisWindowMs = analysisWindowMs; }
+    
+    void setProgressCallback(const std::function<void(int)> &callback) { m_progressCallback = callback; }
+    void setCancelFlag(const std::atomic<bool> *cancelFlag) { m_cancelFlag = cancelFlag; }
+    
+    Result align(const QString &filePathA, const QString &filePathB);
+
+private:
+    bool isCancelled() const { return m_cancelFlag && m_cancelFlag->load(); }
+    // Onset envelope with one value per hop; startMs receives the time of the
+    // first value relative to the start of the file
+    bool decodeEnvelope(const QString &filePath, qint64 durationMs, QVector<double> &envelope, qint64 &startMs,
+                        const std::function<void(int)> &progress) const;
+    
+    qint64 m_maxOffsetMs;
+    qint64 m_analysisWindowMs;
+    std::function<void(int)> m_progressCallback;
+    const std::atomic<bool> *m_cancelFlag;
+};
+
+#endif // AUDIOALIGNER_H
@@ -2,6 +2,7 @@
 #include "ffmpeghandler.h"
 #include "thememanager.h"
 #include "batchworker.h"
+#include "uringqueue.h"
 #include <QFileDialog>
 #include <QDir>
 #include <QFileInfo>
@@ -12,6 +13,7 @@
 #include <QPainter>
 #include <QPixmap>
 #include <QThread>
+#include <QSet>
 
 BatchProcessor::BatchProcessor(QWidget *parent)
     : QWidget(parent)
@@ -20,11 +22,12 @@ BatchProcessor::BatchProcessor(QWidget *parent)
     , m_processingCancelled(false)
     , m_workerThread(nullptr)
     , m_worker(nullptr)
+    , m_verifier(nullptr)
 {
     // Connect to theme manager
     connect(ThemeManager::instance(), &ThemeManager::themeChanged,
             this, &BatchProcessor::onThemeChanged);
-            
+    
     setupUI();
     
     // Apply initial theme after UI is set up
@@ -530,7 +533,40 @@ void BatchProcessor::setupUI()
     );
     m_removeExistingTracksCheckbox->setToolTip("WARNING: This will completely remove existing audio/subtitle tracks from target videos!");
     
+    m_skipUnverifiedCheckbox = new QCheckBox("Only merge pairs verified as identical");
+    m_skipUnverifiedCheckbox->setChecked(false);
+    m_skipUnverifiedCheckbox->setStyleSheet("QCheckBox { font-size: 12px; }");
+    m_skipUnverifiedCheckbox->setToolTip("Skip pairs that failed or have not been through 'Verify Pairs'");
+    
     optionsLayout->addWidget(m_removeExistingTracksCheckbox);
+    optionsLayout->addSpacing(16);
+    optionsLayout->addWidget(m_skipUnverifiedCheckbox);
+    
+    m_fanOutCheckbox = new QCheckBox("Merge leftover targets with their best source");
+    m_fanOutCheckbox->setChecked(false);
+    m_fanOutCheckbox->setStyleSheet("QCheckBox { font-size: 12px; }");
+    m_fanOutCheckbox->setToolTip("For several variants of one title (e.g. 1080p, 4K, HDR): unmatched targets reuse the best\n"
+                                 "matching source, which is then read once for all of its targets");
+    optionsLayout->addSpacing(16);
+    optionsLayout->addWidget(m_fanOutCheckbox);
+    
+    // Demux-only check of each output while the following merges run
+    m_verifyOutputsCheckbox = new QCheckBox("Verify outputs");
+    m_verifyOutputsCheckbox->setChecked(false);
+    m_verifyOutputsCheckbox->setStyleSheet("QCheckBox { font-size: 12px; }");
+    m_verifyOutputsCheckbox->setToolTip("After each merge, compare the output's streams, packet counts and durations\n"
+                                        "with its inputs; mismatches are listed for review at the end");
+    m_compareHashesCheckbox = new QCheckBox("Compare payloads");
+    m_compareHashesCheckbox->setChecked(false);
+    m_compareHashesCheckbox->setEnabled(false);
+    m_compareHashesCheckbox->setStyleSheet("QCheckBox { font-size: 12px; }");
+    m_compareHashesCheckbox->setToolTip("Also hash every copied packet on both sides.\n"
+                                        "Reports a difference where the output container stores a stream differently,\n"
+                                        "e.g. AAC from a transport stream in MP4");
+    connect(m_verifyOutputsCheckbox, &QCheckBox::toggled, m_compareHashesCheckbox, &QCheckBox::setEnabled);
+    optionsLayout->addSpacing(16);
+    optionsLayout->addWidget(m_verifyOutputsCheckbox);
+    optionsLayout->addWidget(m_compareHashesCheckbox);
     optionsLayout->addStretch();
     
     // Output settings and processing section with clean business styling
@@ -579,6 +615,76 @@ void BatchProcessor::setupUI()
     );
     m_postfixEdit->setToolTip("This will be added to each output filename (e.g., movie_merged.mp4)");
     postfixLayout->addWidget(m_postfixEdit);
+    
+    // Shift applied to the source tracks while merging
+    QLabel *sourceOffsetLabel = new QLabel("Source Track Offset:");
+    sourceOffsetLabel->setStyleSheet("font-size: 12px; font-weight: 500; color: #24292f;");
+    postfixLayout->addSpacing(12);
+    postfixLayout->addWidget(sourceOffsetLabel);
+    m_sourceOffsetSpinBox = new QSpinBox();
+    m_sourceOffsetSpinBox->setRange(-999999, 999999);
+    m_sourceOffsetSpinBox->setValue(0);
+    m_sourceOffsetSpinBox->setSuffix(" ms");
+    m_sourceOffsetSpinBox->setToolTip("Positive: source tracks are delayed\nNegative: source tracks start earlier (their beginning is cut)");
+    postfixLayout->addWidget(m_sourceOffsetSpinBox);
+    m_useVerifiedOffsetsCheckbox = new QCheckBox("Use offsets found by Verify Pairs");
+    m_useVerifiedOffsetsCheckbox->setStyleSheet("QCheckBox { font-size: 12px; }");
+    m_useVerifiedOffsetsCheckbox->setToolTip("Shift each verified pair by its own detected offset; other pairs use the value on the left");
+    postfixLayout->addWidget(m_useVerifiedOffsetsCheckbox);
+    m_detectOffsetsCheckbox = new QCheckBox("Detect offset per pair");
+    m_detectOffsetsCheckbox->setStyleSheet("QCheckBox { font-size: 12px; }");
+    m_detectOffsetsCheckbox->setToolTip("Align each pair by its audio before merging; uncertain pairs keep the manual offset and are flagged for review");
+    postfixLayout->addWidget(m_detectOffsetsCheckbox);
+    
+    // Size of each read while merging; larger reads suit network shares
+    QLabel *readBufferLabel = new QLabel("Read Buffer:");
+    readBufferLabel->setStyleSheet("font-size: 12px; font-weight: 500; color: #24292f;");
+    postfixLayout->addSpacing(12);
+    postfixLayout->addWidget(readBufferLabel);
+    m_readBufferCombo = new QComboBox();
+    for (int megabytes : {1, 2, 4, 8}) {
+        m_readBufferCombo->addItem(QString("%1 MB").arg(megabytes), megabytes * 1024 * 1024);
+    }
+    m_readBufferCombo->setCurrentIndex(2);
+    m_readBufferCombo->setToolTip("Bytes requested per read of the source and target files.\n"
+                                  "Files on NFS or SMB shares merge faster with larger reads");
+    postfixLayout->addWidget(m_readBufferCombo);
+    m_asyncIOCheckbox = new QCheckBox("Async I/O");
+    m_asyncIOCheckbox->setStyleSheet("QCheckBox { font-size: 12px; }");
+    if (UringQueue::isAvailable()) {
+        m_asyncIOCheckbox->setToolTip("Keep several reads and writes in flight through io_uring.\n"
+                                      "Helps most on fast local disks");
+    } else {
+        m_asyncIOCheckbox->setEnabled(false);
+        m_asyncIOCheckbox->setToolTip("Needs Linux io_uring and a build with liburing");
+    }
+    postfixLayout->addWidget(m_asyncIOCheckbox);
+    
+    // Merges running at once; probing and offset detection overlap with them anyway
+    QLabel *parallelMergesLabel = new QLabel("Parallel Merges:");
+    parallelMergesLabel->setStyleSheet("font-size: 12px; font-weight: 500; color: #24292f;");
+    postfixLayout->addSpacing(12);
+    postfixLayout->addWidget(parallelMergesLabel);
+    m_parallelMergesSpinBox = new QSpinBox();
+    m_parallelMergesSpinBox->setRange(1, 4);
+    m_parallelMergesSpinBox->setValue(1);
+    m_parallelMergesSpinBox->setToolTip("Merges written at the same time.\n"
+                                        "More than one helps when sources and outputs are on different disks");
+    postfixLayout->addWidget(m_parallelMergesSpinBox);
+    
+    // Job order, from the sizes of the input files
+    QLabel *scheduleLabel = new QLabel("Order:");
+    scheduleLabel->setStyleSheet("font-size: 12px; font-weight: 500; color: #24292f;");
+    postfixLayout->addSpacing(12);
+    postfixLayout->addWidget(scheduleLabel);
+    m_scheduleCombo = new QComboBox();
+    m_scheduleCombo->addItem("List order", BatchWorker::ListOrder);
+    m_scheduleCombo->addItem("Smallest first", BatchWorker::SmallestFirst);
+    m_scheduleCombo->addItem("Largest first", BatchWorker::LargestFirst);
+    m_scheduleCombo->addItem("Alternate disks", BatchWorker::BalanceDevices);
+    m_scheduleCombo->setToolTip("Smallest first gives quick results for most pairs; alternating disks\n"
+                                "keeps parallel merges on different drives");
+    postfixLayout->addWidget(m_scheduleCombo);
     postfixLayout->addStretch();
     
     // Processing controls
@@ -637,7 +743,17 @@ void BatchProcessor::setupUI()
     );
     m_stopButton->setEnabled(false); // Initially disabled
     
+    // Styled in applyTheme()
+    m_verifyButton = new QPushButton("Verify Pairs");
+    m_verifyButton->setToolTip("Detect the offset and compare the content of every matched pair");
+    
+    m_extractButton = new QPushButton("Extract Tracks");
+    m_extractButton->setToolTip("Write the checked source tracks of every source file to their own files\n"
+                                "(.mka, .srt, .ass, .sup) in the output directory, without merging");
+    
     buttonLayout->addWidget(m_startButton);
+    buttonLayout->addWidget(m_verifyButton);
+    buttonLayout->addWidget(m_extractButton);
     buttonLayout->addWidget(m_stopButton);
     buttonLayout->addStretch();
     
@@ -673,12 +789,17 @@ void BatchProcessor::setupUI()
         "}"
     );
     
+    // Learned from the merges finished so far
+    m_timeRemainingLabel = new QLabel();
+    m_timeRemainingLabel->setStyleSheet("font-size: 12px; color: #57606a;");
+    
     QLabel *logLabel = new QLabel("Processing Log:");
     logLabel->setStyleSheet("font-size: 12px; font-weight: 500; color: #24292f; margin-top: 8px;");
     
     processingLayout->addLayout(postfixLayout);
     processingLayout->addLayout(buttonLayout);
     processingLayout->addWidget(m_progressBar);
+    processingLayout->addWidget(m_timeRemainingLabel);
     processingLayout->addWidget(logLabel);
     processingLayout->addWidget(m_logOutput);
     
@@ -699,6 +820,8 @@ void BatchProcessor::setupUI()
     connect(m_moveDownButton, &QPushButton::clicked, this, &BatchProcessor::onMoveDown);
     connect(m_startButton, &QPushButton::clicked, this, &BatchProcessor::onStartBatchProcess);
     connect(m_stopButton, &QPushButton::clicked, this, &BatchProcessor::onStopBatchProcess);
+    connect(m_verifyButton, &QPushButton::clicked, this, &BatchProcessor::onVerifyPairs);
+    connect(m_extractButton, &QPushButton::clicked, this, &BatchProcessor::onExtractTracks);
     connect(m_postfixEdit, &QLineEdit::textChanged, this, &BatchProcessor::setOutputPostfix);
     
     // Template controls connections
@@ -858,18 +981,7 @@ void BatchProcessor::matchFiles()
             QFileInfo targetInfo(targetFile);
             QString targetBaseName = targetInfo.baseName().toLower();
             
-            // Calculate similarity score (simple substring matching)
-            int score = 0;
-            QStringList sourceWords = sourceBaseName.split(QRegularExpression("[\\s\\-_\\.]"), Qt::SkipEmptyParts);
-            QStringList targetWords = targetBaseName.split(QRegularExpression("[\\s\\-_\\.]"), Qt::SkipEmptyParts);
-            
-            for (const QString &sourceWord : sourceWords) {
-                for (const QString &targetWord : targetWords) {
-                    if (sourceWord == targetWord) {
-                        score += sourceWord.length();
-                    }
-                }
-            }
+            int score = matchScore(sourceBaseName, targetBaseName);
             
             if (score > bestScore) {
                 bestScore = score;
@@ -901,6 +1013,24 @@ void BatchProcessor::matchFiles()
     }
 }
 
+int BatchProcessor::matchScore(const QString &sourceBaseName, const QString &targetBaseName)
+{
+    // Calculate similarity score (simple substring matching)
+    int score = 0;
+    QStringList sourceWords = sourceBaseName.split(QRegularExpression("[\\s\\-_\\.]"), Qt::SkipEmptyParts);
+    QStringList targetWords = targetBaseName.split(QRegularExpression("[\\s\\-_\\.]"), Qt::SkipEmptyParts);
+    
+    for (const QString &sourceWord : sourceWords) {
+        for (const QString &targetWord : targetWords) {
+            if (sourceWord == targetWord) {
+                score += sourceWord.length();
+            }
+        }
+    }
+    
+    return score;
+}
+
 void BatchProcessor::onMoveUp()
 {
     int currentRow = m_targetFilesList->currentRow();
@@ -961,38 +1091,54 @@ void BatchProcessor::onStartBatchProcess()
     // Prepare file lists
     QStringList sourceFiles;
     QStringList targetFiles;
+    QStringList skippedFiles;
+    bool skipUnverified = m_skipUnverifiedCheckbox->isChecked();
     
-    QDir sourceDirObj(sourceDir);
-    QDir targetDirObj(targetDir);
-    
-    for (int i = 0; i < qMin(m_sourceFilesList->count(), m_targetFilesList->count()); ++i) {
-        QString sourceFile = m_sourceFilesList->item(i)->text();
-        QString targetFile = m_targetFilesList->item(i)->text();
-        
-        if (targetFile != "(No Match)") {
-            sourceFiles.append(sourceDirObj.absoluteFilePath(sourceFile));
-            targetFiles.append(targetDirObj.absoluteFilePath(targetFile));
+    for (const QPair<QString, QString> &pair : matchedPairs()) {
+        if (skipUnverified && !m_verification.value(pair).identical) {
+            skippedFiles.append(QFileInfo(pair.second).fileName());
+            continue;
         }
+        sourceFiles.append(pair.first);
+        targetFiles.append(pair.second);
     }
     
     if (sourceFiles.isEmpty()) {
-        QMessageBox::warning(this, "Warning", "No valid file pairs to process.");
+        QMessageBox::warning(this, "Warning", skippedFiles.isEmpty()
+                             ? "No valid file pairs to process."
+                             : "No file pairs have been verified as identical. Run 'Verify Pairs' first.");
         return;
     }
     
-    // Prepare jobs for worker thread
+    // Prepare jobs for worker thread; target tracks are probed there
     QList<BatchWorker::ProcessingJob> jobs;
-    FFmpegHandler handler;
+    QSet<QString> outputFiles;
     
     for (int i = 0; i < sourceFiles.size(); ++i) {
         QFileInfo targetInfo(targetFiles[i]);
-        QString outputFile = QDir(outputDir).absoluteFilePath(
-            targetInfo.baseName() + m_currentPostfix + "." + targetInfo.suffix());
+        QString outputName = targetInfo.completeBaseName() + m_currentPostfix;
+        QString outputFile = QDir(outputDir).absoluteFilePath(outputName + "." + targetInfo.suffix());
+        // Targets of the same name from different folders get numbered outputs
+        for (int n = 2; outputFiles.contains(outputFile); ++n) {
+            outputFile = QDir(outputDir).absoluteFilePath(
+                QString("%1_%2.%3").arg(outputName).arg(n).arg(targetInfo.suffix()));
+        }
+        outputFiles.insert(outputFile);
         
         BatchWorker::ProcessingJob job;
         job.sourceFile = sourceFiles[i];
         job.targetFile = targetFiles[i];
         job.outputFile = outputFile;
+        job.sourceOffsetMs = m_sourceOffsetSpinBox->value();
+        
+        // Verification compares the source as Video A, which at t shows what
+        // the target shows at t - offset
+        QPair<QString, QString> pair(sourceFiles[i], targetFiles[i]);
+        if (m_useVerifiedOffsetsCheckbox->isChecked() && m_verification.contains(pair)) {
+            job.sourceOffsetMs = -m_verification.value(pair).offsetMs;
+        } else {
+            job.detectOffset = m_detectOffsetsCheckbox->isChecked();
+        }
         
         // Add selected source tracks (tracks to ADD)
         for (int trackIndex : sourceAudioTrackIndexes) {
@@ -1002,23 +1148,71 @@ void BatchProcessor::onStartBatchProcess()
             job.selectedSubtitleTracks.append(qMakePair(QString("source"), trackIndex));
         }
         
-        // Add existing target tracks (unless user wants to remove them)
-        if (!removeExistingTracks) {
-            // Get existing tracks from target file
-            QList<AudioTrackInfo> targetAudioTracks = handler.getAudioTracks(targetFiles[i]);
-            for (const AudioTrackInfo &track : targetAudioTracks) {
-                job.selectedAudioTracks.append(qMakePair(QString("target"), track.index));
-            }
-            
-            QList<SubtitleTrackInfo> targetSubtitleTracks = handler.getSubtitleTracks(targetFiles[i]);
-            for (const SubtitleTrackInfo &track : targetSubtitleTracks) {
-                job.selectedSubtitleTracks.append(qMakePair(QString("target"), track.index));
-            }
-        }
+        // Existing target tracks are kept unless the user wants them removed
+        job.keepTargetTracks = !removeExistingTracks;
         
         jobs.append(job);
     }
     
+    startWorker(jobs);
+    for (const QString &fileName : skippedFiles) {
+        m_logOutput->append(QString("Skipping unverified pair: %1").arg(fileName));
+    }
+}
+
+void BatchProcessor::onExtractTracks()
+{
+    QString sourceDir = m_sourceDirectoryEdit->text();
+    QString outputDir = m_outputDirectoryEdit->text();
+    
+    if (sourceDir.isEmpty() || outputDir.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "Please select the source and output directories.");
+        return;
+    }
+    
+    // Checked source tracks are the ones written out
+    QList<QPair<QString, int>> audioTracks;
+    QList<QPair<QString, int>> subtitleTracks;
+    for (int i = 0; i < m_audioTracksList->count(); ++i) {
+        QListWidgetItem *item = m_audioTracksList->item(i);
+        if (item->checkState() == Qt::Checked) {
+            audioTracks.append(qMakePair(QString("source"), item->data(Qt::UserRole).toInt()));
+        }
+    }
+    for (int i = 0; i < m_subtitleTracksList->count(); ++i) {
+        QListWidgetItem *item = m_subtitleTracksList->item(i);
+        if (item->checkState() == Qt::Checked) {
+            subtitleTracks.append(qMakePair(QString("source"), item->data(Qt::UserRole).toInt()));
+        }
+    }
+    
+    if (audioTracks.isEmpty() && subtitleTracks.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "Please check at least one source track to extract.");
+        return;
+    }
+    
+    // Every source file is extracted, matched to a target or not
+    QList<BatchWorker::ProcessingJob> jobs;
+    QDir sourceDirObj(sourceDir);
+    for (int i = 0; i < m_sourceFilesList->count(); ++i) {
+        BatchWorker::ProcessingJob job;
+        job.sourceFile = sourceDirObj.absoluteFilePath(m_sourceFilesList->item(i)->text());
+        job.extractDirectory = outputDir;
+        job.selectedAudioTracks = audioTracks;
+        job.selectedSubtitleTracks = subtitleTracks;
+        jobs.append(job);
+    }
+    
+    if (jobs.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "No source files to extract from.");
+        return;
+    }
+    
+    startWorker(jobs);
+}
+
+void BatchProcessor::startWorker(const QList<BatchWorker::ProcessingJob> &jobs)
+{
     // Clean up previous worker if exists
     if (m_workerThread) {
         if (m_worker) {
@@ -1042,10 +1236,14 @@ void BatchProcessor::onStartBatchProcess()
             this, &BatchProcessor::onWorkerProgressUpdated);
     connect(m_worker, &BatchWorker::jobCompleted,
             this, &BatchProcessor::onWorkerJobCompleted);
+    connect(m_worker, &BatchWorker::jobNeedsReview,
+            this, &BatchProcessor::onWorkerJobNeedsReview);
     connect(m_worker, &BatchWorker::processingFinished,
             this, &BatchProcessor::onWorkerProcessingFinished);
     connect(m_worker, &BatchWorker::logMessage,
             this, &BatchProcessor::onWorkerLogMessage);
+    connect(m_worker, &BatchWorker::timeRemainingUpdated,
+            this, &BatchProcessor::onWorkerTimeRemainingUpdated);
     
     // Connect thread signals
     connect(m_workerThread, &QThread::started,
@@ -1055,14 +1253,27 @@ void BatchProcessor::onStartBatchProcess()
     
     // Set up UI for processing
     m_processingCancelled = false;
+    m_jobTargetFiles.clear();
+    for (const BatchWorker::ProcessingJob &job : jobs) {
+        m_jobTargetFiles.append(job.extractDirectory.isEmpty() ? job.targetFile : job.sourceFile);
+    }
+    m_reviewList.clear();
     m_startButton->setEnabled(false);
+    m_verifyButton->setEnabled(false);
+    m_extractButton->setEnabled(false);
     m_stopButton->setEnabled(true);
     m_progressBar->setRange(0, jobs.size());
     m_progressBar->setValue(0);
+    m_timeRemainingLabel->clear();
     m_logOutput->clear();
     
     // Start processing in worker thread
     m_worker->setJobs(jobs);
+    m_worker->setReadBufferSize(m_readBufferCombo->currentData().toInt());
+    m_worker->setAsyncIO(m_asyncIOCheckbox->isChecked());
+    m_worker->setStageWorkers(BatchWorker::RemuxStage, m_parallelMergesSpinBox->value());
+    m_worker->setSchedulePolicy(static_cast<BatchWorker::SchedulePolicy>(m_scheduleCombo->currentData().toInt()));
+    m_worker->setVerifyOutputs(m_verifyOutputsCheckbox->isChecked(), m_compareHashesCheckbox->isChecked());
     m_workerThread->start();
 }
 
@@ -1076,6 +1287,143 @@ void BatchProcessor::onStopBatchProcess()
     if (m_worker) {
         m_worker->requestStop();
     }
+    if (m_verifier && m_verifier->isRunning()) {
+        m_verifier->requestStop();
+    }
+}
+
+QList<QPair<QString, QString>> BatchProcessor::matchedPairs() const
+{
+    QList<QPair<QString, QString>> pairs;
+    
+    QDir sourceDirObj(m_sourceDirectoryEdit->text());
+    QDir targetDirObj(m_targetDirectoryEdit->text());
+    
+    for (int i = 0; i < qMin(m_sourceFilesList->count(), m_targetFilesList->count()); ++i) {
+        QString sourceFile = m_sourceFilesList->item(i)->text();
+        QString targetFile = m_targetFilesList->item(i)->text();
+        
+        if (targetFile != "(No Match)") {
+            pairs.append(qMakePair(sourceDirObj.absoluteFilePath(sourceFile),
+                                   targetDirObj.absoluteFilePath(targetFile)));
+        }
+    }
+    
+    // Targets left over after one-to-one matching (other variants of the
+    // same title) share the source they match best
+    if (m_fanOutCheckbox->isChecked()) {
+        for (int i = m_sourceFilesList->count(); i < m_targetFilesList->count(); ++i) {
+            QString targetFile = m_targetFilesList->item(i)->text();
+            QString targetBaseName = QFileInfo(targetFile).baseName().toLower();
+            
+            QString bestSource;
+            int bestScore = 0;
+            for (int j = 0; j < m_sourceFilesList->count(); ++j) {
+                QString sourceFile = m_sourceFilesList->item(j)->text();
+                int score = matchScore(QFileInfo(sourceFile).baseName().toLower(), targetBaseName);
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestSource = sourceFile;
+                }
+            }
+            
+            if (!bestSource.isEmpty()) {
+                pairs.append(qMakePair(sourceDirObj.absoluteFilePath(bestSource),
+                                       targetDirObj.absoluteFilePath(targetFile)));
+            }
+        }
+    }
+    
+    return pairs;
+}
+
+void BatchProcessor::onVerifyPairs()
+{
+    if (m_sourceDirectoryEdit->text().isEmpty() || m_targetDirectoryEdit->text().isEmpty()) {
+        QMessageBox::warning(this, "Warning", "Please select the source and target directories.");
+        return;
+    }
+    
+    QList<QPair<QString, QString>> pairs = matchedPairs();
+    if (pairs.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "No valid file pairs to verify.");
+        return;
+    }
+    
+    if (!m_verifier) {
+        m_verifier = new BatchVerifier(this);
+        connect(m_verifier, &BatchVerifier::progressUpdated, this, [this](int completed, int total) {
+            m_progressBar->setRange(0, total);
+            m_progressBar->setValue(completed);
+        });
+        connect(m_verifier, &BatchVerifier::pairVerified, this, &BatchProcessor::onPairVerified);
+        connect(m_verifier, &BatchVerifier::verificationFinished, this, &BatchProcessor::onVerificationFinished);
+        connect(m_verifier, &BatchVerifier::logMessage, this, &BatchProcessor::onWorkerLogMessage);
+    }
+    
+    m_verification.clear();
+    m_startButton->setEnabled(false);
+    m_verifyButton->setEnabled(false);
+    m_extractButton->setEnabled(false);
+    m_stopButton->setEnabled(true);
+    m_logOutput->clear();
+    
+    m_verifier->setPairs(pairs);
+    m_verifier->start();
+}
+
+void BatchProcessor::onPairVerified(int pairIndex, const BatchVerifier::PairResult &result)
+{
+    if (result.completed) {
+        m_verification.insert(qMakePair(result.sourceFile, result.targetFile), result);
+    }
+    
+    QString name = QFileInfo(result.targetFile).fileName();
+    if (!result.completed) {
+        m_logOutput->append(QString("- Pair %1 not verified: %2").arg(pairIndex + 1).arg(name));
+        return;
+    }
+    
+    m_logOutput->append(QString("%1 Pair %2 %3: %4 (offset %5 ms, similarity %6%, %7 s)")
+                        .arg(result.identical ? "✓" : "✗")
+                        .arg(pairIndex + 1)
+                        .arg(result.identical ? "identical" : "different")
+                        .arg(name)
+                        .arg(result.offsetMs)
+                        .arg(result.similarity * 100.0, 0, 'f', 1)
+                        .arg(result.elapsedMs / 1000.0, 0, 'f', 1));
+}
+
+void BatchProcessor::onVerificationFinished(bool cancelled)
+{
+    m_startButton->setEnabled(true);
+    m_verifyButton->setEnabled(true);
+    m_extractButton->setEnabled(true);
+    m_stopButton->setEnabled(false);
+    m_processingCancelled = false;
+    
+    int identical = 0;
+    for (const BatchVerifier::PairResult &result : m_verifier->results()) {
+        if (result.completed && result.identical) {
+            identical++;
+        }
+    }
+    m_logOutput->append(QString("%1 of %2 pairs verified as identical")
+                        .arg(identical).arg(m_verifier->results().size()));
+    
+    // The report goes next to the merged files, or next to the targets before an output is chosen
+    QString reportDir = m_outputDirectoryEdit->text().isEmpty() ? m_targetDirectoryEdit->text()
+                                                                : m_outputDirectoryEdit->text();
+    QString reportPath = QDir(reportDir).absoluteFilePath("verification_report.csv");
+    if (m_verifier->writeReport(reportPath)) {
+        m_logOutput->append(QString("Verification report written to %1").arg(reportPath));
+    } else {
+        m_logOutput->append(QString("Could not write verification report to %1").arg(reportPath));
+    }
+    
+    if (cancelled) {
+        m_progressBar->setValue(0);
+    }
 }
 
 QIcon BatchProcessor::createColoredIcon(const QColor &color, int size)
@@ -1200,12 +1548,18 @@ void BatchProcessor::applyTheme()
     if (m_moveDownButton) m_moveDownButton->setStyleSheet(theme->buttonStyleSheet());
     if (m_startButton) m_startButton->setStyleSheet(theme->successButtonStyleSheet());
     if (m_stopButton) m_stopButton->setStyleSheet(theme->dangerButtonStyleSheet());
+    if (m_verifyButton) m_verifyButton->setStyleSheet(theme->primaryButtonStyleSheet());
+    if (m_extractButton) m_extractButton->setStyleSheet(theme->buttonStyleSheet());
     
     // Update input fields
     if (m_sourceDirectoryEdit) m_sourceDirectoryEdit->setStyleSheet(theme->lineEditStyleSheet());
     if (m_targetDirectoryEdit) m_targetDirectoryEdit->setStyleSheet(theme->lineEditStyleSheet());
     if (m_outputDirectoryEdit) m_outputDirectoryEdit->setStyleSheet(theme->lineEditStyleSheet());
     if (m_postfixEdit) m_postfixEdit->setStyleSheet(theme->lineEditStyleSheet());
+    if (m_sourceOffsetSpinBox) m_sourceOffsetSpinBox->setStyleSheet(theme->lineEditStyleSheet());
+    if (m_readBufferCombo) m_readBufferCombo->setStyleSheet(theme->lineEditStyleSheet());
+    if (m_scheduleCombo) m_scheduleCombo->setStyleSheet(theme->lineEditStyleSheet());
+    if (m_parallelMergesSpinBox) m_parallelMergesSpinBox->setStyleSheet(theme->lineEditStyleSheet());
     if (m_audioTemplateEdit) m_audioTemplateEdit->setStyleSheet(theme->lineEditStyleSheet());
     if (m_subtitleTemplateEdit) m_subtitleTemplateEdit->setStyleSheet(theme->lineEditStyleSheet());
     
@@ -1247,15 +1601,11 @@ void BatchProcessor::onThemeChanged()
     applyTheme();
 }
 
-void BatchProcessor::onWorkerProgressUpdated(int current, int total, const QString &currentFile)
+void BatchProcessor::onWorkerProgressUpdated(int completed, int total)
 {
+    // The worker logs which files it is working on
     m_progressBar->setRange(0, total);
-    m_progressBar->setValue(current);
-    
-    if (!currentFile.isEmpty()) {
-        QFileInfo fileInfo(currentFile);
-        m_logOutput->append(QString("Processing: %1").arg(fileInfo.fileName()));
-    }
+    m_progressBar->setValue(completed);
 }
 
 void BatchProcessor::onWorkerJobCompleted(int jobIndex, bool success, const QString &message)
@@ -1267,11 +1617,21 @@ void BatchProcessor::onWorkerJobCompleted(int jobIndex, bool success, const QStr
     }
 }
 
+void BatchProcessor::onWorkerJobNeedsReview(int jobIndex, const QString &reason)
+{
+    if (jobIndex >= 0 && jobIndex < m_jobTargetFiles.size()) {
+        m_reviewList.append(QString("%1 (%2)").arg(QFileInfo(m_jobTargetFiles[jobIndex]).fileName()).arg(reason));
+    }
+}
+
 void BatchProcessor::onWorkerProcessingFinished(bool cancelled)
 {
     // Clean up UI state
     m_startButton->setEnabled(true);
+    m_verifyButton->setEnabled(true);
+    m_extractButton->setEnabled(true);
     m_stopButton->setEnabled(false);
+    m_timeRemainingLabel->clear();
     
     if (cancelled) {
         m_logOutput->append("Batch processing was cancelled.");
@@ -1281,6 +1641,13 @@ void BatchProcessor::onWorkerProcessingFinished(bool cancelled)
         m_progressBar->setValue(m_progressBar->maximum());
     }
     
+    if (!m_reviewList.isEmpty()) {
+        m_logOutput->append(QString("%1 pairs need to be reviewed:").arg(m_reviewList.size()));
+        for (const QString &entry : m_reviewList) {
+            m_logOutput->append("  " + entry);
+        }
+    }
+    
     // Clean up worker thread
     if (m_workerThread) {
         m_workerThread->quit();
@@ -1295,6 +1662,16 @@ void BatchProcessor::onWorkerProcessingFinished(bool cancelled)
     m_processingCancelled = false;
 }
 
+void BatchProcessor::onWorkerTimeRemainingUpdated(qint64 remainingMs, const QString &runningJobs)
+{
+    QString text = remainingMs < 0 ? QString("Remaining: estimating...")
+                                   : QString("Remaining: about %1").arg(EtaModel::formatDuration(remainingMs));
+    if (!runningJobs.isEmpty()) {
+        text += QString("  (now: %1)").arg(runningJobs);
+    }
+    m_timeRemainingLabel->setText(text);
+}
+
 void BatchProcessor::onWorkerLogMessage(const QString &message)
 {
     m_logOutput->append(message);
@@ -13,9 +13,11 @@
 #include <QGroupBox>
 #include <QCheckBox>
 #include <QSpinBox>
+#include <QComboBox>
 #include <QThread>
-
-class BatchWorker;
+#include <QHash>
+#include "batchverifier.h"
+#include "batchworker.h"
 
 class BatchProcessor : public QWidget
 {
@@ -37,6 +39,8 @@ private slots:
     void onSelectOutputDirectory();
     void onStartBatchProcess();
     void onStopBatchProcess();
+    void onVerifyPairs();
+    void onExtractTracks();
     void onMoveUp();
     void onMoveDown();
     void onAutoMatch();
@@ -51,15 +55,24 @@ private slots:
     void onThemeChanged();
     
     // Worker thread slots
-    void onWorkerProgressUpdated(int current, int total, const QString &currentFile);
+    void onWorkerProgressUpdated(int completed, int total);
     void onWorkerJobCompleted(int jobIndex, bool success, const QString &message);
+    void onWorkerJobNeedsReview(int jobIndex, const QString &reason);
     void onWorkerProcessingFinished(bool cancelled);
     void onWorkerLogMessage(const QString &message);
+    void onWorkerTimeRemainingUpdated(qint64 remainingMs, const QString &runningJobs);
+    
+    // Verification slots
+    void onPairVerified(int pairIndex, const BatchVerifier::PairResult &result);
+    void onVerificationFinished(bool cancelled);
 
 private:
     void setupUI();
     void updateFileList();
     void matchFiles();
+    QList<QPair<QString, QString>> matchedPairs() const;
+    void startWorker(const QList<BatchWorker::ProcessingJob> &jobs);
+    static int matchScore(const QString &sourceBaseName, const QString &targetBaseName);
     QIcon createColoredIcon(const QColor &color, int size = 16);
     
     QVBoxLayout *m_mainLayout;
@@ -93,20 +106,40 @@ private:
     
     // Output options
     QLineEdit *m_postfixEdit;
+    QSpinBox *m_sourceOffsetSpinBox;
+    QCheckBox *m_useVerifiedOffsetsCheckbox;
+    QCheckBox *m_detectOffsetsCheckbox;
+    QComboBox *m_readBufferCombo;
+    QCheckBox *m_asyncIOCheckbox;
+    QSpinBox *m_parallelMergesSpinBox;
+    QComboBox *m_scheduleCombo;
     QCheckBox *m_removeExistingTracksCheckbox;
+    QCheckBox *m_skipUnverifiedCheckbox;
+    QCheckBox *m_fanOutCheckbox;
+    QCheckBox *m_verifyOutputsCheckbox;
+    QCheckBox *m_compareHashesCheckbox;
     
     // Processing
     QPushButton *m_startButton;
     QPushButton *m_stopButton;
+    QPushButton *m_verifyButton;
+    QPushButton *m_extractButton;
     QProgressBar *m_progressBar;
+    QLabel *m_timeRemainingLabel;
     QTextEdit *m_logOutput;
     
     QString m_currentPostfix;
     bool m_processingCancelled;
+    QStringList m_jobTargetFiles;
+    QStringList m_reviewList;
     
     // Threading
     QThread *m_workerThread;
     BatchWorker *m_worker;
+    
+    // Pair verification; completed results are keyed by (source, target) path
+    BatchVerifier *m_verifier;
+    QHash<QPair<QString, QString>, BatchVerifier::PairResult> m_verification;
 };
 
 #endif // BATCHPROCESSOR_H
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "batchverifier.h"
+#include "videocomparator.h"
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+
+BatchVerifier::BatchVerifier(QObject *parent)
+    : QObject(parent)
+    , m_maxParallel(qBound(1, QThread::idealThreadCount() / 4, 4))
+    , m_nextPair(0)
+    , m_completedPairs(0)
+    , m_stopRequested(false)
+{
+}
+
+BatchVerifier::~BatchVerifier()
+{
+    m_stopRequested = true;
+    shutDown();
+}
+
+void BatchVerifier::setPairs(const QList<QPair<QString, QString>> &pairs)
+{
+    m_pairs = pairs;
+}
+
+void BatchVerifier::start()
+{
+    if (isRunning()) {
+        return;
+    }
+    
+    m_stopRequested = false;
+    m_nextPair = 0;
+    m_completedPairs = 0;
+    m_results.clear();
+    for (const QPair<QString, QString> &pair : m_pairs) {
+        PairResult result;
+        result.sourceFile = pair.first;
+        result.targetFile = pair.second;
+        m_results.append(result);
+    }
+    
+    if (m_pairs.isEmpty()) {
+        emit verificationFinished(false);
+        return;
+    }
+    
+    const int workerCount = qMin(m_maxParallel, m_pairs.size());
+    emit logMessage(QString("Verifying %1 pairs, %2 at a time...").arg(m_pairs.size()).arg(workerCount));
+    
+    for (int i = 0; i < workerCount; ++i) {
+        Worker worker;
+        worker.thread = new QThread(this);
+        worker.comparator = new VideoComparator();
+        worker.comparator->moveToThread(worker.thread);
+        worker.pairIndex = -1;
+        m_workers.append(worker);
+        
+        // Results come back to this thread through queued connections
+        connect(worker.comparator, &VideoComparator::optimalOffsetFound, this,
+                [this, i](qint64 offsetMs, double confidence) { onOffsetFound(i, offsetMs, confidence); });
+        connect(worker.comparator, &VideoComparator::autoComparisonComplete, this,
+                [this, i](double similarity, bool identical, const QString &summary) {
+                    onComparisonComplete(i, similarity, identical, summary);
+                });
+        connect(worker.comparator, &VideoComparator::operationCancelled, this,
+                [this, i]() { finishPair(i, false); });
+        
+        worker.thread->start();
+    }
+    
+    emit progressUpdated(0, m_pairs.size());
+    for (int i = 0; i < m_workers.size(); ++i) {
+        startNextPair(i);
+    }
+}
+
+void BatchVerifier::requestStop()
+{
+    m_stopRequested = true;
+    for (const Worker &worker : m_workers) {
+        worker.comparator->cancel();
+    }
+}
+
+void BatchVerifier::startNextPair(int worker)
+{
+    Worker &slot = m_workers[worker];
+    if (m_stopRequested || m_nextPair >= m_pairs.size()) {
+        slot.pairIndex = -1;
+        
+        // The last worker to go idle ends the run
+        for (const Worker &other : m_workers) {
+            if (other.pairIndex >= 0) {
+                return;
+            }
+        }
+        bool cancelled = m_stopRequested;
+        shutDown();
+        emit logMessage(cancelled ? "Verification cancelled" : "Verification completed");
+        emit verificationFinished(cancelled);
+        return;
+    }
+    
+    slot.pairIndex = m_nextPair++;
+    slot.timer.start();
+    
+    const QString sourceFile = m_pairs[slot.pairIndex].first;
+    const QString targetFile = m_pairs[slot.pairIndex].second;
+    emit logMessage(QString("Verifying %1 against %2")
+                    .arg(QFileInfo(sourceFile).fileName())
+                    .arg(QFileInfo(targetFile).fileName()));
+    
+    // setVideo() probes the files, so it runs on the worker thread as well
+    VideoComparator *comparator = slot.comparator;
+    const int pairIndex = slot.pairIndex;
+    QMetaObject::invokeMethod(comparator, [this, comparator, worker, pairIndex, sourceFile, targetFile]() {
+        comparator->setVideo(0, sourceFile);
+        comparator->setVideo(1, targetFile);
+        comparator->setVideoOffset(0, 0);
+        comparator->setVideoOffset(1, 0);
+        comparator->setTimeMap(TimeMap());
+        if (!comparator->findOptimalOffset(VideoComparator::AutoOffset)) {
+            QMetaObject::invokeMethod(this, [this, worker, pairIndex]() { abandonPair(worker, pairIndex); },
+                                      Qt::QueuedConnection);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void BatchVerifier::onOffsetFound(int worker, qint64 offsetMs, double confidence)
+{
+    Worker &slot = m_workers[worker];
+    if (slot.pairIndex < 0) {
+        return;
+    }
+    
+    PairResult &result = m_results[slot.pairIndex];
+    result.offsetMs = offsetMs;
+    result.offsetConfidence = confidence;
+    
+    if (m_stopRequested) {
+        finishPair(worker, false);
+        return;
+    }
+    
+    // Compare at the detected offset, as the comparison tab does
+    VideoComparator *comparator = slot.comparator;
+    const int pairIndex = slot.pairIndex;
+    QMetaObject::invokeMethod(comparator, [this, comparator, worker, pairIndex, offsetMs]() {
+        comparator->setVideoOffset(0, offsetMs);
+        if (!comparator->startAutoComparison()) {
+            QMetaObject::invokeMethod(this, [this, worker, pairIndex]() { abandonPair(worker, pairIndex); },
+                                      Qt::QueuedConnection);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void BatchVerifier::onComparisonComplete(int worker, double similarity, bool identical, const QString &summary)
+{
+    Worker &slot = m_workers[worker];
+    if (slot.pairIndex < 0) {
+        return;
+    }
+    
+    PairResult &result = m_results[slot.pairIndex];
+    result.similarity = similarity;
+    result.identical = identical;
+    result.summary = summary;
+    finishPair(worker, true);
+}
+
+void BatchVerifier::abandonPair(int worker, int pairIndex)
+{
+    // The comparator refused the job, so no signal will come for this pair
+    if (worker >= m_workers.size() || m_workers[worker].pairIndex != pairIndex) {
+        return;
+    }
+    
+    m_results[pairIndex].summary = "Could not start verification";
+    emit logMessage(QString("Could not verify %1").arg(QFileInfo(m_pairs[pairIndex].first).fileName()));
+    finishPair(worker, false);
+}
+
+void BatchVerifier::finishPair(int worker, bool completed)
+{
+    Worker &slot = m_workers[worker];
+    if (slot.pairIndex < 0) {
+        return;
+    }
+    
+    PairResult &result = m_results[slot.pairIndex];
+    result.completed = completed;
+    result.elapsedMs = slot.timer.elapsed();
+    
+    m_completedPairs++;
+    emit pairVerified(slot.pairIndex, result);
+    emit progressUpdated(m_completedPairs, m_pairs.size());
+    
+    startNextPair(worker);
+}
+
+void BatchVerifier::shutDown()
+{
+    for (Worker &worker : m_workers) {
+        worker.comparator->cancel();
+        worker.thread->quit();
+        worker.thread->wait();
+        delete worker.comparator;
+        delete worker.thread;
+    }
+    m_workers.clear();
+}
+
+bool BatchVerifier::writeReport(const QString &filePath) const
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+    
+    auto quoted = [](const QString &text) {
+        return QString("\"%1\"").arg(QString(text).replace("\"", "\"\""));
+    };
+    
+    QTextStream out(&file);
+    out << "source,target,offset_ms,offset_confidence,similarity,verdict,seconds\n";
+    for (const PairResult &result : m_results) {
+        QString verdict = !result.completed ? "NOT VERIFIED" : (result.identical ? "IDENTICAL" : "DIFFERENT");
+        out << quoted(result.sourceFile) << ','
+            << quoted(result.targetFile) << ','
+            << result.offsetMs << ','
+            << QString::number(result.offsetConfidence, 'f', 3) << ','
+            << QString::number(result.similarity, 'f', 4) << ','
+            << verdict << ','
+            << QString::number(result.elapsedMs / 1000.0, 'f', 1) << '\n';
+    }
+    out.flush();
+    
+    return file.commit();
+}
@@ -0,0 +1,80 @@
+#ifndef BATCHVERIFIER_H
+#define BATCHVERIFIER_H
+
+#include <QObject>
+#include <QThread>
+#include <QStringList>
+#include <QPair>
+#include <QList>
+#include <QElapsedTimer>
+
+class VideoComparator;
+
+// Checks that matched source/target pairs hold the same content before
+// tracks are merged across them. Each pair gets offset detection followed by
+// an auto comparison at that offset. Several pairs run at once, each on its
+// own VideoComparator and thread; this object only coordinates them and
+// lives in the thread that created it.
+class BatchVerifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct PairResult {
+        QString sourceFile;
+        QString targetFile;
+        bool completed = false;       // False when cancelled before a verdict
+        qint64 offsetMs = 0;          // Source relative to target, as in the comparison tab
+        double offsetConfidence = 0.0;
+        double similarity = 0.0;
+        bool identical = false;
+        qint64 elapsedMs = 0;
+        QString summary;
+    };
+    
+    explicit BatchVerifier(QObject *parent = nullptr);
+    ~BatchVerifier();
+    
+    void setPairs(const QList<QPair<QString, QString>> &pairs);
+    // Pairs verified at the same time; each one already decodes on several threads
+    void setMaxParallel(int count) { m_maxParallel = qMax(1, count); }
+    
+    void start();
+    void requestStop();
+    bool isRunning() const { return !m_workers.isEmpty(); }
+    
+    const QList<PairResult> &results() const { return m_results; }
+    // CSV with one row per pair
+    bool writeReport(const QString &filePath) const;
+
+signals:
+    void progressUpdated(int completed, int total);
+    void pairVerified(int pairIndex, const BatchVerifier::PairResult &result);
+    void verificationFinished(bool cancelled);
+    void logMessage(const QString &message);
+
+private:
+    struct Worker {
+        QThread *thread;
+        VideoComparator *comparator;
+        int pairIndex;
+        QElapsedTimer timer;
+    };
+    
+    void startNextPair(int worker);
+    void onOffsetFound(int worker, qint64 offsetMs, double confidence);
+    void onComparisonComplete(int worker, double similarity, bool identical, const QString &summary);
+    void abandonPair(int worker, int pairIndex);
+    void finishPair(int worker, bool completed);
+    void shutDown();
+    
+    QList<QPair<QString, QString>> m_pairs;
+    QList<PairResult> m_results;
+    QList<Worker> m_workers;
+    int m_maxParallel;
+    int m_nextPair;
+    int m_completedPairs;
+    bool m_stopRequested;
+};
+
+#endif // BATCHVERIFIER_H
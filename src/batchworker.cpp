@@ -1,17 +1,80 @@
 #include "batchworker.h"
 #include "ffmpeghandler.h"
+#include "audioaligner.h"
+#include "mergeverifier.h"
+#include "boundedqueue.h"
 #include <QFileInfo>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QSet>
+#include <sys/stat.h>
+#include <algorithm>
+#include <memory>
+
+// Targets written by one ffmpeg run; each output holds a muxer and its queues
+static const int MAX_FAN_OUT = 8;
+
+// Detected offsets below this confidence are not applied; the pair is
+// merged with its manual offset and flagged for review
+static const double MIN_ALIGNMENT_CONFIDENCE = 0.6;
+
+// Jobs waiting between two stages; enough to gather a full fan-out group
+static const int QUEUE_CAPACITY = 2 * MAX_FAN_OUT;
+
+// How often a waiting batch checks for a stop request
+static const int STOP_POLL_MS = 100;
+
+// Between two remaining time updates
+static const int ETA_INTERVAL_MS = 1000;
+
+static QString readStatsMessage(const MediaIO::Stats &stats)
+{
+    return QString("Read %1 MB in %2 requests at %3 MB/s")
+           .arg(stats.bytesRead / 1048576.0, 0, 'f', 1)
+           .arg(stats.readCalls)
+           .arg(stats.throughputMBps(), 0, 'f', 1);
+}
+
+// Jobs on the same device compete for it; 0 if unknown
+static quint64 deviceId(const QString &filePath)
+{
+    struct stat info;
+    return ::stat(filePath.toUtf8().constData(), &info) == 0 ? static_cast<quint64>(info.st_dev) : 0;
+}
+
+static MergeOutput mergeOutput(const BatchWorker::ProcessingJob &job)
+{
+    MergeOutput output;
+    output.targetFile = job.targetFile;
+    output.outputFile = job.outputFile;
+    output.selectedAudioTracks = job.selectedAudioTracks;
+    output.selectedSubtitleTracks = job.selectedSubtitleTracks;
+    return output;
+}
 
 BatchWorker::BatchWorker(QObject *parent)
     : QObject(parent)
     , m_stopRequested(false)
+    , m_completedJobs(0)
+    , m_readBufferSize(MediaIO::Options().bufferSize)
+    , m_asyncIO(false)
+    , m_verifyOutputs(false)
+    , m_compareHashes(false)
+    , m_schedulePolicy(ListOrder)
 {
+    // Probes mostly wait on file headers; each alignment already decodes
+    // both of its files in parallel; merges compete for the same disks, and
+    // verification reads three files per merge
+    m_stageWorkers[ProbeStage] = 4;
+    m_stageWorkers[PlanStage] = qMax(1, QThread::idealThreadCount() / 2);
+    m_stageWorkers[RemuxStage] = 1;
+    m_stageWorkers[VerifyStage] = 2;
 }
 
 void BatchWorker::setJobs(const QList<ProcessingJob> &jobs)
 {
-    m_jobs = jobs;
+    m_jobs.assign(jobs.begin(), jobs.end());
 }
 
 void BatchWorker::requestStop()
@@ -22,62 +85,417 @@ void BatchWorker::requestStop()
 void BatchWorker::startProcessing()
 {
     m_stopRequested = false;
+    m_completedJobs = 0;
     
     emit logMessage("Starting batch processing...");
+    emit progressUpdated(0, jobCount());
     
-    for (int i = 0; i < m_jobs.size(); ++i) {
-        if (m_stopRequested) {
-            emit logMessage("Processing cancelled by user");
-            emit processingFinished(true);
-            return;
+    m_eta.clear();
+    m_eta.setParallelJobs(m_stageWorkers[RemuxStage]);
+    
+    JobQueue probeQueue(QUEUE_CAPACITY);
+    JobQueue planQueue(QUEUE_CAPACITY);
+    JobQueue remuxQueue(QUEUE_CAPACITY);
+    JobQueue verifyQueue(QUEUE_CAPACITY);
+    JobQueue *verifyOutput = m_verifyOutputs ? &verifyQueue : nullptr;
+    
+    // Scanning keeps list order, so it runs on one thread
+    QList<QThread *> threads;
+    threads += startStage(1, [this, &probeQueue]() { scanJobs(&probeQueue); }, &probeQueue);
+    threads += startStage(m_stageWorkers[ProbeStage], [this, &probeQueue, &planQueue]() {
+        probeJobs(&probeQueue, &planQueue);
+    }, &planQueue);
+    threads += startStage(m_stageWorkers[PlanStage], [this, &planQueue, &remuxQueue]() {
+        planJobs(&planQueue, &remuxQueue);
+    }, &remuxQueue);
+    threads += startStage(m_stageWorkers[RemuxStage], [this, &remuxQueue, verifyOutput]() {
+        remuxJobs(&remuxQueue, verifyOutput);
+    }, verifyOutput);
+    if (m_verifyOutputs) {
+        threads += startStage(m_stageWorkers[VerifyStage], [this, &verifyQueue]() { verifyJobs(&verifyQueue); }, nullptr);
+    }
+    
+    // Closing every queue releases stages blocked on a full or empty one;
+    // each stage then stops at its next job
+    bool closed = false;
+    QElapsedTimer etaTimer;
+    etaTimer.start();
+    for (QThread *thread : threads) {
+        while (!thread->wait(STOP_POLL_MS)) {
+            if (etaTimer.elapsed() >= ETA_INTERVAL_MS) {
+                reportTimeRemaining();
+                etaTimer.restart();
+            }
+            if (m_stopRequested && !closed) {
+                probeQueue.close();
+                planQueue.close();
+                remuxQueue.close();
+                verifyQueue.close();
+                closed = true;
+            }
         }
-        
+    }
+    qDeleteAll(threads);
+    
+    if (m_stopRequested) {
+        emit logMessage("Processing cancelled by user");
+        emit processingFinished(true);
+        return;
+    }
+    
+    emit logMessage("Batch processing completed!");
+    emit processingFinished(false);
+}
+
+QList<QThread *> BatchWorker::startStage(int count, const std::function<void()> &loop, JobQueue *output)
+{
+    std::shared_ptr<std::atomic<int>> running = std::make_shared<std::atomic<int>>(count);
+    QList<QThread *> threads;
+    for (int i = 0; i < count; ++i) {
+        QThread *thread = QThread::create([loop, running, output]() {
+            loop();
+            if (--*running == 0 && output) {
+                output->close();
+            }
+        });
+        thread->start();
+        threads.append(thread);
+    }
+    return threads;
+}
+
+void BatchWorker::scanJobs(JobQueue *output)
+{
+    QList<int> scanned;
+    for (int i = 0; i < jobCount() && !m_stopRequested; ++i) {
         const ProcessingJob &job = m_jobs[i];
-        QString fileName = QFileInfo(job.targetFile).fileName();
+        const bool extracting = !job.extractDirectory.isEmpty();
+        const QFileInfo sourceInfo(job.sourceFile);
+        const QFileInfo targetInfo(job.targetFile);
         
-        emit progressUpdated(i, m_jobs.size(), fileName);
-        emit logMessage(QString("Processing %1/%2: %3")
-                       .arg(i + 1)
-                       .arg(m_jobs.size())
-                       .arg(fileName));
+        // A missing file fails its job now instead of after the jobs ahead of it
+        const QString missing = !sourceInfo.isFile() ? job.sourceFile
+                              : !extracting && !targetInfo.isFile() ? job.targetFile
+                              : QString();
+        if (!missing.isEmpty()) {
+            finishJob(i, false, QString("Failed - %1 not found").arg(QFileInfo(missing).fileName()));
+            continue;
+        }
         
-        bool success = processJob(job);
+        // A merge reads all of both files; the larger one sets its pace
+        const qint64 targetBytes = extracting ? 0 : targetInfo.size();
+        m_eta.addJob(i, sourceInfo.size() + targetBytes,
+                     deviceId(sourceInfo.size() >= targetBytes ? job.sourceFile : job.targetFile));
         
-        QString message = success ? "Success - tracks merged" : "Failed";
-        emit jobCompleted(i, success, message);
-        emit logMessage(message);
+        // List order starts the first job right away; the others need every
+        // size first, which stat() delivers quickly even for long lists
+        if (m_schedulePolicy != ListOrder) {
+            scanned.append(i);
+        } else if (!output->push(i)) {
+            return;
+        }
+    }
+    
+    for (int index : schedule(scanned)) {
+        if (m_stopRequested || !output->push(index)) {
+            return;
+        }
+    }
+}
+
+QList<int> BatchWorker::schedule(QList<int> jobIndexes) const
+{
+    switch (m_schedulePolicy) {
+    case ListOrder:
+        break;
+    case SmallestFirst:
+        std::stable_sort(jobIndexes.begin(), jobIndexes.end(), [this](int a, int b) {
+            return m_eta.jobBytes(a) < m_eta.jobBytes(b);
+        });
+        break;
+    case LargestFirst:
+        std::stable_sort(jobIndexes.begin(), jobIndexes.end(), [this](int a, int b) {
+            return m_eta.jobBytes(a) > m_eta.jobBytes(b);
+        });
+        break;
+    case BalanceDevices: {
+        // One job per device in turn, each device's jobs in list order
+        QList<quint64> devices;
+        QMap<quint64, QList<int>> jobsByDevice;
+        for (int index : jobIndexes) {
+            const quint64 device = m_eta.jobDevice(index);
+            if (!jobsByDevice.contains(device)) {
+                devices.append(device);
+            }
+            jobsByDevice[device].append(index);
+        }
         
-        // Check for cancellation again after processing
-        if (m_stopRequested) {
-            emit logMessage("Processing cancelled by user");
-            emit processingFinished(true);
+        QList<int> balanced;
+        for (int round = 0; balanced.size() < jobIndexes.size(); ++round) {
+            for (quint64 device : devices) {
+                const QList<int> &jobs = jobsByDevice[device];
+                if (round < jobs.size()) {
+                    balanced.append(jobs[round]);
+                }
+            }
+        }
+        return balanced;
+    }
+    }
+    return jobIndexes;
+}
+
+void BatchWorker::probeJobs(JobQueue *input, JobQueue *output)
+{
+    int index;
+    while (!m_stopRequested && input->pop(&index)) {
+        if (m_jobs[index].keepTargetTracks) {
+            probeJob(m_jobs[index]);
+        }
+        if (!output->push(index)) {
+            return;
+        }
+    }
+}
+
+void BatchWorker::planJobs(JobQueue *input, JobQueue *output)
+{
+    int index;
+    while (!m_stopRequested && input->pop(&index)) {
+        if (m_jobs[index].detectOffset) {
+            alignJob(index);
+        }
+        if (m_stopRequested || !output->push(index)) {
             return;
         }
+    }
+}
+
+void BatchWorker::remuxJobs(JobQueue *input, JobQueue *output)
+{
+    int index;
+    while (!m_stopRequested && input->pop(&index)) {
+        const ProcessingJob &job = m_jobs[index];
+        const bool extracting = !job.extractDirectory.isEmpty();
+        
+        // Planned jobs waiting for the same shifted source are merged in the
+        // same run, reading the source once; extraction already writes every
+        // track from one read. Jobs writing the same output stay apart.
+        QList<int> group;
+        group.append(index);
+        if (!extracting) {
+            QSet<QString> outputFiles{job.outputFile};
+            group += input->takeMatching([this, &job, &outputFiles](const int &other) {
+                const ProcessingJob &candidate = m_jobs[other];
+                if (!candidate.extractDirectory.isEmpty() || candidate.sourceFile != job.sourceFile ||
+                    candidate.sourceOffsetMs != job.sourceOffsetMs || outputFiles.contains(candidate.outputFile)) {
+                    return false;
+                }
+                outputFiles.insert(candidate.outputFile);
+                return true;
+            }, MAX_FAN_OUT - 1);
+        }
         
-        // Small delay to allow UI updates and cancellation checks
-        QThread::msleep(10);
+        QString fileName = QFileInfo(extracting ? job.sourceFile : job.targetFile).fileName();
+        if (group.size() == 1) {
+            emit logMessage(QString("Processing %1/%2: %3")
+                           .arg(index + 1)
+                           .arg(jobCount())
+                           .arg(fileName));
+        } else {
+            emit logMessage(QString("Processing %1 into %2 targets")
+                           .arg(QFileInfo(job.sourceFile).fileName())
+                           .arg(group.size()));
+        }
+        
+        m_eta.jobsStarted(group);
+        reportTimeRemaining();
+        QList<bool> results = processJobs(group);
+        m_eta.jobsFinished(group, results.contains(true));
+        for (int i = 0; i < group.size(); ++i) {
+            QString message = results[i] ? (extracting ? "Success - tracks extracted" : "Success - tracks merged")
+                                         : "Failed";
+            finishJob(group[i], results[i], message);
+            if (group.size() > 1) {
+                emit logMessage(QString("%1: %2").arg(QFileInfo(m_jobs[group[i]].targetFile).fileName()).arg(message));
+            }
+        }
+        
+        // Verification reads the output again while the next merge runs
+        for (int i = 0; i < group.size(); ++i) {
+            if (output && !extracting && results[i] && !output->push(group[i])) {
+                return;
+            }
+        }
+    }
+}
+
+void BatchWorker::verifyJobs(JobQueue *input)
+{
+    int index;
+    while (!m_stopRequested && input->pop(&index)) {
+        verifyJob(index);
+    }
+}
+
+void BatchWorker::probeJob(ProcessingJob &job)
+{
+    try {
+        FFmpegHandler handler;
+        for (const AudioTrackInfo &track : handler.getAudioTracks(job.targetFile)) {
+            job.selectedAudioTracks.append(qMakePair(QString("target"), track.index));
+        }
+        for (const SubtitleTrackInfo &track : handler.getSubtitleTracks(job.targetFile)) {
+            job.selectedSubtitleTracks.append(qMakePair(QString("target"), track.index));
+        }
+    } catch (...) {
+        // The merge reports the unreadable target
     }
+}
+
+void BatchWorker::alignJob(int jobIndex)
+{
+    ProcessingJob &job = m_jobs[jobIndex];
+    QString fileName = QFileInfo(job.targetFile).fileName();
     
-    emit logMessage("Batch processing completed!");
-    emit processingFinished(false);
+    AudioAligner aligner;
+    aligner.setCancelFlag(&m_stopRequested);
+    AudioAligner::Result result = aligner.align(job.sourceFile, job.targetFile);
+    if (m_stopRequested) {
+        return;
+    }
+    
+    if (!result.valid || result.confidence < MIN_ALIGNMENT_CONFIDENCE) {
+        QString reason = result.valid
+            ? QString("low offset confidence (%1%)").arg(result.confidence * 100.0, 0, 'f', 0)
+            : QString("no audio offset found");
+        emit logMessage(QString("%1: %2, using %3 ms").arg(fileName).arg(reason).arg(job.sourceOffsetMs));
+        emit jobNeedsReview(jobIndex, reason);
+        return;
+    }
+    
+    // The source is A in A(t) == B(t - offset), so its tracks move by -offset
+    job.sourceOffsetMs = -result.offsetMs;
+    emit logMessage(QString("%1: source offset %2 ms (confidence %3%)")
+                   .arg(fileName)
+                   .arg(job.sourceOffsetMs)
+                   .arg(result.confidence * 100.0, 0, 'f', 0));
+}
+
+void BatchWorker::verifyJob(int jobIndex)
+{
+    const ProcessingJob &job = m_jobs[jobIndex];
+    QString fileName = QFileInfo(job.outputFile).fileName();
+    
+    MergeVerifier verifier;
+    verifier.setCancelFlag(&m_stopRequested);
+    verifier.setCompareHashes(m_compareHashes);
+    MergeVerifier::Result result = verifier.verify(job.sourceFile, mergeOutput(job), job.sourceOffsetMs);
+    if (m_stopRequested) {
+        return;
+    }
+    
+    if (!result.passed) {
+        emit logMessage(QString("%1: verification failed - %2").arg(fileName).arg(result.problems.join("; ")));
+        emit jobNeedsReview(jobIndex, QString("output %1").arg(result.problems.first()));
+        return;
+    }
+    emit logMessage(QString("%1: verified %2 streams, %3 packets%4 (%5 s)")
+                   .arg(fileName)
+                   .arg(result.streamCount)
+                   .arg(result.packetCount)
+                   .arg(m_compareHashes ? " and payloads" : "")
+                   .arg(result.elapsedMs / 1000.0, 0, 'f', 1));
 }
 
-bool BatchWorker::processJob(const ProcessingJob &job)
+void BatchWorker::finishJob(int jobIndex, bool success, const QString &message)
 {
+    emit jobCompleted(jobIndex, success, message);
+    emit progressUpdated(++m_completedJobs, jobCount());
+}
+
+void BatchWorker::reportTimeRemaining()
+{
+    QStringList running;
+    for (int index : m_eta.runningJobs()) {
+        const ProcessingJob &job = m_jobs[index];
+        const qint64 remainingMs = m_eta.jobRemainingMs(index);
+        running << QString("%1 %2")
+                   .arg(QFileInfo(job.extractDirectory.isEmpty() ? job.targetFile : job.sourceFile).fileName())
+                   .arg(remainingMs < 0 ? QString("?") : EtaModel::formatDuration(remainingMs));
+    }
+    emit timeRemainingUpdated(m_eta.remainingMs(), running.join(", "));
+}
+
+bool BatchWorker::extractJob(const ProcessingJob &job)
+{
+    QList<int> audioTrackIndexes;
+    QList<int> subtitleTrackIndexes;
+    for (const QPair<QString, int> &track : job.selectedAudioTracks) {
+        if (track.first == "source") {
+            audioTrackIndexes.append(track.second);
+        }
+    }
+    for (const QPair<QString, int> &track : job.selectedSubtitleTracks) {
+        if (track.first == "source") {
+            subtitleTrackIndexes.append(track.second);
+        }
+    }
+    
+    try {
+        FFmpegHandler handler;
+        QStringList outputFiles = handler.extractTracks(job.sourceFile, audioTrackIndexes,
+                                                        subtitleTrackIndexes, job.extractDirectory);
+        for (const QString &outputFile : outputFiles) {
+            emit logMessage(QString("  wrote %1").arg(QFileInfo(outputFile).fileName()));
+        }
+        return !outputFiles.isEmpty();
+    } catch (...) {
+        return false;
+    }
+}
+
+QList<bool> BatchWorker::processJobs(const QList<int> &jobIndexes)
+{
+    if (jobIndexes.size() == 1 && !m_jobs[jobIndexes.first()].extractDirectory.isEmpty()) {
+        return QList<bool>() << extractJob(m_jobs[jobIndexes.first()]);
+    }
+    
+    QList<MergeOutput> outputs;
+    for (int index : jobIndexes) {
+        outputs.append(mergeOutput(m_jobs[index]));
+    }
+    
+    const ProcessingJob &first = m_jobs[jobIndexes.first()];
+    
     try {
         FFmpegHandler handler;
+        MediaIO::Options ioOptions;
+        ioOptions.bufferSize = m_readBufferSize;
+        ioOptions.ioUring = m_asyncIO;
+        handler.setIOOptions(ioOptions);
+        
+        if (handler.mergeTracksFanOut(first.sourceFile, outputs, first.sourceOffsetMs)) {
+            if (handler.lastReadStats().bytesRead > 0) {
+                emit logMessage(readStatsMessage(handler.lastReadStats()));
+            }
+            return QList<bool>(jobIndexes.size(), true);
+        }
         
-        // Use the merge operation
-        bool success = handler.mergeTracks(
-            job.sourceFile,
-            job.targetFile, 
-            job.outputFile,
-            job.selectedAudioTracks,
-            job.selectedSubtitleTracks
-        );
+        if (jobIndexes.size() == 1) {
+            return QList<bool>() << false;
+        }
         
-        return success;
+        // One unreadable target fails the whole run; merge the rest one by one
+        emit logMessage("Combined merge failed, retrying each target separately");
+        QList<bool> results;
+        for (const MergeOutput &output : outputs) {
+            results.append(!m_stopRequested &&
+                           handler.mergeTracksFanOut(first.sourceFile, QList<MergeOutput>() << output,
+                                                     first.sourceOffsetMs));
+        }
+        return results;
     } catch (...) {
-        return false;
+        return QList<bool>(jobIndexes.size(), false);
     }
-}
\ No newline at end of file
+}
@@ -5,39 +5,115 @@
 #include <QThread>
 #include <QStringList>
 #include <QPair>
+#include "etamodel.h"
+#include <atomic>
+#include <functional>
+#include <vector>
 
+template <typename T> class BoundedQueue;
+
+// Runs a batch as a pipeline: a scan of the inputs feeds probe, plan, remux
+// and optionally verify stages through bounded queues, each stage on its own
+// threads, so the first merge starts as soon as its own job is planned
+// instead of after the whole list, and outputs are checked while the next
+// merges run.
 class BatchWorker : public QObject
 {
     Q_OBJECT
 
 public:
+    enum Stage {
+        ProbeStage,  // Reads the target's track list
+        PlanStage,   // Detects the audio offset
+        RemuxStage,  // Merges or extracts
+        VerifyStage, // Checks merged outputs against their plan
+        StageCount
+    };
+    
+    // Order in which the scan hands jobs on, from the sizes of their inputs
+    enum SchedulePolicy {
+        ListOrder,
+        SmallestFirst,   // Quick feedback on most of the batch
+        LargestFirst,    // The long jobs are not left for the end
+        BalanceDevices   // Alternate between disks so parallel merges use all of them
+    };
+    
     struct ProcessingJob {
         QString sourceFile;
         QString targetFile;
         QString outputFile;
         QList<QPair<QString, int>> selectedAudioTracks;
         QList<QPair<QString, int>> selectedSubtitleTracks;
+        qint64 sourceOffsetMs = 0; // Shift of the source tracks, as in FFmpegHandler::mergeTracks
+        bool detectOffset = false; // Replace sourceOffsetMs by an audio alignment before merging
+        QString extractDirectory;  // If set, the selected source tracks are written there instead of merged
+        bool keepTargetTracks = false; // Add every track of the target during the probe stage
     };
 
     explicit BatchWorker(QObject *parent = nullptr);
     
     void setJobs(const QList<ProcessingJob> &jobs);
+    // Read size per request when merging, in bytes
+    void setReadBufferSize(int bytes) { m_readBufferSize = bytes; }
+    // Merge reads and writes through io_uring where available
+    void setAsyncIO(bool enabled) { m_asyncIO = enabled; }
+    // Threads working on a stage at once
+    void setStageWorkers(Stage stage, int count) { m_stageWorkers[stage] = qMax(1, count); }
+    void setSchedulePolicy(SchedulePolicy policy) { m_schedulePolicy = policy; }
+    // Check each merged output with MergeVerifier, optionally with payload hashes
+    void setVerifyOutputs(bool enabled, bool compareHashes = false)
+    {
+        m_verifyOutputs = enabled;
+        m_compareHashes = compareHashes;
+    }
     void requestStop();
 
 public slots:
     void startProcessing();
 
 signals:
-    void progressUpdated(int current, int total, const QString &currentFile);
+    void progressUpdated(int completed, int total);
     void jobCompleted(int jobIndex, bool success, const QString &message);
+    void jobNeedsReview(int jobIndex, const QString &reason);
     void processingFinished(bool cancelled);
     void logMessage(const QString &message);
+    // remainingMs is -1 until a first job has been timed; runningJobs lists
+    // the jobs being merged with their own remaining time
+    void timeRemainingUpdated(qint64 remainingMs, const QString &runningJobs);
 
 private:
-    QList<ProcessingJob> m_jobs;
-    bool m_stopRequested;
+    typedef BoundedQueue<int> JobQueue;
+    
+    // Sized once by setJobs(). Stages update their own jobs in place from
+    // several threads, which needs storage that never detaches or moves.
+    std::vector<ProcessingJob> m_jobs;
+    std::atomic<bool> m_stopRequested;
+    std::atomic<int> m_completedJobs;
+    int m_readBufferSize;
+    bool m_asyncIO;
+    bool m_verifyOutputs;
+    bool m_compareHashes;
+    int m_stageWorkers[StageCount];
+    SchedulePolicy m_schedulePolicy;
+    EtaModel m_eta;
+    
+    int jobCount() const { return static_cast<int>(m_jobs.size()); }
+    // Starts count threads running loop; the last one to return closes output
+    QList<QThread *> startStage(int count, const std::function<void()> &loop, JobQueue *output);
+    void scanJobs(JobQueue *output);
+    QList<int> schedule(QList<int> jobIndexes) const;
+    void probeJobs(JobQueue *input, JobQueue *output);
+    void planJobs(JobQueue *input, JobQueue *output);
+    void remuxJobs(JobQueue *input, JobQueue *output);
+    void verifyJobs(JobQueue *input);
     
-    bool processJob(const ProcessingJob &job);
+    void probeJob(ProcessingJob &job);
+    void alignJob(int jobIndex);
+    void verifyJob(int jobIndex);
+    void finishJob(int jobIndex, bool success, const QString &message);
+    void reportTimeRemaining();
+    QList<bool> processJobs(const QList<int> &jobIndexes);
+    bool extractJob(const ProcessingJob &job);
 };
 
 #endif // BATCHWORKER_H
\ No newline at end of file
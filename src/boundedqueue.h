@@ -0,0 +1,88 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <functional>
+
+// Blocking FIFO between two pipeline stages. push() waits while the queue is
+// full, so a fast stage cannot run arbitrarily far ahead of a slow one, and
+// pop() waits for an item. After close() pushes are refused and pop() fails
+// once the queue has drained.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int capacity)
+        : m_capacity(qMax(1, capacity))
+        , m_closed(false)
+    {
+    }
+    
+    bool push(const T &item)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.size() >= m_capacity && !m_closed) {
+            m_notFull.wait(&m_mutex);
+        }
+        if (m_closed) {
+            return false;
+        }
+        
+        m_items.append(item);
+        m_notEmpty.wakeOne();
+        return true;
+    }
+    
+    bool pop(T *item)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.isEmpty() && !m_closed) {
+            m_notEmpty.wait(&m_mutex);
+        }
+        if (m_items.isEmpty()) {
+            return false;
+        }
+        
+        *item = m_items.takeFirst();
+        m_notFull.wakeOne();
+        return true;
+    }
+    
+    // Removes up to max queued items that match, in queue order, without waiting
+    QList<T> takeMatching(const std::function<bool(const T &)> &matches, int max)
+    {
+        QMutexLocker locker(&m_mutex);
+        QList<T> taken;
+        for (int i = 0; i < m_items.size() && taken.size() < max;) {
+            if (matches(m_items[i])) {
+                taken.append(m_items.takeAt(i));
+            } else {
+                ++i;
+            }
+        }
+        if (!taken.isEmpty()) {
+            m_notFull.wakeAll();
+        }
+        return taken;
+    }
+    
+    void close()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QList<T> m_items;
+    int m_capacity;
+    bool m_closed;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,154 @@
+#include "crosscorrelation.h"
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+void CrossCorrelation::normalize(QVector<double> &series)
+{
+    if (series.isEmpty()) {
+        return;
+    }
+    
+    double mean = std::accumulate(series.begin(), series.end(), 0.0) / series.size();
+    double variance = 0.0;
+    for (double value : series) {
+        variance += (value - mean) * (value - mean);
+    }
+    double stdDev = std::sqrt(variance / series.size());
+    
+    for (double &value : series) {
+        value = (stdDev > 1e-9) ? (value - mean) / stdDev : 0.0;
+    }
+}
+
+void CrossCorrelation::fft(std::vector<std::complex<double>> &data, bool inverse)
+{
+    const size_t n = data.size();
+    
+    // Bit-reversal permutation
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+    
+    // Iterative radix-2 butterflies
+    for (size_t length = 2; length <= n; length <<= 1) {
+        double angle = 2.0 * M_PI / length * (inverse ? 1.0 : -1.0);
+        std::complex<double> step(std::cos(angle), std::sin(angle));
+        
+        for (size_t start = 0; start < n; start += length) {
+            std::complex<double> twiddle(1.0, 0.0);
+            for (size_t k = 0; k < length / 2; ++k) {
+                std::complex<double> even = data[start + k];
+                std::complex<double> odd = data[start + k + length / 2] * twiddle;
+                data[start + k] = even + odd;
+                data[start + k + length / 2] = even - odd;
+                twiddle *= step;
+            }
+        }
+    }
+    
+    if (inverse) {
+        for (std::complex<double> &value : data) {
+            value /= static_cast<double>(n);
+        }
+    }
+}
+
+QVector<double> CrossCorrelation::correlate(const QVector<double> &a, const QVector<double> &b,
+                                            int maxLag, int minOverlap)
+{
+    const int sizeA = a.size();
+    const int sizeB = b.size();
+    if (sizeA == 0 || sizeB == 0 || maxLag < 0) {
+        return QVector<double>();
+    }
+    
+    // Zero padding to at least sizeA + sizeB keeps the circular correlation
+    // from wrapping around
+    size_t fftSize = 1;
+    while (fftSize < static_cast<size_t>(sizeA + sizeB)) {
+        fftSize <<= 1;
+    }
+    
+    std::vector<std::complex<double>> spectrumA(fftSize);
+    std::vector<std::complex<double>> spectrumB(fftSize);
+    for (int i = 0; i < sizeA; ++i) {
+        spectrumA[i] = a[i];
+    }
+    for (int i = 0; i < sizeB; ++i) {
+        spectrumB[i] = b[i];
+    }
+    
+    fft(spectrumA, false);
+    fft(spectrumB, false);
+    for (size_t i = 0; i < fftSize; ++i) {
+        spectrumB[i] *= std::conj(spectrumA[i]);
+    }
+    fft(spectrumB, true);
+    
+    // Negative lags wrap to the end of the buffer
+    QVector<double> correlation(2 * maxLag + 1, -std::numeric_limits<double>::infinity());
+    for (int lag = -maxLag; lag <= maxLag; ++lag) {
+        int overlap = qMin(sizeA, sizeB - lag) - qMax(0, -lag);
+        if (overlap < qMax(1, minOverlap)) {
+            continue;
+        }
+        
+        size_t index = (lag >= 0) ? static_cast<size_t>(lag) : fftSize - static_cast<size_t>(-lag);
+        correlation[lag + maxLag] = spectrumB[index].real() / overlap;
+    }
+    
+    return correlation;
+}
+
+CrossCorrelation::Peak CrossCorrelation::findPeak(const QVector<double> &correlation, int maxLag, int exclusionRadius)
+{
+    Peak peak;
+    peak.valid = false;
+    peak.lag = 0.0;
+    peak.value = -std::numeric_limits<double>::infinity();
+    peak.secondValue = -std::numeric_limits<double>::infinity();
+    
+    int bestIndex = -1;
+    for (int i = 0; i < correlation.size(); ++i) {
+        if (correlation[i] > peak.value) {
+            peak.value = correlation[i];
+            bestIndex = i;
+        }
+    }
+    
+    if (bestIndex < 0) {
+        return peak;
+    }
+    
+    peak.valid = true;
+    peak.lag = bestIndex - maxLag;
+    
+    // Fit a parabola through the peak and its neighbours for sub-sample precision
+    if (bestIndex > 0 && bestIndex + 1 < correlation.size() &&
+        std::isfinite(correlation[bestIndex - 1]) && std::isfinite(correlation[bestIndex + 1])) {
+        double left = correlation[bestIndex - 1];
+        double right = correlation[bestIndex + 1];
+        double denominator = left - 2.0 * peak.value + right;
+        if (denominator < 0.0) {
+            peak.lag += qBound(-0.5, 0.5 * (left - right) / denominator, 0.5);
+        }
+    }
+    
+    for (int i = 0; i < correlation.size(); ++i) {
+        if (std::abs(i - bestIndex) > exclusionRadius) {
+            peak.secondValue = qMax(peak.secondValue, correlation[i]);
+        }
+    }
+    
+    return peak;
+}
@@ -0,0 +1,36 @@
+#ifndef CROSSCORRELATION_H
+#define CROSSCORRELATION_H
+
+#include <QVector>
+#include <complex>
+#include <vector>
+
+// FFT based cross-correlation of uniformly sampled series
+class CrossCorrelation
+{
+public:
+    struct Peak {
+        bool valid;
+        double lag;         // Sub-sample lag of the maximum (b[t + lag] matches a[t])
+        double value;       // Normalized correlation at the maximum
+        double secondValue; // Best value outside the main peak
+    };
+    
+    // Subtracts the mean and divides by the standard deviation
+    static void normalize(QVector<double> &series);
+    
+    // Returns c[lag + maxLag] = mean over t of a[t] * b[t + lag] for lag in
+    // [-maxLag, maxLag], computed in O(n log n). Lags whose overlap is
+    // shorter than minOverlap are set to -infinity.
+    static QVector<double> correlate(const QVector<double> &a, const QVector<double> &b,
+                                     int maxLag, int minOverlap);
+    
+    // Largest value with parabolic sub-sample interpolation; secondValue is
+    // the best value further than exclusionRadius samples away from it
+    static Peak findPeak(const QVector<double> &correlation, int maxLag, int exclusionRadius);
+
+private:
+    static void fft(std::vector<std::complex<double>> &data, bool inverse);
+};
+
+#endif // CROSSCORRELATION_H
@@ -0,0 +1,329 @@
+#include "duplicatefinder.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QHash>
+#include <QMap>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// Signatures this flat (black frames, fades, title cards) match everything
+static const float MIN_KEY_LUMA_STDDEV = 12.0f;
+
+// Keys per file: cuts first, topped up with evenly spaced signatures
+static const int MIN_KEYS_PER_FILE = 16;
+static const int MAX_KEYS_PER_FILE = 128;
+
+// Offset votes are binned this coarsely; a vote also counts for both neighbours
+static const qint64 OFFSET_BIN_MS = 500;
+
+// A pair is a duplicate when this many keys, and this fraction of the keys of
+// the shorter file, match at one offset
+static const int MIN_MATCHING_KEYS = 4;
+static const double MIN_MATCHING_RATIO = 0.25;
+
+// Default key match radius; re-encodes rarely move an average hash further
+static const int DEFAULT_MAX_HASH_DISTANCE = 3;
+
+namespace {
+
+struct OffsetVotes {
+    int count = 0;
+    qint64 offsetSum = 0;
+};
+
+}
+
+MultiIndexHash::MultiIndexHash()
+{
+}
+
+int MultiIndexHash::add(quint64 hash)
+{
+    m_hashes.append(hash);
+    return m_hashes.size() - 1;
+}
+
+void MultiIndexHash::build()
+{
+    // Counting sort of the entries by each substring
+    for (int table = 0; table < TABLES; ++table) {
+        QVector<qint32> &starts = m_bucketStarts[table];
+        starts.fill(0, BUCKETS + 1);
+        for (quint64 hash : m_hashes) {
+            starts[substring(hash, table) + 1]++;
+        }
+        for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+            starts[bucket + 1] += starts[bucket];
+        }
+        
+        QVector<qint32> next = starts;
+        QVector<qint32> &entries = m_entries[table];
+        entries.resize(m_hashes.size());
+        for (int entry = 0; entry < m_hashes.size(); ++entry) {
+            entries[next[substring(m_hashes[entry], table)]++] = entry;
+        }
+    }
+}
+
+DuplicateFinder::DuplicateFinder(QObject *parent)
+    : QObject(parent)
+    , m_maxHashDistance(DEFAULT_MAX_HASH_DISTANCE)
+    , m_cancelRequested(false)
+{
+    // Keyframes sit on cuts in most encodes, and decoding only them is what
+    // makes a whole library affordable
+    m_fingerprintOptions.keyframesOnly = true;
+}
+
+void DuplicateFinder::start()
+{
+    m_index = MultiIndexHash();
+    m_keys.clear();
+    m_fileKeyStarts.clear();
+    
+    QStringList files = collectFiles();
+    emit logMessage(QString("Found %1 video files in %2").arg(files.size()).arg(m_rootDirectory));
+    
+    // Fingerprinting and key selection: the only per-file decoding
+    QVector<int> keyCounts(files.size(), 0);
+    for (int file = 0; file < files.size() && !isCancelled(); ++file) {
+        m_fileKeyStarts.append(m_keys.size());
+        
+        SignatureTrack track = signatureTrack(files[file]);
+        if (track.isEmpty()) {
+            emit logMessage(QString("Skipped (no video): %1").arg(files[file]));
+        }
+        
+        for (int index : selectKeys(track)) {
+            const FrameSignature &signature = track.at(index);
+            m_index.add(signature.perceptualHash);
+            m_keys.append(Key{file, signature.ptsMs});
+        }
+        keyCounts[file] = m_keys.size() - m_fileKeyStarts.last();
+        emit progress(((file + 1) * 80) / files.size());
+    }
+    m_fileKeyStarts.append(m_keys.size());
+    
+    if (isCancelled()) {
+        emit logMessage("Duplicate search cancelled");
+        emit finished(QList<Group>(), files.size());
+        return;
+    }
+    
+    m_index.build();
+    emit logMessage(QString("Indexed %1 key signatures").arg(m_index.size()));
+    
+    QList<Match> matches;
+    for (int file = 0; file < files.size() && !isCancelled(); ++file) {
+        matches += findMatches(file, keyCounts);
+        emit progress(80 + ((file + 1) * 20) / files.size());
+    }
+    
+    if (isCancelled()) {
+        emit logMessage("Duplicate search cancelled");
+        emit finished(QList<Group>(), files.size());
+        return;
+    }
+    
+    QList<Group> groups = groupMatches(files, matches);
+    emit logMessage(QString("%1 matching pairs form %2 duplicate groups").arg(matches.size()).arg(groups.size()));
+    emit progress(100);
+    emit finished(groups, files.size());
+}
+
+QStringList DuplicateFinder::collectFiles() const
+{
+    QStringList videoExtensions = {"*.mp4", "*.avi", "*.mkv", "*.mov", "*.wmv", "*.flv", "*.webm", "*.m4v"};
+    
+    QStringList files;
+    QDirIterator iterator(m_rootDirectory, videoExtensions, QDir::Files, QDirIterator::Subdirectories);
+    while (iterator.hasNext()) {
+        files.append(iterator.next());
+    }
+    files.sort();
+    return files;
+}
+
+SignatureTrack DuplicateFinder::signatureTrack(const QString &filePath)
+{
+    SignatureTrack track;
+    if (m_signatureCache.load(filePath, m_fingerprintOptions, track)) {
+        return track;
+    }
+    
+    VideoFingerprinter fingerprinter;
+    fingerprinter.setOptions(m_fingerprintOptions);
+    fingerprinter.setCancelFlag(&m_cancelRequested);
+    
+    track = fingerprinter.compute(filePath);
+    if (!track.isEmpty() && !isCancelled()) {
+        m_signatureCache.store(filePath, m_fingerprintOptions, track);
+    }
+    return track;
+}
+
+QVector<int> DuplicateFinder::selectKeys(const SignatureTrack &track)
+{
+    // Shot starts survive re-encoding, trimming and re-editing; skip flat
+    // frames and repeats of the previous key
+    QVector<int> cuts;
+    QVector<int> detailed;
+    for (int i = 0; i < track.size(); ++i) {
+        const FrameSignature &signature = track.at(i);
+        if (signature.lumaStdDev < MIN_KEY_LUMA_STDDEV) {
+            continue;
+        }
+        if (!detailed.isEmpty() && track.at(detailed.last()).perceptualHash == signature.perceptualHash) {
+            continue;
+        }
+        detailed.append(i);
+        if (i > 0 && VideoFingerprinter::isSceneChange(track.at(i - 1), signature)) {
+            cuts.append(i);
+        }
+    }
+    
+    QVector<int> keys = cuts.size() >= MIN_KEYS_PER_FILE ? cuts : detailed;
+    if (keys.size() <= MAX_KEYS_PER_FILE) {
+        return keys;
+    }
+    
+    QVector<int> spread;
+    spread.reserve(MAX_KEYS_PER_FILE);
+    for (int i = 0; i < MAX_KEYS_PER_FILE; ++i) {
+        spread.append(keys[(static_cast<qint64>(i) * keys.size()) / MAX_KEYS_PER_FILE]);
+    }
+    return spread;
+}
+
+QList<DuplicateFinder::Match> DuplicateFinder::findMatches(int file, const QVector<int> &keyCounts) const
+{
+    // Votes per (other file, offset bin); each key votes once per bin
+    QHash<QPair<int, qint64>, OffsetVotes> votes;
+    QHash<QPair<int, qint64>, int> lastVoter;
+    
+    for (int key = m_fileKeyStarts[file]; key < m_fileKeyStarts[file + 1]; ++key) {
+        const qint64 ptsA = m_keys[key].ptsMs;
+        m_index.query(m_index.hashAt(key), m_maxHashDistance, [&](int entry, int) {
+            // Only later files, so every pair is examined from one side
+            const Key &match = m_keys[entry];
+            if (match.file <= file) {
+                return;
+            }
+            
+            const qint64 offset = match.ptsMs - ptsA;
+            const qint64 bin = static_cast<qint64>(std::floor(static_cast<double>(offset) / OFFSET_BIN_MS));
+            const QPair<int, qint64> slot(match.file, bin);
+            if (lastVoter.value(slot, -1) == key) {
+                return;
+            }
+            lastVoter.insert(slot, key);
+            
+            OffsetVotes &binVotes = votes[slot];
+            binVotes.count++;
+            binVotes.offsetSum += offset;
+        });
+    }
+    
+    // Best offset per other file, counting neighbouring bins along
+    QHash<int, Match> best;
+    for (auto it = votes.constBegin(); it != votes.constEnd(); ++it) {
+        const int other = it.key().first;
+        const qint64 bin = it.key().second;
+        
+        int count = 0;
+        qint64 offsetSum = 0;
+        for (qint64 neighbour = bin - 1; neighbour <= bin + 1; ++neighbour) {
+            OffsetVotes binVotes = votes.value(QPair<int, qint64>(other, neighbour));
+            count += binVotes.count;
+            offsetSum += binVotes.offsetSum;
+        }
+        
+        const int shorter = qMax(1, qMin(keyCounts[file], keyCounts[other]));
+        const double score = qMin(1.0, static_cast<double>(count) / shorter);
+        if (count < MIN_MATCHING_KEYS || score < MIN_MATCHING_RATIO) {
+            continue;
+        }
+        
+        if (!best.contains(other) || score > best[other].score) {
+            best.insert(other, Match{file, other, offsetSum / count, score});
+        }
+    }
+    
+    return best.values();
+}
+
+QList<DuplicateFinder::Group> DuplicateFinder::groupMatches(const QStringList &files, const QList<Match> &matches) const
+{
+    // Union-find that also tracks each file's offset relative to its root
+    QVector<int> parent(files.size());
+    QVector<int> rank(files.size(), 0);
+    QVector<qint64> offset(files.size(), 0);
+    for (int file = 0; file < files.size(); ++file) {
+        parent[file] = file;
+    }
+    
+    std::function<int(int)> find = [&](int file) {
+        if (parent[file] == file) {
+            return file;
+        }
+        int root = find(parent[file]);
+        offset[file] += offset[parent[file]];
+        parent[file] = root;
+        return root;
+    };
+    
+    QHash<int, double> weakestLink;
+    for (const Match &match : matches) {
+        int rootA = find(match.fileA);
+        int rootB = find(match.fileB);
+        if (rootA == rootB) {
+            continue;
+        }
+        
+        // Position of the content in B relative to A's root
+        qint64 offsetB = offset[match.fileA] + match.offsetMs;
+        double score = qMin(weakestLink.value(rootA, 1.0), weakestLink.value(rootB, 1.0));
+        score = qMin(score, match.score);
+        
+        if (rank[rootA] < rank[rootB]) {
+            parent[rootA] = rootB;
+            offset[rootA] = offset[match.fileB] - offsetB;
+            weakestLink.insert(rootB, score);
+        } else {
+            parent[rootB] = rootA;
+            offset[rootB] = offsetB - offset[match.fileB];
+            weakestLink.insert(rootA, score);
+            if (rank[rootA] == rank[rootB]) {
+                rank[rootA]++;
+            }
+        }
+    }
+    
+    QMap<int, QList<int>> members;
+    for (int file = 0; file < files.size(); ++file) {
+        members[find(file)].append(file);
+    }
+    
+    QList<Group> groups;
+    for (auto it = members.constBegin(); it != members.constEnd(); ++it) {
+        if (it.value().size() < 2) {
+            continue;
+        }
+        
+        Group group;
+        group.score = weakestLink.value(it.key(), 1.0);
+        const qint64 firstOffset = offset[it.value().first()];
+        for (int file : it.value()) {
+            group.paths.append(files[file]);
+            group.offsetsMs.append(offset[file] - firstOffset);
+        }
+        groups.append(group);
+    }
+    
+    std::sort(groups.begin(), groups.end(), [](const Group &a, const Group &b) {
+        return a.paths.size() != b.paths.size() ? a.paths.size() > b.paths.size() : a.score > b.score;
+    });
+    return groups;
+}
@@ -0,0 +1,151 @@
+#ifndef DUPLICATEFINDER_H
+#define DUPLICATEFINDER_H
+
+#include "videofingerprint.h"
+#include "signaturecache.h"
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <atomic>
+
+// Multi-index hashing over 64 bit perceptual hashes. The hash is split into
+// four 16 bit substrings with one table each; a hash within distance r of
+// the query agrees with it on some substring to within r / 4 bits, so a
+// query only visits a handful of buckets instead of every entry.
+class MultiIndexHash
+{
+public:
+    static const int MAX_DISTANCE = 7;
+    
+    MultiIndexHash();
+    
+    void reserve(int count) { m_hashes.reserve(count); }
+    // Entries are numbered in the order they are added
+    int add(quint64 hash);
+    // Builds the tables; call once after the last add()
+    void build();
+    
+    int size() const { return m_hashes.size(); }
+    quint64 hashAt(int entry) const { return m_hashes[entry]; }
+    
+    // Calls visit(entry, distance) once for every entry within maxDistance
+    // (at most MAX_DISTANCE) of hash
+    template<typename Visitor>
+    void query(quint64 hash, int maxDistance, Visitor visit) const;
+
+private:
+    static const int TABLES = 4;
+    static const int BUCKETS = 1 << 16;
+    
+    static quint16 substring(quint64 hash, int table) { return static_cast<quint16>(hash >> (16 * table)); }
+    
+    QVector<quint64> m_hashes;
+    // Per table: entries sorted by substring, and where each bucket starts
+    QVector<qint32> m_entries[TABLES];
+    QVector<qint32> m_bucketStarts[TABLES];
+};
+
+template<typename Visitor>
+void MultiIndexHash::query(quint64 hash, int maxDistance, Visitor visit) const
+{
+    maxDistance = qBound(0, maxDistance, static_cast<int>(MAX_DISTANCE));
+    const int substringDistance = maxDistance / TABLES;
+    
+    for (int table = 0; table < TABLES; ++table) {
+        const quint16 key = substring(hash, table);
+        
+        // The exact bucket, then every bucket one bit away if the radius needs it
+        for (int flip = -1; flip < (substringDistance > 0 ? 16 : 0); ++flip) {
+            const quint16 bucket = flip < 0 ? key : static_cast<quint16>(key ^ (1u << flip));
+            for (int i = m_bucketStarts[table][bucket]; i < m_bucketStarts[table][bucket + 1]; ++i) {
+                const int entry = m_entries[table][i];
+                const quint64 candidate = m_hashes[entry];
+                const int distance = VideoFingerprinter::hammingDistance(hash, candidate);
+                if (distance > maxDistance) {
+                    continue;
+                }
+                
+                // Report each entry from the first table it can be found in only
+                bool seenEarlier = false;
+                for (int earlier = 0; earlier < table && !seenEarlier; ++earlier) {
+                    seenEarlier = VideoFingerprinter::hammingDistance(substring(hash, earlier),
+                                                                      substring(candidate, earlier)) <= substringDistance;
+                }
+                if (!seenEarlier) {
+                    visit(entry, distance);
+                }
+            }
+        }
+    }
+}
+
+// Finds duplicate and near-duplicate videos in a directory tree. Every file
+// is fingerprinted once (through the signature cache) and contributes a few
+// key signatures at scene cuts to a multi-index hash. Each file then queries
+// the index with its keys, and files whose matching keys agree on one time
+// offset are grouped, so no pair of files is ever compared directly.
+class DuplicateFinder : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Group {
+        QStringList paths;
+        // Where the content at t in paths.first() appears in each path, as t + offset
+        QList<qint64> offsetsMs;
+        // Weakest link of the group: fraction of keys agreeing on one offset
+        double score;
+    };
+    
+    explicit DuplicateFinder(QObject *parent = nullptr);
+    
+    void setRootDirectory(const QString &directory) { m_rootDirectory = directory; }
+    void setFingerprintOptions(const VideoFingerprinter::Options &options) { m_fingerprintOptions = options; }
+    // Largest Hamming distance at which two key signatures still match
+    void setMaxHashDistance(int distance) { m_maxHashDistance = distance; }
+    
+    // Safe to call from any thread
+    void cancel() { m_cancelRequested = true; }
+
+public slots:
+    void start();
+
+signals:
+    void progress(int percentage);
+    void logMessage(const QString &message);
+    void finished(const QList<DuplicateFinder::Group> &groups, int fileCount);
+
+private:
+    struct Key {
+        qint32 file;
+        qint64 ptsMs;
+    };
+    
+    struct Match {
+        int fileA;
+        int fileB;
+        qint64 offsetMs; // Content at t in fileA appears at t + offsetMs in fileB
+        double score;
+    };
+    
+    bool isCancelled() const { return m_cancelRequested.load(); }
+    QStringList collectFiles() const;
+    SignatureTrack signatureTrack(const QString &filePath);
+    static QVector<int> selectKeys(const SignatureTrack &track);
+    QList<Match> findMatches(int file, const QVector<int> &keyCounts) const;
+    QList<Group> groupMatches(const QStringList &files, const QList<Match> &matches) const;
+    
+    QString m_rootDirectory;
+    VideoFingerprinter::Options m_fingerprintOptions;
+    int m_maxHashDistance;
+    std::atomic<bool> m_cancelRequested;
+    SignatureCache m_signatureCache;
+    
+    // Index of the key signatures of all files; m_keys runs parallel to it
+    MultiIndexHash m_index;
+    QVector<Key> m_keys;
+    QVector<int> m_fileKeyStarts;
+};
+
+#endif // DUPLICATEFINDER_H
@@ -0,0 +1,182 @@
+#include "etamodel.h"
+#include <algorithm>
+
+// Weight of the newest job in a device's rate
+static const double RATE_SMOOTHING = 0.3;
+
+// Shorter jobs are mostly open and close overhead, not throughput
+static const qint64 MIN_SAMPLE_MS = 500;
+
+EtaModel::EtaModel()
+    : m_parallelJobs(1)
+{
+}
+
+void EtaModel::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_jobs.clear();
+    m_rates.clear();
+}
+
+void EtaModel::setParallelJobs(int count)
+{
+    QMutexLocker locker(&m_mutex);
+    m_parallelJobs = qMax(1, count);
+}
+
+void EtaModel::addJob(int jobIndex, qint64 bytes, quint64 device)
+{
+    QMutexLocker locker(&m_mutex);
+    Job &job = m_jobs[jobIndex];
+    job.bytes = bytes;
+    job.device = device;
+}
+
+qint64 EtaModel::jobBytes(int jobIndex) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_jobs.value(jobIndex).bytes;
+}
+
+quint64 EtaModel::jobDevice(int jobIndex) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_jobs.value(jobIndex).device;
+}
+
+void EtaModel::jobsStarted(const QList<int> &jobIndexes)
+{
+    QMutexLocker locker(&m_mutex);
+    for (int index : jobIndexes) {
+        auto job = m_jobs.find(index);
+        if (job != m_jobs.end()) {
+            job->running = true;
+            job->timer.start();
+        }
+    }
+}
+
+void EtaModel::jobsFinished(const QList<int> &jobIndexes, bool learn)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    // The group's bytes per device over the group's time
+    QHash<quint64, qint64> bytes;
+    qint64 elapsedMs = 0;
+    for (int index : jobIndexes) {
+        auto job = m_jobs.find(index);
+        if (job == m_jobs.end()) {
+            continue;
+        }
+        if (job->running) {
+            bytes[job->device] += job->bytes;
+            elapsedMs = qMax(elapsedMs, job->timer.elapsed());
+        }
+        m_jobs.erase(job);
+    }
+    
+    if (!learn || elapsedMs < MIN_SAMPLE_MS) {
+        return;
+    }
+    for (auto it = bytes.constBegin(); it != bytes.constEnd(); ++it) {
+        const double sample = it.value() * 1000.0 / elapsedMs;
+        auto rate = m_rates.find(it.key());
+        if (rate == m_rates.end()) {
+            m_rates.insert(it.key(), sample);
+        } else {
+            *rate = RATE_SMOOTHING * sample + (1.0 - RATE_SMOOTHING) * *rate;
+        }
+    }
+}
+
+qint64 EtaModel::remainingMs() const
+{
+    QMutexLocker locker(&m_mutex);
+    
+    // Jobs on one device queue behind each other, while the parallel jobs
+    // share the total; the slower of the two bounds the batch
+    QHash<quint64, qint64> deviceMs;
+    qint64 totalMs = 0;
+    for (const Job &job : m_jobs) {
+        const qint64 ms = jobRemainingLocked(job);
+        if (ms < 0) {
+            return -1;
+        }
+        deviceMs[job.device] += ms;
+        totalMs += ms;
+    }
+    
+    qint64 longestDeviceMs = 0;
+    for (qint64 ms : deviceMs) {
+        longestDeviceMs = qMax(longestDeviceMs, ms);
+    }
+    return qMax(longestDeviceMs, totalMs / m_parallelJobs);
+}
+
+qint64 EtaModel::jobRemainingMs(int jobIndex) const
+{
+    QMutexLocker locker(&m_mutex);
+    auto job = m_jobs.constFind(jobIndex);
+    return job != m_jobs.constEnd() ? jobRemainingLocked(*job) : 0;
+}
+
+QList<int> EtaModel::runningJobs() const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<int> running;
+    for (auto it = m_jobs.constBegin(); it != m_jobs.constEnd(); ++it) {
+        if (it->running) {
+            running.append(it.key());
+        }
+    }
+    std::sort(running.begin(), running.end());
+    return running;
+}
+
+double EtaModel::rateMBps(quint64 device) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_rates.value(device) / 1048576.0;
+}
+
+QString EtaModel::formatDuration(qint64 ms)
+{
+    const qint64 seconds = (ms + 999) / 1000;
+    if (seconds < 60) {
+        return QString("%1 s").arg(seconds);
+    }
+    const qint64 minutes = (seconds + 30) / 60;
+    if (minutes < 60) {
+        return QString("%1 min").arg(minutes);
+    }
+    return QString("%1 h %2 min").arg(minutes / 60).arg(minutes % 60, 2, 10, QChar('0'));
+}
+
+double EtaModel::rateLocked(quint64 device) const
+{
+    auto rate = m_rates.constFind(device);
+    if (rate != m_rates.constEnd()) {
+        return *rate;
+    }
+    if (m_rates.isEmpty()) {
+        return 0.0;
+    }
+    
+    double sum = 0.0;
+    for (double known : m_rates) {
+        sum += known;
+    }
+    return sum / m_rates.size();
+}
+
+qint64 EtaModel::jobRemainingLocked(const Job &job) const
+{
+    const double rate = rateLocked(job.device);
+    if (rate <= 0.0) {
+        return -1;
+    }
+    
+    const qint64 expectedMs = static_cast<qint64>(job.bytes * 1000.0 / rate);
+    return job.running ? qMax<qint64>(0, expectedMs - job.timer.elapsed()) : expectedMs;
+}
@@ -0,0 +1,64 @@
+#ifndef ETAMODEL_H
+#define ETAMODEL_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QString>
+
+// Remaining time of a batch from the sizes of its jobs and the throughput
+// measured so far. Rates are learned per device, as an exponentially
+// weighted average over finished jobs, so a slow network share does not
+// skew the estimate for a local disk. Thread-safe.
+class EtaModel
+{
+public:
+    EtaModel();
+    
+    void clear();
+    // Jobs running at once
+    void setParallelJobs(int count);
+    
+    // bytes: what the job reads; device: where most of it comes from
+    void addJob(int jobIndex, qint64 bytes, quint64 device);
+    qint64 jobBytes(int jobIndex) const;
+    quint64 jobDevice(int jobIndex) const;
+    
+    // A fan-out group runs as one: its rate is the bytes of all its jobs
+    // over the time they took together
+    void jobsStarted(const QList<int> &jobIndexes);
+    // learn: whether the time taken is a valid throughput sample
+    void jobsFinished(const QList<int> &jobIndexes, bool learn);
+    
+    // Time left for all unfinished jobs; -1 until a rate is known
+    qint64 remainingMs() const;
+    // Time left for a running job; -1 until a rate is known
+    qint64 jobRemainingMs(int jobIndex) const;
+    QList<int> runningJobs() const;
+    // Learned rate of a device, 0 if none yet
+    double rateMBps(quint64 device) const;
+    
+    // "1 h 05 min", "12 min", "40 s"
+    static QString formatDuration(qint64 ms);
+
+private:
+    struct Job {
+        qint64 bytes = 0;
+        quint64 device = 0;
+        bool running = false;
+        QElapsedTimer timer;
+    };
+    
+    // Bytes per second for device; the average of the known devices for a
+    // new one, 0 if nothing is known
+    double rateLocked(quint64 device) const;
+    qint64 jobRemainingLocked(const Job &job) const;
+    
+    mutable QMutex m_mutex;
+    QHash<int, Job> m_jobs;               // Unfinished jobs
+    QHash<quint64, double> m_rates;       // Bytes per second, per device
+    int m_parallelJobs;
+};
+
+#endif // ETAMODEL_H
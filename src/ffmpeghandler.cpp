@@ -1,8 +1,10 @@
 #include "ffmpeghandler.h"
+#include "remuxer.h"
 #include <QDebug>
 #include <QFileInfo>
 #include <QDir>
 #include <QProcess>
+#include <QSet>
 #include <cmath>
 
 FFmpegHandler::FFmpegHandler()
@@ -258,53 +260,193 @@ bool FFmpegHandler::mergeTracks(const QString &sourceFile,
                                const QString &targetFile, 
                                const QString &outputFile,
                                const QList<QPair<QString, int>> &selectedAudioTracks,
-                               const QList<QPair<QString, int>> &selectedSubtitleTracks)
+                               const QList<QPair<QString, int>> &selectedSubtitleTracks,
+                               qint64 sourceOffsetMs)
 {
+    MergeOutput output;
+    output.targetFile = targetFile;
+    output.outputFile = outputFile;
+    output.selectedAudioTracks = selectedAudioTracks;
+    output.selectedSubtitleTracks = selectedSubtitleTracks;
+    
+    return mergeTracksFanOut(sourceFile, QList<MergeOutput>() << output, sourceOffsetMs);
+}
+
+bool FFmpegHandler::mergeTracksFanOut(const QString &sourceFile,
+                                      const QList<MergeOutput> &outputs,
+                                      qint64 sourceOffsetMs)
+{
+    if (outputs.isEmpty()) {
+        return false;
+    }
+    
+    // Two outputs on one path would be written over each other
+    QSet<QString> outputFiles;
+    for (const MergeOutput &output : outputs) {
+        QString outputFile = QFileInfo(output.outputFile).absoluteFilePath();
+        if (outputFiles.contains(outputFile)) {
+            qWarning() << "Fan-out refused, output written twice:" << outputFile;
+            return false;
+        }
+        outputFiles.insert(outputFile);
+    }
+    
+    Remuxer remuxer;
+    remuxer.setIOOptions(m_ioOptions);
+    if (remuxer.run(sourceFile, outputs, sourceOffsetMs)) {
+        m_lastReadStats = remuxer.readStats();
+        return true;
+    }
+    
+    // The command line handles what the stream copy above cannot, such as
+    // codecs the output container needs converted tags for
+    qWarning() << "In-process merge failed, falling back to ffmpeg:" << remuxer.errorString();
+    m_lastReadStats = MediaIO::Stats();
+    
     QStringList arguments;
+    
+    // Shift the source streams in the same stream-copy pass. A delay just
+    // offsets their timestamps; an advance drops the start of the source
+    // instead, since negative timestamps would make the muxer shift the
+    // target video along with them
+    if (sourceOffsetMs > 0) {
+        arguments << "-itsoffset" << QString::number(sourceOffsetMs / 1000.0, 'f', 3);
+    } else if (sourceOffsetMs < 0) {
+        arguments << "-ss" << QString::number(-sourceOffsetMs / 1000.0, 'f', 3);
+    }
     arguments << "-i" << sourceFile;  // Input 0: source video
-    arguments << "-i" << targetFile;  // Input 1: target video
     
-    // Always map the video stream from target (base video)
-    arguments << "-map" << "1:v:0";
+    // Inputs 1..N: one target video per output
+    for (const MergeOutput &output : outputs) {
+        arguments << "-i" << output.targetFile;
+    }
     
-    // Map selected audio tracks
-    for (const auto &track : selectedAudioTracks) {
-        QString source = track.first;
-        int trackIndex = track.second;
+    // ffmpeg demuxes every input once and hands each source packet to all
+    // outputs that map its stream
+    for (int i = 0; i < outputs.size(); ++i) {
+        const MergeOutput &output = outputs[i];
+        const int targetInput = i + 1;
+        
+        // Always map the video stream from target (base video)
+        arguments << "-map" << QString("%1:v:0").arg(targetInput);
+        
+        // Map selected audio tracks, then selected subtitle tracks
+        QList<QPair<QString, int>> tracks = output.selectedAudioTracks;
+        tracks += output.selectedSubtitleTracks;
+        for (const auto &track : tracks) {
+            QString source = track.first;
+            int trackIndex = track.second;
+            
+            if (source == "source") {
+                arguments << "-map" << QString("0:%1").arg(trackIndex);
+            } else if (source == "target") {
+                arguments << "-map" << QString("%1:%2").arg(targetInput).arg(trackIndex);
+            }
+        }
         
-        if (source == "source") {
-            arguments << "-map" << QString("0:%1").arg(trackIndex);
-        } else if (source == "target") {
-            arguments << "-map" << QString("1:%1").arg(trackIndex);
+        // Copy all streams without re-encoding
+        arguments << "-c" << "copy";
+        
+        // Targets of different bitrates drain at different rates, so give
+        // the slower outputs room to queue source packets
+        if (outputs.size() > 1) {
+            arguments << "-max_muxing_queue_size" << "4096";
         }
+        
+        // Output file
+        arguments << output.outputFile;
     }
     
-    // Map selected subtitle tracks
-    for (const auto &track : selectedSubtitleTracks) {
-        QString source = track.first;
-        int trackIndex = track.second;
+    // Overwrite output file if it exists
+    arguments << "-y";
+    
+    QProcess ffmpeg;
+    ffmpeg.start("ffmpeg", arguments);
+    ffmpeg.waitForFinished(-1);
+    
+    return ffmpeg.exitCode() == 0;
+}
+
+QStringList FFmpegHandler::extractTracks(const QString &sourceFile,
+                                        const QList<int> &audioTrackIndexes,
+                                        const QList<int> &subtitleTrackIndexes,
+                                        const QString &outputDir)
+{
+    QDir dir(outputDir);
+    if (!dir.exists()) {
+        dir.mkpath(outputDir);
+    }
+    
+    QString baseName = QFileInfo(sourceFile).completeBaseName();
+    
+    QStringList arguments;
+    arguments << "-i" << sourceFile;
+    
+    // One output per track; ffmpeg demuxes the source once and feeds them all
+    QStringList outputFiles;
+    auto addOutput = [&](int index, const QString &language, const QString &codec, bool subtitle) {
+        QString suffix = extractionSuffix(codec, subtitle);
+        QString outputFile = dir.absoluteFilePath(QString("%1.%2.%3.%4").arg(baseName).arg(index).arg(language).arg(suffix));
         
-        if (source == "source") {
-            arguments << "-map" << QString("0:%1").arg(trackIndex);
-        } else if (source == "target") {
-            arguments << "-map" << QString("1:%1").arg(trackIndex);
+        arguments << "-map" << QString("0:%1").arg(index);
+        // MP4 text subtitles have no standalone container; convert them to SubRip
+        if (subtitle && (codec == "mov_text" || codec == "text")) {
+            arguments << "-c" << "srt";
+        } else {
+            arguments << "-c" << "copy";
         }
-    }
+        arguments << outputFile;
+        outputFiles.append(outputFile);
+    };
     
-    // Copy all streams without re-encoding
-    arguments << "-c" << "copy";
+    for (const AudioTrackInfo &track : getAudioTracks(sourceFile)) {
+        if (audioTrackIndexes.contains(track.index)) {
+            addOutput(track.index, track.language, track.codec, false);
+        }
+    }
+    for (const SubtitleTrackInfo &track : getSubtitleTracks(sourceFile)) {
+        if (subtitleTrackIndexes.contains(track.index)) {
+            addOutput(track.index, track.language, track.codec, true);
+        }
+    }
     
-    // Output file
-    arguments << outputFile;
+    if (outputFiles.isEmpty()) {
+        qWarning() << "No selected tracks found in" << sourceFile;
+        return QStringList();
+    }
     
-    // Overwrite output file if it exists
+    // Overwrite output files if they exist
     arguments << "-y";
     
     QProcess ffmpeg;
     ffmpeg.start("ffmpeg", arguments);
     ffmpeg.waitForFinished(-1);
     
-    return ffmpeg.exitCode() == 0;
+    return ffmpeg.exitCode() == 0 ? outputFiles : QStringList();
+}
+
+QString FFmpegHandler::extractionSuffix(const QString &codecName, bool subtitle)
+{
+    // Matroska holds any audio codec as-is
+    if (!subtitle) {
+        return "mka";
+    }
+    
+    if (codecName == "subrip" || codecName == "srt" || codecName == "mov_text" || codecName == "text") {
+        return "srt";
+    }
+    if (codecName == "ass" || codecName == "ssa") {
+        return "ass";
+    }
+    if (codecName == "pgssub") {
+        return "sup";
+    }
+    if (codecName == "webvtt") {
+        return "vtt";
+    }
+    
+    // Bitmap formats such as DVD and DVB subtitles
+    return "mks";
 }
 
 bool FFmpegHandler::batchTransferTracks(const QStringList &sourceFiles,
@@ -416,24 +558,11 @@ QList<ChapterInfo> FFmpegHandler::getChapters(const QString &filePath)
 
 AVFormatContext* FFmpegHandler::openVideoFile(const QString &filePath)
 {
-    AVFormatContext *formatContext = nullptr;
-    
-    if (avformat_open_input(&formatContext, filePath.toUtf8().data(), nullptr, nullptr) != 0) {
-        return nullptr;
-    }
-    
-    // Use simpler approach without dictionary options to avoid memory issues
-    if (avformat_find_stream_info(formatContext, nullptr) < 0) {
-        avformat_close_input(&formatContext);
-        return nullptr;
-    }
-    
-    return formatContext;
+    // Large reads keep probing fast on network shares
+    return MediaIO::openInput(filePath, MediaIO::probeOptions());
 }
 
 void FFmpegHandler::closeVideoFile(AVFormatContext *formatContext)
 {
-    if (formatContext) {
-        avformat_close_input(&formatContext);
-    }
-}
\ No newline at end of file
+    MediaIO::closeInput(formatContext);
+}
@@ -4,6 +4,7 @@
 #include <QString>
 #include <QStringList>
 #include <QImage>
+#include "mediaio.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -37,12 +38,26 @@ struct ChapterInfo {
     QString formattedTime;
 };
 
+// One output of a track merge: the target's video plus the selected tracks,
+// each given as ("source" or "target", stream index)
+struct MergeOutput {
+    QString targetFile;
+    QString outputFile;
+    QList<QPair<QString, int>> selectedAudioTracks;
+    QList<QPair<QString, int>> selectedSubtitleTracks;
+};
+
 class FFmpegHandler
 {
 public:
     FFmpegHandler();
     ~FFmpegHandler();
     
+    // Read buffering for merges; probing always uses MediaIO::probeOptions()
+    void setIOOptions(const MediaIO::Options &options) { m_ioOptions = options; }
+    // Reads of the last merge, empty when it went through the ffmpeg command line
+    MediaIO::Stats lastReadStats() const { return m_lastReadStats; }
+    
     // Video information
     qint64 getVideoDuration(const QString &filePath);
     QImage extractFrame(const QString &filePath, qint64 timestampMs);
@@ -61,12 +76,29 @@ public:
                        const QList<int> &audioTrackIndexes,
                        const QList<int> &subtitleTrackIndexes);
     
-    // New merge tracks operation
+    // New merge tracks operation. sourceOffsetMs shifts the source tracks:
+    // source content at t plays at t + sourceOffsetMs in the output
     bool mergeTracks(const QString &sourceFile,
                     const QString &targetFile, 
                     const QString &outputFile,
                     const QList<QPair<QString, int>> &selectedAudioTracks,
-                    const QList<QPair<QString, int>> &selectedSubtitleTracks);
+                    const QList<QPair<QString, int>> &selectedSubtitleTracks,
+                    qint64 sourceOffsetMs = 0);
+    
+    // Merges one source into several targets in a single pass, so the source
+    // is read and demuxed once for all of them. Runs in-process through
+    // Remuxer, with the ffmpeg command line as fallback
+    bool mergeTracksFanOut(const QString &sourceFile,
+                           const QList<MergeOutput> &outputs,
+                           qint64 sourceOffsetMs = 0);
+    
+    // Writes each selected source track to its own file in outputDir, all in
+    // one read of the source. Files are named <source>.<index>.<language>.<ext>;
+    // returns the files written, or nothing on failure
+    QStringList extractTracks(const QString &sourceFile,
+                              const QList<int> &audioTrackIndexes,
+                              const QList<int> &subtitleTrackIndexes,
+                              const QString &outputDir);
     
     // Batch operations
     bool batchTransferTracks(const QStringList &sourceFiles,
@@ -78,10 +110,14 @@ public:
 
 private:
     void initializeFFmpeg();
+    // File suffix for a stream-copied track, from its decoder name
+    static QString extractionSuffix(const QString &codecName, bool subtitle);
     AVFormatContext* openVideoFile(const QString &filePath);
     void closeVideoFile(AVFormatContext *formatContext);
     
     bool m_initialized;
+    MediaIO::Options m_ioOptions;
+    MediaIO::Stats m_lastReadStats;
 };
 
 #endif // FFMPEGHANDLER_H
\ No newline at end of file
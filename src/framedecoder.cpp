@@ -0,0 +1,259 @@
+#include "framedecoder.h"
+#include <algorithm>
+
+// Targets closer than this to the last decoded frame are reached by decoding
+// forward; anything further away (or behind) triggers a keyframe seek
+static const qint64 FORWARD_DECODE_LIMIT_MS = 2000;
+
+FrameDecoder::FrameDecoder()
+    : m_formatContext(nullptr)
+    , m_codecContext(nullptr)
+    , m_swsContext(nullptr)
+    , m_packet(nullptr)
+    , m_frame(nullptr)
+    , m_videoStreamIndex(-1)
+    , m_timeBase{1, 1000}
+    , m_startTimeMs(0)
+    , m_lastFrameMs(-1)
+    , m_endOfStream(false)
+    , m_frameHasTimestamp(false)
+    , m_outputWidth(0)
+    , m_outputHeight(0)
+    , m_threadCount(0)
+    , m_skipFrames(AVDISCARD_DEFAULT)
+{
+}
+
+FrameDecoder::~FrameDecoder()
+{
+    close();
+}
+
+bool FrameDecoder::open(const QString &filePath)
+{
+    close();
+    
+    if (avformat_open_input(&m_formatContext, filePath.toUtf8().constData(), nullptr, nullptr) != 0) {
+        m_formatContext = nullptr;
+        return false;
+    }
+    
+    if (avformat_find_stream_info(m_formatContext, nullptr) < 0) {
+        close();
+        return false;
+    }
+    
+    const AVCodec *codec = nullptr;
+    m_videoStreamIndex = av_find_best_stream(m_formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (m_videoStreamIndex < 0 || !codec) {
+        close();
+        return false;
+    }
+    
+    // Only the video stream is decoded, so let the demuxer skip everything else
+    for (unsigned int i = 0; i < m_formatContext->nb_streams; i++) {
+        if (static_cast<int>(i) != m_videoStreamIndex) {
+            m_formatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    
+    AVStream *stream = m_formatContext->streams[m_videoStreamIndex];
+    
+    m_codecContext = avcodec_alloc_context3(codec);
+    if (!m_codecContext) {
+        close();
+        return false;
+    }
+    
+    avcodec_parameters_to_context(m_codecContext, stream->codecpar);
+    m_codecContext->thread_count = m_threadCount;
+    m_codecContext->skip_frame = m_skipFrames;
+    
+    if (avcodec_open2(m_codecContext, codec, nullptr) < 0) {
+        close();
+        return false;
+    }
+    
+    m_timeBase = stream->time_base;
+    m_startTimeMs = (m_formatContext->start_time != AV_NOPTS_VALUE)
+                        ? m_formatContext->start_time / 1000 : 0;
+    
+    m_packet = av_packet_alloc();
+    m_frame = av_frame_alloc();
+    m_lastFrameMs = -1;
+    m_endOfStream = false;
+    m_frameHasTimestamp = false;
+    
+    return true;
+}
+
+void FrameDecoder::close()
+{
+    if (m_swsContext) {
+        sws_freeContext(m_swsContext);
+        m_swsContext = nullptr;
+    }
+    if (m_frame) {
+        av_frame_free(&m_frame);
+    }
+    if (m_packet) {
+        av_packet_free(&m_packet);
+    }
+    if (m_codecContext) {
+        avcodec_free_context(&m_codecContext);
+    }
+    if (m_formatContext) {
+        avformat_close_input(&m_formatContext);
+    }
+    
+    m_videoStreamIndex = -1;
+    m_lastFrameMs = -1;
+    m_endOfStream = false;
+}
+
+void FrameDecoder::setOutputSize(int width, int height)
+{
+    m_outputWidth = qMax(0, width);
+    m_outputHeight = qMax(0, height);
+}
+
+void FrameDecoder::setThreadCount(int threadCount)
+{
+    m_threadCount = qMax(0, threadCount);
+}
+
+void FrameDecoder::setSkipFrames(AVDiscard skipFrames)
+{
+    m_skipFrames = skipFrames;
+    if (m_codecContext) {
+        m_codecContext->skip_frame = skipFrames;
+    }
+}
+
+bool FrameDecoder::currentFrameIsKeyframe() const
+{
+    if (!m_frame) {
+        return false;
+    }
+#ifdef AV_FRAME_FLAG_KEY
+    return (m_frame->flags & AV_FRAME_FLAG_KEY) != 0;
+#else
+    return m_frame->key_frame != 0;
+#endif
+}
+
+qint64 FrameDecoder::durationMs() const
+{
+    if (!m_formatContext || m_formatContext->duration == AV_NOPTS_VALUE) {
+        return 0;
+    }
+    return m_formatContext->duration / 1000;
+}
+
+QImage FrameDecoder::frameAt(qint64 timestampMs)
+{
+    if (!isOpen()) {
+        return QImage();
+    }
+    
+    // A seek lands on the last keyframe at or before the target, so with one
+    // past the current frame it never decodes more than going forward would
+    bool decodeForward = m_lastFrameMs >= 0 && !m_endOfStream &&
+                         timestampMs > m_lastFrameMs &&
+                         timestampMs - m_lastFrameMs <= FORWARD_DECODE_LIMIT_MS &&
+                         !keyframeBetween(m_lastFrameMs, timestampMs);
+    
+    if (!decodeForward && !seekTo(timestampMs)) {
+        return QImage();
+    }
+    
+    while (decodeNextFrame()) {
+        if (!m_frameHasTimestamp || m_lastFrameMs >= timestampMs) {
+            return convertCurrentFrame();
+        }
+    }
+    
+    return QImage();
+}
+
+bool FrameDecoder::keyframeBetween(qint64 afterMs, qint64 upToMs) const
+{
+    auto keyframe = std::upper_bound(m_keyframesMs.constBegin(), m_keyframesMs.constEnd(), afterMs);
+    return keyframe != m_keyframesMs.constEnd() && *keyframe <= upToMs;
+}
+
+bool FrameDecoder::seekTo(qint64 timestampMs)
+{
+    qint64 seekTarget = (timestampMs + m_startTimeMs) * AV_TIME_BASE / 1000;
+    if (av_seek_frame(m_formatContext, -1, seekTarget, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+    
+    avcodec_flush_buffers(m_codecContext);
+    m_lastFrameMs = -1;
+    m_endOfStream = false;
+    return true;
+}
+
+bool FrameDecoder::decodeNextFrame()
+{
+    while (true) {
+        int ret = avcodec_receive_frame(m_codecContext, m_frame);
+        if (ret == 0) {
+            int64_t pts = m_frame->best_effort_timestamp;
+            if (pts == AV_NOPTS_VALUE) {
+                pts = m_frame->pts;
+            }
+            
+            m_frameHasTimestamp = (pts != AV_NOPTS_VALUE);
+            if (m_frameHasTimestamp) {
+                // Rounded up, so a frame's time as a seek target never lands before it
+                m_lastFrameMs = av_rescale_q_rnd(pts, m_timeBase, AVRational{1, 1000}, AV_ROUND_UP) - m_startTimeMs;
+            }
+            return true;
+        }
+        
+        if (ret != AVERROR(EAGAIN)) {
+            // AVERROR_EOF after draining, or a decoder error
+            m_endOfStream = true;
+            return false;
+        }
+        
+        if (av_read_frame(m_formatContext, m_packet) < 0) {
+            // End of file - drain the frames still buffered in the decoder
+            avcodec_send_packet(m_codecContext, nullptr);
+            continue;
+        }
+        
+        if (m_packet->stream_index == m_videoStreamIndex) {
+            // Corrupt packets are skipped; the decoder resyncs on its own
+            avcodec_send_packet(m_codecContext, m_packet);
+        }
+        av_packet_unref(m_packet);
+    }
+}
+
+QImage FrameDecoder::convertCurrentFrame()
+{
+    int outputWidth = m_outputWidth > 0 ? m_outputWidth : m_frame->width;
+    int outputHeight = m_outputHeight > 0 ? m_outputHeight : m_frame->height;
+    
+    m_swsContext = sws_getCachedContext(m_swsContext,
+                                        m_frame->width, m_frame->height,
+                                        static_cast<AVPixelFormat>(m_frame->format),
+                                        outputWidth, outputHeight, AV_PIX_FMT_RGB24,
+                                        SWS_AREA, nullptr, nullptr, nullptr);
+    if (!m_swsContext) {
+        return QImage();
+    }
+    
+    // Scale straight into the image buffer to avoid an extra copy
+    QImage image(outputWidth, outputHeight, QImage::Format_RGB888);
+    uint8_t *dstData[4] = { image.bits(), nullptr, nullptr, nullptr };
+    int dstLinesize[4] = { static_cast<int>(image.bytesPerLine()), 0, 0, 0 };
+    
+    sws_scale(m_swsContext, m_frame->data, m_frame->linesize, 0, m_frame->height,
+              dstData, dstLinesize);
+    
+    return image;
+}
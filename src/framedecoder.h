@@ -0,0 +1,82 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QString>
+#include <QImage>
+#include <QVector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// Persistent decoder session for one video file. Unlike
+// FFmpegHandler::extractFrame, which reopens the file for every frame, a
+// session keeps the demuxer and decoder open so that increasing timestamps
+// can be reached by decoding forward instead of seeking each time.
+class FrameDecoder
+{
+public:
+    FrameDecoder();
+    ~FrameDecoder();
+    
+    FrameDecoder(const FrameDecoder &) = delete;
+    FrameDecoder &operator=(const FrameDecoder &) = delete;
+    
+    bool open(const QString &filePath);
+    void close();
+    bool isOpen() const { return m_codecContext != nullptr; }
+    
+    // Frames are scaled to this size (0x0 keeps the native resolution)
+    void setOutputSize(int width, int height);
+    // Decoder threads per session; parallel callers should use 1
+    void setThreadCount(int threadCount);
+    // Frames the decoder may drop entirely (AVDISCARD_NONREF, AVDISCARD_NONKEY, ...)
+    void setSkipFrames(AVDiscard skipFrames);
+    // Keyframe times of the file, e.g. from a PacketIndex. frameAt() then
+    // seeks whenever a keyframe lies between the current frame and the
+    // target instead of decoding every frame in between.
+    void setKeyframes(const QVector<qint64> &keyframesMs) { m_keyframesMs = keyframesMs; }
+    
+    // Returns the first frame at or after timestampMs (relative to the start
+    // of the file, frame times rounded up to the millisecond), or a null
+    // image if the file ends before it
+    QImage frameAt(qint64 timestampMs);
+    
+    // Sequential access: seek once, then step through the decoded frames
+    // and convert only the ones that are actually needed
+    bool seekTo(qint64 timestampMs);
+    bool decodeNextFrame();
+    QImage convertCurrentFrame();
+    bool currentFrameHasTimestamp() const { return m_frameHasTimestamp; }
+    bool currentFrameIsKeyframe() const;
+    
+    qint64 durationMs() const;
+    qint64 lastFrameTimestamp() const { return m_lastFrameMs; }
+
+private:
+    // Whether a known keyframe lies in (afterMs, upToMs]
+    bool keyframeBetween(qint64 afterMs, qint64 upToMs) const;
+    
+    AVFormatContext *m_formatContext;
+    AVCodecContext *m_codecContext;
+    SwsContext *m_swsContext;
+    AVPacket *m_packet;
+    AVFrame *m_frame;
+    
+    int m_videoStreamIndex;
+    AVRational m_timeBase;
+    qint64 m_startTimeMs;
+    qint64 m_lastFrameMs;
+    bool m_endOfStream;
+    bool m_frameHasTimestamp;
+    
+    int m_outputWidth;
+    int m_outputHeight;
+    int m_threadCount;
+    AVDiscard m_skipFrames;
+    QVector<qint64> m_keyframesMs; // Sorted
+};
+
+#endif // FRAMEDECODER_H
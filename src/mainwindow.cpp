@@ -11,20 +11,31 @@
 #include <QPainter>
 #include <QPixmap>
 #include <QDebug>
+#include <QSet>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_tabWidget(new QTabWidget(this))
-    , m_comparator(new VideoComparator(this))
+    , m_comparator(new VideoComparator())
+    , m_comparatorThread(new QThread(this))
     , m_isPlaying(false)
     , m_currentChapterIndex(-1)
     , m_transferThread(nullptr)
     , m_transferWorker(nullptr)
+    , m_duplicateThread(nullptr)
+    , m_duplicateFinder(nullptr)
+    , m_duplicateProgressDialog(nullptr)
 {
     // Connect to theme manager
     connect(ThemeManager::instance(), &ThemeManager::themeChanged,
             this, &MainWindow::onThemeChanged);
     
+    // Comparison jobs run on their own thread so the UI stays responsive
+    m_comparator->moveToThread(m_comparatorThread);
+    connect(m_comparatorThread, &QThread::finished,
+            m_comparator, &QObject::deleteLater);
+    m_comparatorThread->start();
+    
     setupMenuBar();
     setupUI();
     applyTheme();
@@ -36,6 +47,11 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    // Stop any running comparison job and shut down its thread
+    m_comparator->cancel();
+    m_comparatorThread->quit();
+    m_comparatorThread->wait();
+    
     // Clean up transfer thread
     if (m_transferThread) {
         m_transferThread->quit();
@@ -43,6 +59,14 @@ MainWindow::~MainWindow()
         delete m_transferWorker;
         delete m_transferThread;
     }
+    
+    // Stop a running duplicate search
+    if (m_duplicateThread) {
+        m_duplicateFinder->cancel();
+        m_duplicateThread->quit();
+        m_duplicateThread->wait();
+        delete m_duplicateFinder;
+    }
 }
 
 void MainWindow::setupUI()
@@ -126,12 +150,53 @@ void MainWindow::setupComparisonTab()
     m_autoCompareButton->setMinimumWidth(100);
     m_autoCompareButton->setStyleSheet(theme->successButtonStyleSheet());
     
+    // Divergence scan button
+    m_findDifferencesButton = new QPushButton("Find Differences", this);
+    m_findDifferencesButton->setMinimumWidth(100);
+    m_findDifferencesButton->setStyleSheet(theme->buttonStyleSheet());
+    m_findDifferencesButton->setToolTip("Scan the whole aligned timeline and list the ranges where the videos differ");
+    
+    // Full-reference quality metrics for auto compare and the divergent ranges
+    m_qualityCheckBox = new QCheckBox("Quality", this);
+    m_qualityCheckBox->setStyleSheet(theme->checkBoxStyleSheet());
+    m_qualityCheckBox->setToolTip("Also measure PSNR, SSIM and MS-SSIM on the frames that Auto Compare decodes\n"
+                                  "and in the middle of each range Find Differences reports");
+    
+    m_qualityResolutionCombo = new QComboBox(this);
+    m_qualityResolutionCombo->addItem("360p", QSize(640, 360));
+    m_qualityResolutionCombo->addItem("540p", QSize(960, 540));
+    m_qualityResolutionCombo->addItem("720p", QSize(1280, 720));
+    m_qualityResolutionCombo->addItem("1080p", QSize(1920, 1080));
+    m_qualityResolutionCombo->setStyleSheet(theme->lineEditStyleSheet());
+    m_qualityResolutionCombo->setEnabled(false);
+    m_qualityResolutionCombo->setToolTip("Resolution both videos are scaled to before measuring quality.\n"
+                                         "Higher resolutions find finer losses but decode slower");
+    
     // Auto offset button
     m_autoOffsetButton = new QPushButton("Auto Offset", this);
     m_autoOffsetButton->setMinimumWidth(100);
     m_autoOffsetButton->setStyleSheet(theme->buttonStyleSheet());
     m_autoOffsetButton->setToolTip("Automatically detect the optimal time offset between videos");
     
+    // What the offset detection looks at
+    m_offsetStrategyCombo = new QComboBox(this);
+    m_offsetStrategyCombo->addItem("Auto", VideoComparator::AutoOffset);
+    m_offsetStrategyCombo->addItem("Audio", VideoComparator::AudioOffset);
+    m_offsetStrategyCombo->addItem("Video", VideoComparator::VisualOffset);
+    m_offsetStrategyCombo->addItem("Video + drift", VideoComparator::DriftOffset);
+    m_offsetStrategyCombo->setStyleSheet(theme->lineEditStyleSheet());
+    m_offsetStrategyCombo->setToolTip("Auto: match the audio first, fall back to the picture\n"
+                                      "Audio: match the main audio tracks (works across different edits and grades)\n"
+                                      "Video: match the picture\n"
+                                      "Video + drift: follow frame-rate differences (PAL speed-up) and cuts");
+    
+    // Cancel button for running comparison jobs
+    m_cancelComparisonButton = new QPushButton("Cancel", this);
+    m_cancelComparisonButton->setMinimumWidth(80);
+    m_cancelComparisonButton->setStyleSheet(theme->dangerButtonStyleSheet());
+    m_cancelComparisonButton->setEnabled(false);
+    m_cancelComparisonButton->setToolTip("Stop the running comparison or offset detection");
+    
     // Relative offset control
     QLabel *offsetLabel = new QLabel("Offset A→B:");
     offsetLabel->setStyleSheet(QString("font-size: 13px; color: %1; font-weight: 500;").arg(theme->secondaryTextColor()));
@@ -173,7 +238,12 @@ void MainWindow::setupComparisonTab()
     
     controlLayout->addWidget(m_syncButton);
     controlLayout->addWidget(m_autoCompareButton);
+    controlLayout->addWidget(m_findDifferencesButton);
+    controlLayout->addWidget(m_qualityCheckBox);
+    controlLayout->addWidget(m_qualityResolutionCombo);
+    controlLayout->addWidget(m_offsetStrategyCombo);
     controlLayout->addWidget(m_autoOffsetButton);
+    controlLayout->addWidget(m_cancelComparisonButton);
     controlLayout->addWidget(offsetLabel);
     controlLayout->addWidget(m_relativeOffsetSpinBox);
     controlLayout->addWidget(timelineLabel);
@@ -304,7 +374,12 @@ void MainWindow::setupComparisonTab()
             [this](const QString &path) { onVideoLoaded(1, path); });
     connect(m_syncButton, &QPushButton::clicked, this, &MainWindow::onSyncPlayback);
     connect(m_autoCompareButton, &QPushButton::clicked, this, &MainWindow::onAutoCompare);
+    connect(m_findDifferencesButton, &QPushButton::clicked, this, &MainWindow::onFindDifferences);
     connect(m_autoOffsetButton, &QPushButton::clicked, this, &MainWindow::onAutoOffset);
+    connect(m_cancelComparisonButton, &QPushButton::clicked, this, &MainWindow::onCancelComparison);
+    connect(m_qualityCheckBox, &QCheckBox::toggled, this, &MainWindow::onQualityOptionsChanged);
+    connect(m_qualityResolutionCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::onQualityOptionsChanged);
     connect(m_timestampSlider, &QSlider::sliderMoved, this, &MainWindow::onSeekToTimestamp);
     connect(m_timestampSlider, &QSlider::sliderPressed, this, &MainWindow::onSeekToTimestamp);
     
@@ -315,7 +390,10 @@ void MainWindow::setupComparisonTab()
     // Connect video comparator signals for auto comparison
     connect(m_comparator, &VideoComparator::comparisonProgress, this, &MainWindow::onComparisonProgress);
     connect(m_comparator, &VideoComparator::autoComparisonComplete, this, &MainWindow::onAutoComparisonComplete);
+    connect(m_comparator, &VideoComparator::divergenceScanComplete, this, &MainWindow::onDivergenceScanComplete);
     connect(m_comparator, &VideoComparator::optimalOffsetFound, this, &MainWindow::onOptimalOffsetFound);
+    connect(m_comparator, &VideoComparator::timeAlignmentFound, this, &MainWindow::onTimeAlignmentFound);
+    connect(m_comparator, &VideoComparator::operationCancelled, this, &MainWindow::onComparisonCancelled);
     
     // Connect chapter navigation signals
     connect(m_leftChaptersList, &QListWidget::itemClicked, this, &MainWindow::onChapterSelected);
@@ -330,12 +408,19 @@ void MainWindow::setupComparisonTab()
                 m_comparator->setVideoOffset(0, value);   // Video A offset
                 m_comparator->setVideoOffset(1, 0);       // Video B baseline (no offset)
                 
+                // An edited offset replaces a fitted time map
+                if (m_timeMap.isValid()) {
+                    m_timeMap = TimeMap();
+                    m_comparator->setTimeMap(m_timeMap);
+                    m_rightVideoWidget->setPlaybackRate(1.0);
+                }
+                
                 // If playback is currently synced, re-sync immediately with new offset
                 if (m_isPlaying) {
                     // Get current base position from slider
                     qint64 basePosition = m_timestampSlider->value();
                     qint64 videoAPosition = basePosition;
-                    qint64 videoBPosition = basePosition - value;  // B needs to be ahead if A is delayed
+                    qint64 videoBPosition = positionInB(basePosition);
                     
                     // Ensure positions are within bounds
                     videoAPosition = qMax(0LL, videoAPosition);
@@ -517,12 +602,42 @@ void MainWindow::setupTransferTab()
     m_postfixEdit->setMinimumWidth(100);
     m_postfixEdit->setStyleSheet(theme->lineEditStyleSheet());
     
+    QLabel *sourceOffsetLabel = new QLabel("Source Offset:");
+    sourceOffsetLabel->setStyleSheet(QString("font-size: 13px; color: %1; font-weight: 500;").arg(theme->secondaryTextColor()));
+    
+    m_sourceOffsetSpinBox = new QSpinBox(this);
+    m_sourceOffsetSpinBox->setRange(-999999, 999999);
+    m_sourceOffsetSpinBox->setValue(0);
+    m_sourceOffsetSpinBox->setSuffix(" ms");
+    m_sourceOffsetSpinBox->setMinimumWidth(80);
+    m_sourceOffsetSpinBox->setStyleSheet(theme->lineEditStyleSheet());
+    m_sourceOffsetSpinBox->setToolTip("Positive: source tracks are delayed\nNegative: source tracks start earlier (their beginning is cut)");
+    
+    m_useComparisonOffsetButton = new QPushButton("From Comparison", this);
+    m_useComparisonOffsetButton->setStyleSheet(theme->buttonStyleSheet());
+    m_useComparisonOffsetButton->setToolTip("Use the offset from the Video Comparison tab, with the source loaded as Video A");
+    
+    // More targets for the same source tracks, written in the same pass
+    m_extraTargetsButton = new QPushButton("Extra Targets", this);
+    m_extraTargetsButton->setStyleSheet(theme->buttonStyleSheet());
+    m_extraTargetsButton->setToolTip("Other versions of the target (e.g. 4K, HDR) that get the same source tracks.\n"
+                                     "The source is read once for all targets; each keeps its own tracks.");
+    QMenu *extraTargetsMenu = new QMenu(m_extraTargetsButton);
+    extraTargetsMenu->addAction("Add Targets...", this, &MainWindow::onAddExtraTargets);
+    extraTargetsMenu->addAction("Clear", this, &MainWindow::onClearExtraTargets);
+    m_extraTargetsButton->setMenu(extraTargetsMenu);
+    
     m_transferButton = new QPushButton("Transfer Selected Tracks", this);
     m_transferButton->setStyleSheet(theme->primaryButtonStyleSheet());
     
     transferLayout->addWidget(postfixLabel);
     transferLayout->addWidget(m_postfixEdit);
+    transferLayout->addSpacing(12);
+    transferLayout->addWidget(sourceOffsetLabel);
+    transferLayout->addWidget(m_sourceOffsetSpinBox);
+    transferLayout->addWidget(m_useComparisonOffsetButton);
     transferLayout->addStretch();
+    transferLayout->addWidget(m_extraTargetsButton);
     transferLayout->addWidget(m_transferButton);
     
     // Assemble main layout
@@ -533,6 +648,10 @@ void MainWindow::setupTransferTab()
     // Connect signals
     connect(m_transferButton, &QPushButton::clicked, this, &MainWindow::onTransferTracks);
     connect(m_postfixEdit, &QLineEdit::textChanged, this, &MainWindow::onPostfixChanged);
+    connect(m_useComparisonOffsetButton, &QPushButton::clicked, this, [this]() {
+        // Video A at t shows what Video B shows at t - offset
+        m_sourceOffsetSpinBox->setValue(-m_relativeOffsetSpinBox->value());
+    });
     
     // Template controls
     connect(m_applyAudioTemplateButton, &QPushButton::clicked, this, &MainWindow::onApplyAudioTemplate);
@@ -567,6 +686,13 @@ void MainWindow::onVideoLoaded(int playerIndex, const QString &filePath)
 {
     m_comparator->setVideo(playerIndex, filePath);
     
+    // A time map only holds for the pair it was fitted on
+    if (m_timeMap.isValid()) {
+        m_timeMap = TimeMap();
+        m_comparator->setTimeMap(m_timeMap);
+        m_rightVideoWidget->setPlaybackRate(1.0);
+    }
+    
     // Update slider range when either video is loaded
     qint64 leftDuration = m_leftVideoWidget->duration();
     qint64 rightDuration = m_rightVideoWidget->duration();
@@ -598,6 +724,7 @@ void MainWindow::onSyncPlayback()
         // Currently playing, so pause both
         m_leftVideoWidget->pause();
         m_rightVideoWidget->pause();
+        m_rightVideoWidget->setPlaybackRate(1.0);
         m_syncButton->setText("Sync Playback");
         m_isPlaying = false;
     } else {
@@ -607,7 +734,7 @@ void MainWindow::onSyncPlayback()
         // Apply offset: positive offset means Video A starts later than Video B
         qint64 relativeOffset = m_relativeOffsetSpinBox->value();
         qint64 videoAPosition = basePosition;
-        qint64 videoBPosition = basePosition - relativeOffset;  // B needs to be ahead if A is delayed
+        qint64 videoBPosition = positionInB(basePosition);
         
         // Ensure positions are within bounds
         videoAPosition = qMax(0LL, videoAPosition);
@@ -617,6 +744,9 @@ void MainWindow::onSyncPlayback()
         m_leftVideoWidget->seek(videoAPosition);
         m_rightVideoWidget->seek(videoBPosition);
         
+        // With a speed difference B plays faster or slower to stay in step
+        m_rightVideoWidget->setPlaybackRate(m_timeMap.isValid() ? m_timeMap.rateAt(videoAPosition) : 1.0);
+        
         m_leftVideoWidget->play();
         m_rightVideoWidget->play();
         m_syncButton->setText("Sync Pause");
@@ -633,9 +763,8 @@ void MainWindow::onSeekToTimestamp()
     qint64 basePosition = m_timestampSlider->value();
     
     // Apply offset: positive offset means Video A starts later than Video B
-    qint64 relativeOffset = m_relativeOffsetSpinBox->value();
     qint64 videoAPosition = basePosition;
-    qint64 videoBPosition = basePosition - relativeOffset;  // B needs to be ahead if A is delayed
+    qint64 videoBPosition = positionInB(basePosition);
     
     // Ensure positions are within bounds
     videoAPosition = qMax(0LL, videoAPosition);
@@ -674,6 +803,16 @@ void MainWindow::onVideoPositionChanged(qint64 position)
         // Update current chapter display
         updateCurrentChapterDisplay(basePosition);
     }
+    
+    // A drifting time map cannot be followed by seeking once, so video B is
+    // nudged back whenever it falls out of step with video A
+    if (m_isPlaying && m_timeMap.hasDrift() && sender() == m_leftVideoWidget) {
+        qint64 expectedB = m_timeMap.mapToB(position);
+        if (qAbs(m_rightVideoWidget->position() - expectedB) > 200) {
+            m_rightVideoWidget->seek(qMax(0LL, expectedB));
+        }
+        m_rightVideoWidget->setPlaybackRate(m_timeMap.rateAt(position));
+    }
 }
 
 void MainWindow::onTransferTracks()
@@ -720,9 +859,29 @@ void MainWindow::onTransferTracks()
     // Generate output filename
     QFileInfo targetInfo(targetFile);
     QString outputFile = targetInfo.absolutePath() + "/" + 
-                        targetInfo.baseName() + m_postfixEdit->text() + 
+                        targetInfo.completeBaseName() + m_postfixEdit->text() + 
                         "." + targetInfo.suffix();
     
+    // Extra targets are written next to themselves, with the same postfix.
+    // Every target of the group needs an output of its own.
+    QList<QPair<QString, QString>> extraTargets;
+    QSet<QString> outputFiles{outputFile};
+    for (const QString &extraTarget : m_extraTargetFiles) {
+        QFileInfo extraInfo(extraTarget);
+        if (extraInfo.absoluteFilePath() == targetInfo.absoluteFilePath()) {
+            continue;
+        }
+        QString extraOutput = extraInfo.absolutePath() + "/" +
+                              extraInfo.completeBaseName() + m_postfixEdit->text() + "." + extraInfo.suffix();
+        if (outputFiles.contains(extraOutput)) {
+            QMessageBox::warning(this, "Warning", QString("%1 would overwrite the output of another target.")
+                                 .arg(extraInfo.fileName()));
+            return;
+        }
+        outputFiles.insert(extraOutput);
+        extraTargets.append(qMakePair(extraTarget, extraOutput));
+    }
+    
     // Clean up previous worker if exists
     if (m_transferThread) {
         m_transferThread->quit();
@@ -738,7 +897,10 @@ void MainWindow::onTransferTracks()
     
     // Set up the transfer job
     m_transferWorker->setTransferJob(sourceFile, targetFile, outputFile,
-                                    selectedAudioTracks, selectedSubtitleTracks);
+                                    selectedAudioTracks, selectedSubtitleTracks,
+                                    m_sourceOffsetSpinBox->value());
+    
+    m_transferWorker->setExtraTargets(extraTargets);
     
     // Connect worker signals
     connect(m_transferWorker, &TransferWorker::transferCompleted,
@@ -760,6 +922,26 @@ void MainWindow::onTransferTracks()
     m_transferThread->start();
 }
 
+void MainWindow::onAddExtraTargets()
+{
+    QStringList files = QFileDialog::getOpenFileNames(this, "Select Extra Target Videos", QString(),
+                                                      "Video Files (*.mp4 *.avi *.mkv *.mov *.wmv *.flv *.webm *.m4v)");
+    for (const QString &file : files) {
+        if (!m_extraTargetFiles.contains(file)) {
+            m_extraTargetFiles.append(file);
+        }
+    }
+    
+    m_extraTargetsButton->setText(m_extraTargetFiles.isEmpty() ? QString("Extra Targets")
+                                  : QString("Extra Targets (%1)").arg(m_extraTargetFiles.size()));
+}
+
+void MainWindow::onClearExtraTargets()
+{
+    m_extraTargetFiles.clear();
+    m_extraTargetsButton->setText("Extra Targets");
+}
+
 void MainWindow::onBatchProcess()
 {
     // Implementation will be added with batch processor
@@ -1046,6 +1228,100 @@ void MainWindow::setupMenuBar()
             m_darkThemeAction->setChecked(true);
             break;
     }
+    
+    // Create Tools menu
+    m_toolsMenu = menuBar()->addMenu("&Tools");
+    
+    m_findDuplicatesAction = new QAction("Find &Duplicate Videos...", this);
+    m_findDuplicatesAction->setToolTip("Index a folder tree and group videos with the same content");
+    connect(m_findDuplicatesAction, &QAction::triggered, this, &MainWindow::onFindDuplicates);
+    m_toolsMenu->addAction(m_findDuplicatesAction);
+}
+
+void MainWindow::onFindDuplicates()
+{
+    if (m_duplicateThread) {
+        return;
+    }
+    
+    QString directory = QFileDialog::getExistingDirectory(this, "Select Video Library");
+    if (directory.isEmpty()) {
+        return;
+    }
+    
+    m_duplicateThread = new QThread(this);
+    m_duplicateFinder = new DuplicateFinder();
+    m_duplicateFinder->setRootDirectory(directory);
+    m_duplicateFinder->moveToThread(m_duplicateThread);
+    
+    m_duplicateProgressDialog = new QProgressDialog("Indexing video library...", "Cancel", 0, 100, this);
+    m_duplicateProgressDialog->setWindowTitle("Find Duplicate Videos");
+    m_duplicateProgressDialog->setWindowModality(Qt::WindowModal);
+    m_duplicateProgressDialog->setMinimumDuration(0);
+    m_duplicateProgressDialog->setAutoClose(false);
+    m_duplicateProgressDialog->setAutoReset(false);
+    
+    // cancel() only sets a flag, so it is safe to call across threads
+    DuplicateFinder *finder = m_duplicateFinder;
+    connect(m_duplicateProgressDialog, &QProgressDialog::canceled, this, [finder]() { finder->cancel(); });
+    connect(m_duplicateFinder, &DuplicateFinder::progress, m_duplicateProgressDialog, &QProgressDialog::setValue);
+    connect(m_duplicateFinder, &DuplicateFinder::logMessage, m_duplicateProgressDialog, &QProgressDialog::setLabelText);
+    connect(m_duplicateFinder, &DuplicateFinder::finished, this, &MainWindow::onDuplicateSearchFinished);
+    connect(m_duplicateThread, &QThread::started, m_duplicateFinder, &DuplicateFinder::start);
+    
+    m_findDuplicatesAction->setEnabled(false);
+    m_duplicateThread->start();
+}
+
+void MainWindow::onDuplicateSearchFinished(const QList<DuplicateFinder::Group> &groups, int fileCount)
+{
+    bool cancelled = m_duplicateProgressDialog->wasCanceled();
+    
+    // The worker is idle once it has reported, so the thread can go
+    m_duplicateThread->quit();
+    m_duplicateThread->wait();
+    delete m_duplicateFinder;
+    delete m_duplicateThread;
+    m_duplicateFinder = nullptr;
+    m_duplicateThread = nullptr;
+    
+    m_duplicateProgressDialog->deleteLater();
+    m_duplicateProgressDialog = nullptr;
+    m_findDuplicatesAction->setEnabled(true);
+    
+    if (cancelled) {
+        return;
+    }
+    
+    if (groups.isEmpty()) {
+        QMessageBox::information(this, "Find Duplicate Videos",
+                                 QString("No duplicates found among %1 video files.").arg(fileCount));
+        return;
+    }
+    
+    // One block per group; offsets say where the first file's content appears in each file
+    QStringList details;
+    int duplicateFiles = 0;
+    for (int i = 0; i < groups.size(); ++i) {
+        const DuplicateFinder::Group &group = groups[i];
+        details << QString("Group %1 (%2 files, match %3%):").arg(i + 1).arg(group.paths.size())
+                                                              .arg(group.score * 100.0, 0, 'f', 0);
+        for (int member = 0; member < group.paths.size(); ++member) {
+            details << QString("    %1  (%2%3 s)").arg(group.paths[member])
+                                                  .arg(group.offsetsMs[member] >= 0 ? "+" : "")
+                                                  .arg(group.offsetsMs[member] / 1000.0, 0, 'f', 3);
+        }
+        details << QString();
+        duplicateFiles += group.paths.size();
+    }
+    
+    QMessageBox messageBox(this);
+    messageBox.setWindowTitle("Find Duplicate Videos");
+    messageBox.setIcon(QMessageBox::Information);
+    messageBox.setText(QString("Found %1 groups of duplicate videos (%2 files) among %3 video files.")
+                           .arg(groups.size()).arg(duplicateFiles).arg(fileCount));
+    messageBox.setDetailedText(details.join("\n"));
+    messageBox.exec();
 }
 
 void MainWindow::applyTheme()
@@ -1096,6 +1372,11 @@ void MainWindow::refreshTabStyling()
         // Update sync button, auto compare button and timestamp label
         if (m_syncButton) m_syncButton->setStyleSheet(theme->primaryButtonStyleSheet());
         if (m_autoCompareButton) m_autoCompareButton->setStyleSheet(theme->successButtonStyleSheet());
+        if (m_findDifferencesButton) m_findDifferencesButton->setStyleSheet(theme->buttonStyleSheet());
+        if (m_cancelComparisonButton) m_cancelComparisonButton->setStyleSheet(theme->dangerButtonStyleSheet());
+        if (m_offsetStrategyCombo) m_offsetStrategyCombo->setStyleSheet(theme->lineEditStyleSheet());
+        if (m_qualityCheckBox) m_qualityCheckBox->setStyleSheet(theme->checkBoxStyleSheet());
+        if (m_qualityResolutionCombo) m_qualityResolutionCombo->setStyleSheet(theme->lineEditStyleSheet());
         if (m_comparisonProgressBar) m_comparisonProgressBar->setStyleSheet(theme->progressBarStyleSheet());
         if (m_prevChapterButton) m_prevChapterButton->setStyleSheet(theme->buttonStyleSheet());
         if (m_nextChapterButton) m_nextChapterButton->setStyleSheet(theme->buttonStyleSheet());
@@ -1160,11 +1441,14 @@ void MainWindow::refreshTabStyling()
         if (m_selectAllSubtitleButton) m_selectAllSubtitleButton->setStyleSheet(theme->buttonStyleSheet());
         if (m_clearSubtitleButton) m_clearSubtitleButton->setStyleSheet(theme->buttonStyleSheet());
         if (m_transferButton) m_transferButton->setStyleSheet(theme->primaryButtonStyleSheet());
+        if (m_useComparisonOffsetButton) m_useComparisonOffsetButton->setStyleSheet(theme->buttonStyleSheet());
+        if (m_extraTargetsButton) m_extraTargetsButton->setStyleSheet(theme->buttonStyleSheet());
         
         // Update line edits
         if (m_audioTemplateEdit) m_audioTemplateEdit->setStyleSheet(theme->lineEditStyleSheet());
         if (m_subtitleTemplateEdit) m_subtitleTemplateEdit->setStyleSheet(theme->lineEditStyleSheet());
         if (m_postfixEdit) m_postfixEdit->setStyleSheet(theme->lineEditStyleSheet());
+        if (m_sourceOffsetSpinBox) m_sourceOffsetSpinBox->setStyleSheet(theme->lineEditStyleSheet());
         
         // Update list widgets
         if (m_audioTracksList) m_audioTracksList->setStyleSheet(theme->listWidgetStyleSheet());
@@ -1242,8 +1526,8 @@ void MainWindow::onAutoCompare()
         return;
     }
     
-    // Disable button and show progress
-    m_autoCompareButton->setEnabled(false);
+    // Disable the job buttons and show progress
+    setComparisonJobsEnabled(false);
     m_autoCompareButton->setText("Comparing...");
     m_comparisonProgressBar->setVisible(true);
     m_comparisonProgressBar->setValue(0);
@@ -1259,7 +1543,9 @@ void MainWindow::onAutoCompare()
     ).arg(ThemeManager::instance()->secondaryTextColor()));
     
     // Start the automatic comparison
-    m_comparator->startAutoComparison();
+    if (!m_comparator->startAutoComparison()) {
+        onComparisonJobRejected();
+    }
 }
 
 void MainWindow::onComparisonProgress(int percentage)
@@ -1275,10 +1561,8 @@ void MainWindow::onComparisonComplete(const QList<ComparisonResult> &results)
 
 void MainWindow::onAutoComparisonComplete(double overallSimilarity, bool videosIdentical, const QString &summary)
 {
-    // Re-enable button and hide progress
-    m_autoCompareButton->setEnabled(true);
-    m_autoCompareButton->setText("Auto Compare");
-    m_comparisonProgressBar->setVisible(false);
+    // Re-enable the job buttons and hide progress
+    setComparisonJobsEnabled(true);
     
     // Set result color based on outcome
     QString resultColor;
@@ -1303,6 +1587,154 @@ void MainWindow::onAutoComparisonComplete(double overallSimilarity, bool videosI
     ).arg(resultColor));
 }
 
+void MainWindow::onFindDifferences()
+{
+    if (m_leftVideoWidget->currentFilePath().isEmpty() || m_rightVideoWidget->currentFilePath().isEmpty()) {
+        m_comparisonResultLabel->setText("Please load both videos before scanning for differences.");
+        m_comparisonResultLabel->setStyleSheet(QString(
+            "QLabel { "
+            "   font-size: 12px; "
+            "   color: %1; "
+            "   padding: 4px; "
+            "   background-color: transparent; "
+            "   border: none; "
+            "}"
+        ).arg(ThemeManager::instance()->dangerColor()));
+        return;
+    }
+    
+    setComparisonJobsEnabled(false);
+    m_findDifferencesButton->setText("Scanning...");
+    m_comparisonProgressBar->setVisible(true);
+    m_comparisonProgressBar->setValue(0);
+    m_comparisonResultLabel->setText("Scanning the aligned timeline for differences...");
+    m_comparisonResultLabel->setStyleSheet(QString(
+        "QLabel { "
+        "   font-size: 12px; "
+        "   color: %1; "
+        "   padding: 4px; "
+        "   background-color: transparent; "
+        "   border: none; "
+        "}"
+    ).arg(ThemeManager::instance()->secondaryTextColor()));
+    
+    if (!m_comparator->startDivergenceScan()) {
+        onComparisonJobRejected();
+    }
+}
+
+void MainWindow::onDivergenceScanComplete(const QList<VideoComparator::DivergentRange> &ranges, const QString &summary)
+{
+    // Only the first few ranges fit in the result label
+    const int maxListedRanges = 8;
+    
+    setComparisonJobsEnabled(true);
+    
+    QStringList lines;
+    lines << summary;
+    for (int i = 0; i < qMin(ranges.size(), maxListedRanges); ++i) {
+        const VideoComparator::DivergentRange &range = ranges[i];
+        QString line = QString("%1 – %2   mean %3%, min %4%")
+                           .arg(QTime::fromMSecsSinceStartOfDay(range.startMs).toString("hh:mm:ss.zzz"))
+                           .arg(QTime::fromMSecsSinceStartOfDay(range.endMs).toString("hh:mm:ss.zzz"))
+                           .arg(range.meanSimilarity * 100.0, 0, 'f', 1)
+                           .arg(range.minSimilarity * 100.0, 0, 'f', 1);
+        if (range.unmatchedSamples > 0) {
+            line += QString(", %1 of %2 samples missing in B").arg(range.unmatchedSamples).arg(range.sampleCount);
+        }
+        if (range.boundedByCuts) {
+            line += ", between scene cuts";
+        }
+        if (range.hasQuality) {
+            line += QString(", PSNR %1 dB, SSIM %2").arg(range.quality.psnr, 0, 'f', 2).arg(range.quality.ssim, 0, 'f', 4);
+        }
+        lines << line;
+    }
+    if (ranges.size() > maxListedRanges) {
+        lines << QString("... and %1 more").arg(ranges.size() - maxListedRanges);
+    }
+    
+    m_comparisonResultLabel->setText(lines.join("\n"));
+    m_comparisonResultLabel->setStyleSheet(QString(
+        "QLabel { "
+        "   font-size: 12px; "
+        "   color: %1; "
+        "   padding: 4px; "
+        "   background-color: transparent; "
+        "   border: none; "
+        "   font-weight: 500; "
+        "}"
+    ).arg(ranges.isEmpty() ? ThemeManager::instance()->successColor() : ThemeManager::instance()->dangerColor()));
+}
+
+void MainWindow::onQualityOptionsChanged()
+{
+    QualityMetrics::Options options;
+    options.enabled = m_qualityCheckBox->isChecked();
+    QSize size = m_qualityResolutionCombo->currentData().toSize();
+    options.width = size.width();
+    options.height = size.height();
+    
+    m_qualityResolutionCombo->setEnabled(options.enabled);
+    m_comparator->setQualityOptions(options);
+}
+
+void MainWindow::setComparisonJobsEnabled(bool enabled)
+{
+    // The comparator runs one job at a time, so all job buttons follow it
+    m_autoCompareButton->setEnabled(enabled);
+    m_findDifferencesButton->setEnabled(enabled);
+    m_autoOffsetButton->setEnabled(enabled);
+    m_cancelComparisonButton->setEnabled(!enabled);
+    
+    if (enabled) {
+        m_autoCompareButton->setText("Auto Compare");
+        m_findDifferencesButton->setText("Find Differences");
+        m_autoOffsetButton->setText("Auto Offset");
+        m_comparisonProgressBar->setVisible(false);
+    }
+}
+
+void MainWindow::onComparisonJobRejected()
+{
+    // A cancelled job may still be winding down on the comparator thread
+    setComparisonJobsEnabled(true);
+    
+    m_comparisonResultLabel->setText("Another analysis is still running. Try again when it has finished.");
+    m_comparisonResultLabel->setStyleSheet(QString(
+        "QLabel { "
+        "   font-size: 12px; "
+        "   color: %1; "
+        "   padding: 4px; "
+        "   background-color: transparent; "
+        "   border: none; "
+        "}"
+    ).arg(ThemeManager::instance()->dangerColor()));
+}
+
+void MainWindow::onCancelComparison()
+{
+    m_cancelComparisonButton->setEnabled(false);
+    m_comparisonResultLabel->setText("Cancelling...");
+    m_comparator->cancel();
+}
+
+void MainWindow::onComparisonCancelled()
+{
+    setComparisonJobsEnabled(true);
+    
+    m_comparisonResultLabel->setText("Analysis cancelled.");
+    m_comparisonResultLabel->setStyleSheet(QString(
+        "QLabel { "
+        "   font-size: 12px; "
+        "   color: %1; "
+        "   padding: 4px; "
+        "   background-color: transparent; "
+        "   border: none; "
+        "}"
+    ).arg(ThemeManager::instance()->secondaryTextColor()));
+}
+
 void MainWindow::onAutoOffset()
 {
     QString leftPath = m_leftVideoWidget->currentFilePath();
@@ -1322,12 +1754,20 @@ void MainWindow::onAutoOffset()
         return;
     }
     
-    // Disable button and show progress
-    m_autoOffsetButton->setEnabled(false);
+    auto strategy = static_cast<VideoComparator::OffsetStrategy>(m_offsetStrategyCombo->currentData().toInt());
+    
+    // Disable the job buttons and show progress
+    setComparisonJobsEnabled(false);
     m_autoOffsetButton->setText("Detecting...");
     m_comparisonProgressBar->setVisible(true);
     m_comparisonProgressBar->setValue(0);
-    m_comparisonResultLabel->setText("Fast detection: ±5s in 25ms steps (first quarter only)...");
+    if (strategy == VideoComparator::DriftOffset) {
+        m_comparisonResultLabel->setText("Fitting frame-rate drift and cuts between video fingerprints...");
+    } else if (strategy == VideoComparator::VisualOffset) {
+        m_comparisonResultLabel->setText("Correlating video fingerprints (up to ±5 minutes)...");
+    } else {
+        m_comparisonResultLabel->setText("Correlating audio (up to ±5 minutes)...");
+    }
     m_comparisonResultLabel->setStyleSheet(QString(
         "QLabel { "
         "   font-size: 12px; "
@@ -1339,15 +1779,15 @@ void MainWindow::onAutoOffset()
     ).arg(ThemeManager::instance()->secondaryTextColor()));
     
     // Start the automatic offset detection
-    m_comparator->findOptimalOffset();
+    if (!m_comparator->findOptimalOffset(strategy)) {
+        onComparisonJobRejected();
+    }
 }
 
 void MainWindow::onOptimalOffsetFound(qint64 optimalOffset, double confidence)
 {
-    // Re-enable button and hide progress
-    m_autoOffsetButton->setEnabled(true);
-    m_autoOffsetButton->setText("Auto Offset");
-    m_comparisonProgressBar->setVisible(false);
+    // Re-enable the job buttons and hide progress
+    setComparisonJobsEnabled(true);
     
     // Update the offset spinbox with the detected value
     m_relativeOffsetSpinBox->setValue(static_cast<int>(optimalOffset));
@@ -1395,6 +1835,70 @@ void MainWindow::onOptimalOffsetFound(qint64 optimalOffset, double confidence)
     ).arg(resultColor.name()));
 }
 
+void MainWindow::onTimeAlignmentFound(const TimeMap &map, double confidence)
+{
+    // Re-enable the job buttons and hide progress
+    setComparisonJobsEnabled(true);
+    
+    if (!map.isValid()) {
+        m_comparisonResultLabel->setText("No time alignment found between the videos.");
+        m_comparisonResultLabel->setStyleSheet(QString("QLabel { font-size: 12px; color: %1; padding: 4px; }")
+                                                   .arg(ThemeManager::instance()->dangerColor()));
+        return;
+    }
+    
+    // The spinbox shows the offset at the start of video A; setting it must
+    // not clear the map that is being applied
+    qint64 startOffset = -map.mapToB(0);
+    m_relativeOffsetSpinBox->blockSignals(true);
+    m_relativeOffsetSpinBox->setValue(static_cast<int>(startOffset));
+    m_relativeOffsetSpinBox->blockSignals(false);
+    m_comparator->setVideoOffset(0, startOffset);
+    m_comparator->setVideoOffset(1, 0);
+    
+    m_timeMap = map;
+    m_comparator->setTimeMap(map);
+    
+    if (m_isPlaying) {
+        qint64 basePosition = m_leftVideoWidget->position();
+        m_rightVideoWidget->seek(qMax(0LL, positionInB(basePosition)));
+        m_rightVideoWidget->setPlaybackRate(m_timeMap.rateAt(basePosition));
+    }
+    
+    QString resultMessage = QString("Time map fitted: video B runs at %1× the speed of video A")
+                                .arg(map.scale(), 0, 'f', 4);
+    if (map.isPiecewise()) {
+        resultMessage += QString(", with %1 edit anchors").arg(map.anchors().size());
+    }
+    resultMessage += QString(".\nOffset at start: %1ms. Confidence: %2%")
+                         .arg(startOffset)
+                         .arg(static_cast<int>(confidence * 100));
+    
+    QColor resultColor = QColor(confidence > 0.7 ? ThemeManager::instance()->successColor()
+                                                 : ThemeManager::instance()->primaryColor());
+    m_comparisonResultLabel->setText(resultMessage);
+    m_comparisonResultLabel->setStyleSheet(QString(
+        "QLabel { "
+        "   font-size: 12px; "
+        "   color: %1; "
+        "   padding: 4px; "
+        "   background-color: transparent; "
+        "   border: none; "
+        "   font-weight: 500; "
+        "}"
+    ).arg(resultColor.name()));
+}
+
+qint64 MainWindow::positionInB(qint64 positionA) const
+{
+    if (m_timeMap.isValid()) {
+        return m_timeMap.mapToB(positionA);
+    }
+    
+    // Positive offset means Video A starts later than Video B
+    return positionA - m_relativeOffsetSpinBox->value();
+}
+
 void MainWindow::updateChapterLists()
 {
     FFmpegHandler handler;
@@ -1446,9 +1950,8 @@ void MainWindow::onChapterSelected()
     qint64 baseTimestamp = selectedItem->data(Qt::UserRole).toLongLong();
     
     // Apply offset: positive offset means Video A starts later than Video B
-    qint64 relativeOffset = m_relativeOffsetSpinBox->value();
     qint64 videoATimestamp = baseTimestamp;
-    qint64 videoBTimestamp = baseTimestamp - relativeOffset;
+    qint64 videoBTimestamp = positionInB(baseTimestamp);
     
     // Ensure timestamps are within bounds
     videoATimestamp = qMax(0LL, videoATimestamp);
@@ -1506,9 +2009,8 @@ void MainWindow::jumpToCurrentChapter()
     }
     
     // Apply offset: positive offset means Video A starts later than Video B
-    qint64 relativeOffset = m_relativeOffsetSpinBox->value();
     qint64 videoATimestamp = baseTimestamp;
-    qint64 videoBTimestamp = baseTimestamp - relativeOffset;
+    qint64 videoBTimestamp = positionInB(baseTimestamp);
     
     // Ensure timestamps are within bounds
     videoATimestamp = qMax(0LL, videoATimestamp);
@@ -11,6 +11,7 @@
 #include <QProgressBar>
 #include <QSlider>
 #include <QSpinBox>
+#include <QComboBox>
 #include <QTabWidget>
 #include <QListWidget>
 #include <QGroupBox>
@@ -20,9 +21,12 @@
 #include <QAction>
 #include <QActionGroup>
 #include <QThread>
+#include <QProgressDialog>
+#include "timealignment.h"
+#include "videocomparator.h"
+#include "duplicatefinder.h"
 
 class VideoWidget;
-class VideoComparator;
 class BatchProcessor;
 class TransferWorker;
 
@@ -52,6 +56,8 @@ private slots:
     void onTransferTracks();
     void onBatchProcess();
     void onPostfixChanged();
+    void onAddExtraTargets();
+    void onClearExtraTargets();
     
     // Track selection slots
     void onApplyAudioTemplate();
@@ -71,13 +77,23 @@ private slots:
     void onTransferCompleted(bool success, const QString &message);
     void onTransferLogMessage(const QString &message);
     
+    // Library duplicate search slots
+    void onFindDuplicates();
+    void onDuplicateSearchFinished(const QList<DuplicateFinder::Group> &groups, int fileCount);
+    
     // Auto comparison slots
     void onAutoCompare();
     void onAutoOffset();
     void onOptimalOffsetFound(qint64 optimalOffset, double confidence);
+    void onTimeAlignmentFound(const TimeMap &map, double confidence);
     void onComparisonProgress(int percentage);
     void onComparisonComplete(const QList<ComparisonResult> &results);
     void onAutoComparisonComplete(double overallSimilarity, bool videosIdentical, const QString &summary);
+    void onFindDifferences();
+    void onDivergenceScanComplete(const QList<VideoComparator::DivergentRange> &ranges, const QString &summary);
+    void onQualityOptionsChanged();
+    void onCancelComparison();
+    void onComparisonCancelled();
     
     // Chapter navigation slots
     void onChapterSelected();
@@ -98,6 +114,13 @@ private:
     void applyTheme();
     void refreshTabStyling();
     QIcon createColoredIcon(const QColor &color, int size = 16);
+    // Enables Auto Compare, Find Differences and Auto Offset, or disables
+    // them while a job runs; Cancel does the opposite
+    void setComparisonJobsEnabled(bool enabled);
+    // Restores the buttons after the comparator refused to start a job
+    void onComparisonJobRejected();
+    // Position in video B matching positionA, from the time map or the offset
+    qint64 positionInB(qint64 positionA) const;
 
     QTabWidget *m_tabWidget;
     
@@ -109,11 +132,18 @@ private:
     QSlider *m_timestampSlider;
     QLabel *m_timestampLabel;
     VideoComparator *m_comparator;
+    QThread *m_comparatorThread;
     bool m_isPlaying;
+    TimeMap m_timeMap; // Fitted by drift detection, cleared when the offset is edited
     
     // Auto comparison controls
     QPushButton *m_autoCompareButton;
+    QPushButton *m_findDifferencesButton;
+    QCheckBox *m_qualityCheckBox;
+    QComboBox *m_qualityResolutionCombo;
     QPushButton *m_autoOffsetButton;
+    QComboBox *m_offsetStrategyCombo;
+    QPushButton *m_cancelComparisonButton;
     QProgressBar *m_comparisonProgressBar;
     QLabel *m_comparisonResultLabel;
     
@@ -138,6 +168,10 @@ private:
     VideoWidget *m_targetVideoWidget;
     QPushButton *m_transferButton;
     QLineEdit *m_postfixEdit;
+    QSpinBox *m_sourceOffsetSpinBox;
+    QPushButton *m_useComparisonOffsetButton;
+    QPushButton *m_extraTargetsButton;
+    QStringList m_extraTargetFiles;
     QListWidget *m_audioTracksList;
     QListWidget *m_subtitleTracksList;
     
@@ -163,9 +197,18 @@ private:
     QAction *m_lightThemeAction;
     QAction *m_darkThemeAction;
     
+    // Tools menu
+    QMenu *m_toolsMenu;
+    QAction *m_findDuplicatesAction;
+    
     // Threading for transfer operations
     QThread *m_transferThread;
     TransferWorker *m_transferWorker;
+    
+    // Threading for the library duplicate search
+    QThread *m_duplicateThread;
+    DuplicateFinder *m_duplicateFinder;
+    QProgressDialog *m_duplicateProgressDialog;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
@@ -0,0 +1,622 @@
+#include "mediaio.h"
+#include "uringqueue.h"
+#include <QDebug>
+#include <QThread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/error.h>
+}
+
+static const int PROBE_BUFFER_SIZE = 1024 * 1024;
+
+// A refill from a mapping is only a memcpy, so the context buffer can stay small
+static const int MAPPED_BUFFER_SIZE = 256 * 1024;
+
+// Buffer sizes outside this range either gain nothing or waste memory per input
+static const int MIN_BUFFER_SIZE = 64 * 1024;
+static const int MAX_BUFFER_SIZE = 64 * 1024 * 1024;
+
+MediaIO::Stats &MediaIO::Stats::operator+=(const Stats &other)
+{
+    bytesRead += other.bytesRead;
+    readCalls += other.readCalls;
+    elapsedMs = qMax(elapsedMs, other.elapsedMs);
+    return *this;
+}
+
+MediaIO::Options MediaIO::probeOptions()
+{
+    Options options;
+    options.bufferSize = PROBE_BUFFER_SIZE;
+    options.readahead = false;
+    options.sequential = false;
+    options.memoryMap = true;
+    return options;
+}
+
+MediaIO::Options MediaIO::scanOptions()
+{
+    Options options;
+    options.readahead = false;
+    options.sequential = true;
+    options.memoryMap = true;
+    return options;
+}
+
+bool MediaIO::isLocalFileSystem(int fd)
+{
+#ifdef __linux__
+    struct statfs info;
+    if (fstatfs(fd, &info) != 0) {
+        return false;
+    }
+    
+    switch (static_cast<unsigned long>(info.f_type)) {
+    case 0x6969:      // NFS
+    case 0x517B:      // SMB
+    case 0xFF534D42:  // CIFS
+    case 0xFE534D42:  // SMB2
+    case 0x65735546:  // FUSE: sshfs, rclone, gvfs
+    case 0x00C36400:  // Ceph
+    case 0x5346414F:  // AFS
+    case 0x73757245:  // Coda
+    case 0x01021997:  // 9P, including WSL drive mounts
+    case 0x0BD00BD0:  // Lustre
+    case 0x47504653:  // GPFS
+        return false;
+    default:
+        return true;
+    }
+#else
+    // No portable way to tell; buffered reads are safe everywhere
+    Q_UNUSED(fd);
+    return false;
+#endif
+}
+
+MediaIO::MediaIO(const Options &options)
+    : m_options(options)
+    , m_fd(-1)
+    , m_fileSize(0)
+    , m_position(0)
+    , m_context(nullptr)
+    , m_map(nullptr)
+    , m_bytesRead(0)
+    , m_readCalls(0)
+    , m_readaheadThread(nullptr)
+    , m_readaheadOffset(0)
+    , m_generation(0)
+    , m_readaheadEof(false)
+    , m_readaheadError(false)
+    , m_stopping(false)
+    , m_ring(nullptr)
+    , m_head(0)
+{
+    m_options.bufferSize = qBound(MIN_BUFFER_SIZE, m_options.bufferSize, MAX_BUFFER_SIZE);
+    m_options.readaheadBlocks = qMax(1, m_options.readaheadBlocks);
+}
+
+MediaIO::~MediaIO()
+{
+    close();
+}
+
+bool MediaIO::open(const QString &filePath)
+{
+    close();
+    
+    m_fd = ::open(filePath.toUtf8().constData(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        qWarning() << "MediaIO: cannot open" << filePath << ":" << strerror(errno);
+        return false;
+    }
+    
+    struct stat info;
+    if (fstat(m_fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_fileSize = info.st_size;
+    
+    if (!(m_options.memoryMap && mapFile())) {
+#ifdef POSIX_FADV_SEQUENTIAL
+        // SEQUENTIAL doubles the kernel's readahead window; RANDOM switches it
+        // off for probes that jump between header and index
+        posix_fadvise(m_fd, 0, 0, m_options.sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+#endif
+    }
+    
+    const int bufferSize = m_map ? MAPPED_BUFFER_SIZE : m_options.bufferSize;
+    unsigned char *buffer = static_cast<unsigned char *>(av_malloc(bufferSize));
+    if (!buffer) {
+        close();
+        return false;
+    }
+    
+    m_context = avio_alloc_context(buffer, bufferSize, 0, this, &MediaIO::readPacket, nullptr,
+                                   &MediaIO::seekCallback);
+    if (!m_context) {
+        av_free(buffer);
+        close();
+        return false;
+    }
+    
+    m_position = 0;
+    m_bytesRead = 0;
+    m_readCalls = 0;
+    m_timer.start();
+    
+    // The page cache is the readahead for a mapping
+    if (m_map) {
+        return true;
+    }
+    
+    if (m_options.readahead && m_options.ioUring) {
+        m_ring = new UringQueue(m_options.readaheadBlocks);
+        if (m_ring->isValid()) {
+            for (int i = 0; i < m_options.readaheadBlocks; ++i) {
+                m_slots.append(Slot{0, QByteArray(m_options.bufferSize, Qt::Uninitialized), 0, SlotIdle});
+            }
+            m_head = 0;
+            m_readaheadOffset = 0;
+            fillRing();
+            return true;
+        }
+        delete m_ring;
+        m_ring = nullptr;
+    }
+    
+    if (m_options.readahead) {
+        m_blocks.clear();
+        m_readaheadOffset = 0;
+        m_readaheadEof = false;
+        m_readaheadError = false;
+        m_stopping = false;
+        m_readaheadThread = QThread::create([this]() { readaheadLoop(); });
+        m_readaheadThread->start();
+    }
+    
+    return true;
+}
+
+void MediaIO::close()
+{
+    stopReadahead();
+    
+    // Deleting the ring waits for reads still landing in m_slots
+    delete m_ring;
+    m_ring = nullptr;
+    m_slots.clear();
+    
+    if (m_context) {
+        av_freep(&m_context->buffer);
+        avio_context_free(&m_context);
+    }
+    if (m_map) {
+        munmap(const_cast<uint8_t *>(m_map), m_fileSize);
+        m_map = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+MediaIO::Stats MediaIO::stats() const
+{
+    Stats stats;
+    stats.bytesRead = m_bytesRead;
+    stats.readCalls = m_readCalls;
+    stats.elapsedMs = m_timer.isValid() ? m_timer.elapsed() : 0;
+    return stats;
+}
+
+int MediaIO::readPacket(void *opaque, uint8_t *buffer, int size)
+{
+    return static_cast<MediaIO *>(opaque)->read(buffer, size);
+}
+
+int64_t MediaIO::seekCallback(void *opaque, int64_t offset, int whence)
+{
+    return static_cast<MediaIO *>(opaque)->seek(offset, whence);
+}
+
+bool MediaIO::mapFile()
+{
+    // Empty files cannot be mapped. On network mounts every fault would be a
+    // small synchronous request, and a file truncated on the server raises
+    // SIGBUS instead of a read error.
+    if (m_fileSize <= 0 || !isLocalFileSystem(m_fd)) {
+        return false;
+    }
+    
+    // MAP_SHARED maps the page cache itself, so concurrent passes over the
+    // same file use the same pages instead of copies of them
+    void *map = mmap(nullptr, m_fileSize, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    m_map = static_cast<const uint8_t *>(map);
+    
+    // Same access patterns as the posix_fadvise() hints of the buffered path
+    madvise(map, m_fileSize, m_options.sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    return true;
+}
+
+int MediaIO::read(uint8_t *buffer, int size)
+{
+    if (m_map) {
+        return readMapped(buffer, size);
+    }
+    if (m_ring) {
+        return readRing(buffer, size);
+    }
+    if (m_readaheadThread) {
+        return readAhead(buffer, size);
+    }
+    return readDirect(buffer, size);
+}
+
+int MediaIO::readDirect(uint8_t *buffer, int size)
+{
+    ssize_t bytes;
+    do {
+        bytes = pread(m_fd, buffer, size, m_position);
+    } while (bytes < 0 && errno == EINTR);
+    
+    if (bytes < 0) {
+        return AVERROR(errno);
+    }
+    if (bytes == 0) {
+        return AVERROR_EOF;
+    }
+    
+    m_position += bytes;
+    m_bytesRead += bytes;
+    m_readCalls++;
+    
+    // Let the kernel fetch the next buffer while the demuxer parses this one
+    if (!m_ring) {
+        hintNext(m_position, m_options.bufferSize);
+    }
+    return static_cast<int>(bytes);
+}
+
+int MediaIO::readMapped(uint8_t *buffer, int size)
+{
+    if (m_position >= m_fileSize) {
+        return AVERROR_EOF;
+    }
+    
+    const int bytes = static_cast<int>(qMin<qint64>(size, m_fileSize - m_position));
+    memcpy(buffer, m_map + m_position, bytes);
+    m_position += bytes;
+    m_bytesRead += bytes;
+    m_readCalls++;
+    
+    // Random access gets no kernel readahead; fault in the next buffer
+    // together instead of page by page
+    if (!m_options.sequential && m_position < m_fileSize) {
+        const qint64 pageStart = m_position & ~static_cast<qint64>(sysconf(_SC_PAGESIZE) - 1);
+        const qint64 length = qMin<qint64>(MAPPED_BUFFER_SIZE, m_fileSize - pageStart);
+        madvise(const_cast<uint8_t *>(m_map) + pageStart, length, MADV_WILLNEED);
+    }
+    return bytes;
+}
+
+int MediaIO::readRing(uint8_t *buffer, int size)
+{
+    for (;;) {
+        // Nothing in flight at the read position: past the end of the file,
+        // or in a gap left by a short read
+        Slot &slot = m_slots[m_head];
+        if (slot.state == SlotIdle || m_position < slot.offset) {
+            return readDirect(buffer, size);
+        }
+        
+        if (!waitForSlot(m_head)) {
+            return AVERROR(EIO);
+        }
+        
+        // Blocks behind the read position, short or failed ones go back to
+        // the end of the ring; a failed read is retried by readDirect()
+        const qint64 start = m_position - slot.offset;
+        if (slot.result <= 0 || start >= slot.result) {
+            slot.state = SlotIdle;
+            m_head = (m_head + 1) % m_slots.size();
+            fillRing();
+            continue;
+        }
+        
+        const int bytes = static_cast<int>(qMin<qint64>(size, slot.result - start));
+        memcpy(buffer, slot.data.constData() + start, bytes);
+        m_position += bytes;
+        m_bytesRead += bytes;
+        m_readCalls++;
+        
+        if (start + bytes >= slot.result) {
+            slot.state = SlotIdle;
+            m_head = (m_head + 1) % m_slots.size();
+            fillRing();
+        }
+        return bytes;
+    }
+}
+
+void MediaIO::fillRing()
+{
+    for (int i = 0; i < m_slots.size(); ++i) {
+        const int index = (m_head + i) % m_slots.size();
+        Slot &slot = m_slots[index];
+        if (slot.state != SlotIdle) {
+            continue;
+        }
+        if (m_readaheadOffset >= m_fileSize ||
+            !m_ring->submitRead(m_fd, slot.data.data(), slot.data.size(), m_readaheadOffset, index)) {
+            return;
+        }
+        slot.offset = m_readaheadOffset;
+        slot.state = SlotPending;
+        m_readaheadOffset += slot.data.size();
+    }
+}
+
+bool MediaIO::waitForSlot(int slot)
+{
+    // Completions arrive in any order; record each until this one is in
+    while (m_slots[slot].state == SlotPending) {
+        quint64 tag;
+        int result;
+        if (!m_ring->waitCompletion(&tag, &result)) {
+            return false;
+        }
+        m_slots[tag].result = result;
+        m_slots[tag].state = SlotReady;
+    }
+    return true;
+}
+
+void MediaIO::resetRing()
+{
+    for (int i = 0; i < m_slots.size(); ++i) {
+        waitForSlot(i);
+        m_slots[i].state = SlotIdle;
+    }
+    m_head = 0;
+}
+
+int MediaIO::readAhead(uint8_t *buffer, int size)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    // Blocks behind the read position are left over from a short forward seek
+    while (!m_blocks.isEmpty() && m_blocks.first().offset + m_blocks.first().data.size() <= m_position) {
+        m_blocks.removeFirst();
+        m_spaceFree.wakeOne();
+    }
+    
+    while (m_blocks.isEmpty() && !m_readaheadEof && !m_readaheadError) {
+        m_blockReady.wait(&m_mutex);
+        while (!m_blocks.isEmpty() && m_blocks.first().offset + m_blocks.first().data.size() <= m_position) {
+            m_blocks.removeFirst();
+            m_spaceFree.wakeOne();
+        }
+    }
+    
+    if (m_blocks.isEmpty()) {
+        return m_readaheadError ? AVERROR(EIO) : AVERROR_EOF;
+    }
+    
+    Block &block = m_blocks.first();
+    const qint64 start = m_position - block.offset;
+    const int bytes = static_cast<int>(qMin<qint64>(size, block.data.size() - start));
+    memcpy(buffer, block.data.constData() + start, bytes);
+    
+    m_position += bytes;
+    m_bytesRead += bytes;
+    m_readCalls++;
+    
+    if (start + bytes >= block.data.size()) {
+        m_blocks.removeFirst();
+        m_spaceFree.wakeOne();
+    }
+    return bytes;
+}
+
+int64_t MediaIO::seek(int64_t offset, int whence)
+{
+    whence &= ~AVSEEK_FORCE;
+    
+    qint64 target;
+    switch (whence) {
+    case AVSEEK_SIZE:
+        return m_fileSize;
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = m_position + offset;
+        break;
+    case SEEK_END:
+        target = m_fileSize + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+    
+    if (m_ring) {
+        // Reads already in flight are kept if the target lies ahead of them
+        const Slot &head = m_slots[m_head];
+        const qint64 bufferedStart = head.state == SlotIdle ? m_readaheadOffset : head.offset;
+        if (target < bufferedStart || target >= m_readaheadOffset) {
+            resetRing();
+            m_readaheadOffset = target;
+        }
+        m_position = target;
+        fillRing();
+        return target;
+    }
+    
+    if (m_readaheadThread) {
+        QMutexLocker locker(&m_mutex);
+        
+        // Stay on the current stream of blocks if the target is already buffered
+        // or about to be; anything else restarts the readahead there
+        const qint64 bufferedStart = m_blocks.isEmpty() ? m_readaheadOffset : m_blocks.first().offset;
+        const bool buffered = target >= bufferedStart && target < m_readaheadOffset + m_options.bufferSize;
+        if (!buffered) {
+            m_blocks.clear();
+            m_readaheadOffset = target;
+            m_readaheadEof = false;
+            m_readaheadError = false;
+            m_generation++;
+            m_spaceFree.wakeOne();
+        }
+    }
+    
+    m_position = target;
+    return target;
+}
+
+void MediaIO::hintNext(qint64 offset, qint64 length) const
+{
+#ifdef POSIX_FADV_WILLNEED
+    if (offset < m_fileSize) {
+        posix_fadvise(m_fd, offset, length, POSIX_FADV_WILLNEED);
+    }
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+#endif
+}
+
+void MediaIO::readaheadLoop()
+{
+    QMutexLocker locker(&m_mutex);
+    
+    while (!m_stopping) {
+        if (m_blocks.size() >= m_options.readaheadBlocks || m_readaheadEof || m_readaheadError) {
+            m_spaceFree.wait(&m_mutex);
+            continue;
+        }
+        
+        const qint64 offset = m_readaheadOffset;
+        const quint64 generation = m_generation;
+        
+        locker.unlock();
+        QByteArray data(m_options.bufferSize, Qt::Uninitialized);
+        ssize_t bytes;
+        do {
+            bytes = pread(m_fd, data.data(), data.size(), offset);
+        } while (bytes < 0 && errno == EINTR);
+        if (bytes > 0) {
+            hintNext(offset + bytes, m_options.bufferSize);
+        }
+        locker.relock();
+        
+        // A seek moved the stream while this block was being read
+        if (generation != m_generation) {
+            continue;
+        }
+        
+        if (bytes < 0) {
+            m_readaheadError = true;
+        } else if (bytes == 0) {
+            m_readaheadEof = true;
+        } else {
+            data.truncate(static_cast<int>(bytes));
+            m_blocks.append(Block{offset, data});
+            m_readaheadOffset = offset + bytes;
+        }
+        m_blockReady.wakeAll();
+    }
+}
+
+void MediaIO::stopReadahead()
+{
+    if (!m_readaheadThread) {
+        return;
+    }
+    
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_spaceFree.wakeAll();
+    }
+    m_readaheadThread->wait();
+    delete m_readaheadThread;
+    m_readaheadThread = nullptr;
+    m_blocks.clear();
+}
+
+AVFormatContext *MediaIO::openInput(const QString &filePath, const Options &options, bool findStreamInfo)
+{
+    AVFormatContext *formatContext = nullptr;
+    
+    // URLs keep going through libavformat's protocols
+    if (filePath.contains("://")) {
+        if (avformat_open_input(&formatContext, filePath.toUtf8().constData(), nullptr, nullptr) != 0) {
+            return nullptr;
+        }
+    } else {
+        MediaIO *io = new MediaIO(options);
+        formatContext = avformat_alloc_context();
+        if (!formatContext || !io->open(filePath)) {
+            avformat_free_context(formatContext);
+            delete io;
+            return nullptr;
+        }
+        
+        formatContext->pb = io->context();
+        formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+        formatContext->opaque = io;
+        
+        // The URL still names the file for demuxers that look at the extension
+        if (avformat_open_input(&formatContext, filePath.toUtf8().constData(), nullptr, nullptr) != 0) {
+            // avformat_open_input() frees the context on failure
+            delete io;
+            return nullptr;
+        }
+    }
+    
+    if (findStreamInfo && avformat_find_stream_info(formatContext, nullptr) < 0) {
+        closeInput(formatContext);
+        return nullptr;
+    }
+    
+    return formatContext;
+}
+
+void MediaIO::closeInput(AVFormatContext *&formatContext)
+{
+    if (!formatContext) {
+        return;
+    }
+    
+    MediaIO *io = (formatContext->flags & AVFMT_FLAG_CUSTOM_IO) ? static_cast<MediaIO *>(formatContext->opaque) : nullptr;
+    avformat_close_input(&formatContext);
+    delete io;
+}
+
+MediaIO::Stats MediaIO::inputStats(const AVFormatContext *formatContext)
+{
+    if (!formatContext || !(formatContext->flags & AVFMT_FLAG_CUSTOM_IO) || !formatContext->opaque) {
+        return Stats();
+    }
+    return static_cast<const MediaIO *>(formatContext->opaque)->stats();
+}
@@ -0,0 +1,141 @@
+#ifndef MEDIAIO_H
+#define MEDIAIO_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+class QThread;
+class UringQueue;
+
+// File input for libavformat with large reads. libavformat's own file
+// protocol reads in 32 KB pieces, which turns into a storm of small requests
+// on NFS and SMB mounts; this AVIOContext reads a whole buffer (1-8 MB) per
+// call, tells the kernel about the access pattern, and can keep the next
+// blocks in flight on a background thread while the demuxer works. Local
+// read-only passes can map the file instead and read straight from the page
+// cache.
+class MediaIO
+{
+public:
+    struct Options {
+        int bufferSize = 4 * 1024 * 1024;
+        // Background thread reading ahead of the demuxer; for sequential passes
+        bool readahead = false;
+        int readaheadBlocks = 3;
+        // posix_fadvise SEQUENTIAL instead of RANDOM
+        bool sequential = true;
+        // Keep the readahead blocks in flight through io_uring instead of a
+        // thread, where available; needs readahead
+        bool ioUring = false;
+        // Map local files instead of reading them; network file systems and
+        // empty files fall back to buffered reads
+        bool memoryMap = false;
+    };
+    
+    struct Stats {
+        qint64 bytesRead = 0;
+        qint64 readCalls = 0;
+        qint64 elapsedMs = 0;  // Since open()
+        
+        double throughputMBps() const { return elapsedMs > 0 ? (bytesRead / 1048576.0) / (elapsedMs / 1000.0) : 0.0; }
+        Stats &operator+=(const Stats &other);
+    };
+    
+    // Probing touches a few header blocks; smaller reads and no readahead
+    static Options probeOptions();
+    // Packet scans and hashing: one mapped front-to-back pass
+    static Options scanOptions();
+    // False for NFS, SMB, FUSE and other file systems where mapping the file
+    // would turn page faults into small synchronous network requests
+    static bool isLocalFileSystem(int fd);
+    
+    explicit MediaIO(const Options &options);
+    ~MediaIO();
+    
+    bool open(const QString &filePath);
+    void close();
+    AVIOContext *context() const { return m_context; }
+    bool isMapped() const { return m_map != nullptr; }
+    // Call from the demuxing thread
+    Stats stats() const;
+    
+    // Opens filePath through a MediaIO owned by the returned context, falling
+    // back to libavformat's own I/O for URLs. Close with closeInput().
+    static AVFormatContext *openInput(const QString &filePath, const Options &options, bool findStreamInfo = true);
+    static void closeInput(AVFormatContext *&formatContext);
+    // Read statistics of a context from openInput(); empty for URLs
+    static Stats inputStats(const AVFormatContext *formatContext);
+
+private:
+    struct Block {
+        qint64 offset;
+        QByteArray data;
+    };
+    
+    enum SlotState { SlotIdle, SlotPending, SlotReady };
+    struct Slot {
+        qint64 offset;
+        QByteArray data;
+        int result;
+        SlotState state;
+    };
+    
+    static int readPacket(void *opaque, uint8_t *buffer, int size);
+    static int64_t seekCallback(void *opaque, int64_t offset, int whence);
+    
+    int read(uint8_t *buffer, int size);
+    int readAhead(uint8_t *buffer, int size);
+    int64_t seek(int64_t offset, int whence);
+    void hintNext(qint64 offset, qint64 length) const;
+    void readaheadLoop();
+    void stopReadahead();
+    int readDirect(uint8_t *buffer, int size);
+    int readMapped(uint8_t *buffer, int size);
+    bool mapFile();
+    int readRing(uint8_t *buffer, int size);
+    void fillRing();
+    bool waitForSlot(int slot);
+    void resetRing();
+    
+    Options m_options;
+    int m_fd;
+    qint64 m_fileSize;
+    qint64 m_position;
+    AVIOContext *m_context;
+    const uint8_t *m_map;  // Whole file, when mapped
+    
+    // Updated on the demuxing thread only
+    QElapsedTimer m_timer;
+    qint64 m_bytesRead;
+    qint64 m_readCalls;
+    
+    // Readahead state, guarded by m_mutex. A seek outside the buffered blocks
+    // bumps m_generation so a block read for the old position is discarded.
+    QThread *m_readaheadThread;
+    QMutex m_mutex;
+    QWaitCondition m_blockReady;
+    QWaitCondition m_spaceFree;
+    QList<Block> m_blocks;
+    qint64 m_readaheadOffset;
+    quint64 m_generation;
+    bool m_readaheadEof;
+    bool m_readaheadError;
+    bool m_stopping;
+    
+    // io_uring readahead, on the demuxing thread: m_slots is a ring of
+    // buffers in file order starting at m_head, and m_readaheadOffset is
+    // where the next submitted read starts
+    UringQueue *m_ring;
+    QList<Slot> m_slots;
+    int m_head;
+};
+
+#endif // MEDIAIO_H
@@ -0,0 +1,387 @@
+#include "mediawriter.h"
+#include "uringqueue.h"
+#include <QDebug>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/error.h>
+}
+
+// Chunks behind the newest one that may still sit in the page cache
+static const int WRITE_BEHIND_CHUNKS = 4;
+
+MediaWriter::MediaWriter(const Options &options)
+    : m_options(options)
+    , m_fd(-1)
+    , m_context(nullptr)
+    , m_position(0)
+    , m_end(0)
+    , m_bytesWritten(0)
+    , m_droppedUpTo(0)
+    , m_error(0)
+    , m_ring(nullptr)
+    , m_current(-1)
+{
+    m_options.bufferSize = qBound(64 * 1024, m_options.bufferSize, 64 * 1024 * 1024);
+    m_options.queueDepth = qMax(1, m_options.queueDepth);
+}
+
+MediaWriter::~MediaWriter()
+{
+    discard();
+}
+
+bool MediaWriter::open(const QString &filePath)
+{
+    discard();
+    
+    m_filePath = filePath;
+    m_partPath = filePath + ".part";
+    m_fd = ::open(m_partPath.toUtf8().constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (m_fd < 0) {
+        qWarning() << "MediaWriter: cannot create" << m_partPath << ":" << strerror(errno);
+        return false;
+    }
+
+#ifdef __linux__
+    // One extent for the whole output instead of one per flush; file systems
+    // without fallocate (NFS, SMB, FAT) simply refuse
+    if (m_options.preallocateBytes > 0) {
+        fallocate(m_fd, 0, 0, m_options.preallocateBytes);
+    }
+#endif
+
+    unsigned char *buffer = static_cast<unsigned char *>(av_malloc(m_options.bufferSize));
+    if (!buffer) {
+        discard();
+        return false;
+    }
+    
+    m_context = avio_alloc_context(buffer, m_options.bufferSize, 1, this, nullptr, &MediaWriter::writePacket,
+                                   &MediaWriter::seekCallback);
+    if (!m_context) {
+        av_free(buffer);
+        discard();
+        return false;
+    }
+    
+    m_position = 0;
+    m_end = 0;
+    m_bytesWritten = 0;
+    m_droppedUpTo = 0;
+    m_error = 0;
+    m_current = -1;
+    
+    int slotCount = 1;
+    if (m_options.ioUring) {
+        m_ring = new UringQueue(m_options.queueDepth);
+        if (m_ring->isValid()) {
+            slotCount = m_options.queueDepth;
+        } else {
+            delete m_ring;
+            m_ring = nullptr;
+        }
+    }
+    for (int i = 0; i < slotCount; ++i) {
+        m_slots.append(Slot{QByteArray(m_options.bufferSize, Qt::Uninitialized), 0, 0, false});
+    }
+    
+    return true;
+}
+
+bool MediaWriter::commit()
+{
+    if (m_fd < 0) {
+        return false;
+    }
+    
+    avio_flush(m_context);
+    if (m_context->error < 0 && m_error == 0) {
+        m_error = m_context->error;
+    }
+    if (m_error == 0) {
+        flushChunk();
+    }
+    drain();
+    
+    // The preallocation may have reserved more than was written
+    if (m_error == 0 && ftruncate(m_fd, m_end) != 0) {
+        m_error = AVERROR(errno);
+    }
+    
+    // The only sync of the file, so it is complete on disk before it
+    // appears under its real name
+    if (m_error == 0 && fsync(m_fd) != 0) {
+        m_error = AVERROR(errno);
+    }
+    
+    closeFile();
+    if (m_error == 0 && ::rename(m_partPath.toUtf8().constData(), m_filePath.toUtf8().constData()) != 0) {
+        m_error = AVERROR(errno);
+    }
+    
+    if (m_error != 0) {
+        ::unlink(m_partPath.toUtf8().constData());
+        return false;
+    }
+    return true;
+}
+
+void MediaWriter::closeFile()
+{
+    if (m_fd < 0) {
+        return;
+    }
+    
+    // Deleting the ring waits for writes still reading from m_slots
+    drain();
+    delete m_ring;
+    m_ring = nullptr;
+    m_slots.clear();
+    m_current = -1;
+    
+    if (m_context) {
+        av_freep(&m_context->buffer);
+        avio_context_free(&m_context);
+    }
+    if (::close(m_fd) != 0 && m_error == 0) {
+        m_error = AVERROR(errno);
+    }
+    m_fd = -1;
+}
+
+void MediaWriter::discard()
+{
+    if (m_fd < 0) {
+        return;
+    }
+    
+    closeFile();
+    ::unlink(m_partPath.toUtf8().constData());
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+int MediaWriter::writePacket(void *opaque, const uint8_t *buffer, int size)
+#else
+int MediaWriter::writePacket(void *opaque, uint8_t *buffer, int size)
+#endif
+{
+    return static_cast<MediaWriter *>(opaque)->write(buffer, size);
+}
+
+int64_t MediaWriter::seekCallback(void *opaque, int64_t offset, int whence)
+{
+    return static_cast<MediaWriter *>(opaque)->seek(offset, whence);
+}
+
+int MediaWriter::write(const uint8_t *buffer, int size)
+{
+    if (m_error) {
+        return m_error;
+    }
+    
+    int remaining = size;
+    while (remaining > 0) {
+        if (m_current >= 0) {
+            const Slot &chunk = m_slots[m_current];
+            if (m_position != chunk.offset + chunk.length && !flushChunk()) {
+                return m_error;
+            }
+        }
+        if (m_current < 0 && !startChunk()) {
+            return m_error;
+        }
+        
+        // Chunks end on multiples of the chunk size, so after the header
+        // every write is aligned and full sized
+        Slot &chunk = m_slots[m_current];
+        const qint64 chunkEnd = (chunk.offset / m_options.bufferSize + 1) * m_options.bufferSize;
+        const int bytes = static_cast<int>(qMin<qint64>(remaining, chunkEnd - m_position));
+        memcpy(chunk.data.data() + chunk.length, buffer, bytes);
+        chunk.length += bytes;
+        buffer += bytes;
+        remaining -= bytes;
+        
+        m_position += bytes;
+        m_end = qMax(m_end, m_position);
+        m_bytesWritten += bytes;
+        
+        if (m_position == chunkEnd && !flushChunk()) {
+            return m_error;
+        }
+    }
+    return size;
+}
+
+int64_t MediaWriter::seek(int64_t offset, int whence)
+{
+    whence &= ~AVSEEK_FORCE;
+    
+    qint64 target;
+    switch (whence) {
+    case AVSEEK_SIZE:
+        return m_end;
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = m_position + offset;
+        break;
+    case SEEK_END:
+        target = m_end + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+    
+    // Muxers seek back to patch headers; io_uring does not order writes, so
+    // let everything queued land before the region can be written again
+    if (target != m_position && (!flushChunk() || !drain())) {
+        return m_error;
+    }
+    
+    m_position = target;
+    return target;
+}
+
+bool MediaWriter::startChunk()
+{
+    // Buffers free up as their writes complete
+    for (;;) {
+        for (int i = 0; i < m_slots.size(); ++i) {
+            if (!m_slots[i].pending) {
+                m_current = i;
+                m_slots[i].offset = m_position;
+                m_slots[i].length = 0;
+                return true;
+            }
+        }
+        if (!reapOne()) {
+            return false;
+        }
+    }
+}
+
+bool MediaWriter::flushChunk()
+{
+    if (m_current < 0) {
+        return m_error == 0;
+    }
+    
+    const int index = m_current;
+    Slot &chunk = m_slots[index];
+    m_current = -1;
+    if (chunk.length == 0) {
+        return true;
+    }
+    
+    if (m_ring && m_ring->submitWrite(m_fd, chunk.data.constData(), chunk.length, chunk.offset, index)) {
+        chunk.pending = true;
+        return true;
+    }
+    
+    if (!writeDirect(chunk.data.constData(), chunk.length, chunk.offset)) {
+        return false;
+    }
+    chunkWritten(chunk.offset, chunk.length);
+    return true;
+}
+
+bool MediaWriter::writeDirect(const char *data, qint64 length, qint64 offset)
+{
+    while (length > 0) {
+        const ssize_t bytes = pwrite(m_fd, data, length, offset);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            if (m_error == 0) {
+                m_error = bytes < 0 ? AVERROR(errno) : AVERROR(EIO);
+            }
+            return false;
+        }
+        data += bytes;
+        length -= bytes;
+        offset += bytes;
+    }
+    return true;
+}
+
+void MediaWriter::chunkWritten(qint64 offset, qint64 length)
+{
+#ifdef __linux__
+    if (!m_options.writeBehind) {
+        return;
+    }
+    
+    // Hand the chunk to the disk now instead of when dirty pages pile up
+    sync_file_range(m_fd, offset, length, SYNC_FILE_RANGE_WRITE);
+    
+    // Older chunks have had time to reach the disk; wait for any rest and
+    // drop them from the cache. Rewrites behind the window are left alone.
+    const qint64 window = static_cast<qint64>(WRITE_BEHIND_CHUNKS) * m_options.bufferSize;
+    while (offset + length - m_droppedUpTo > window) {
+        sync_file_range(m_fd, m_droppedUpTo, m_options.bufferSize,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(m_fd, m_droppedUpTo, m_options.bufferSize, POSIX_FADV_DONTNEED);
+        m_droppedUpTo += m_options.bufferSize;
+    }
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+#endif
+}
+
+bool MediaWriter::reapOne()
+{
+    quint64 tag;
+    int result;
+    if (!m_ring || !m_ring->waitCompletion(&tag, &result)) {
+        if (m_error == 0) {
+            m_error = AVERROR(EIO);
+        }
+        return false;
+    }
+    
+    Slot &chunk = m_slots[tag];
+    chunk.pending = false;
+    
+    // result is -errno, which is how AVERROR() encodes errors on POSIX
+    if (result < 0) {
+        if (m_error == 0) {
+            m_error = result;
+        }
+        return false;
+    }
+    
+    // Short writes are finished in place
+    if (result < chunk.length &&
+        !writeDirect(chunk.data.constData() + result, chunk.length - result, chunk.offset + result)) {
+        return false;
+    }
+    chunkWritten(chunk.offset, chunk.length);
+    return true;
+}
+
+bool MediaWriter::drain()
+{
+    // Keeps reaping past a failed write, so no buffer is still in use; stops
+    // only if the ring itself fails
+    while (m_ring && m_ring->pending() > 0) {
+        const int pending = m_ring->pending();
+        reapOne();
+        if (m_ring->pending() == pending) {
+            break;
+        }
+    }
+    return m_error == 0;
+}
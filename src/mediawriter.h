@@ -0,0 +1,93 @@
+#ifndef MEDIAWRITER_H
+#define MEDIAWRITER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+class UringQueue;
+
+// File output for libavformat muxers, the write side of MediaIO. Data is
+// gathered into chunks that end on multiples of the buffer size and each
+// chunk goes to the file at its own offset: through io_uring with several
+// in flight while the muxing thread goes back to reading, or otherwise with
+// a plain pwrite(). Like QSaveFile, everything is written to <file>.part,
+// which commit() syncs once and renames into place.
+class MediaWriter
+{
+public:
+    struct Options {
+        // Chunk size, and the alignment of the writes
+        int bufferSize = 4 * 1024 * 1024;
+        // Chunks in flight through io_uring
+        int queueDepth = 4;
+        bool ioUring = false;
+        // Expected size, reserved in one piece when the file is created
+        qint64 preallocateBytes = 0;
+        // Start writeback of each chunk right away and drop older chunks
+        // from the page cache, so large outputs never fill it
+        bool writeBehind = true;
+    };
+    
+    explicit MediaWriter(const Options &options);
+    // Removes the partial file unless commit() succeeded
+    ~MediaWriter();
+    
+    bool open(const QString &filePath);
+    // Waits for every queued write, trims the preallocation, syncs and
+    // renames the file into place; on failure the partial file is removed
+    bool commit();
+    bool isOpen() const { return m_fd >= 0; }
+    AVIOContext *context() const { return m_context; }
+    bool usesIoUring() const { return m_ring != nullptr; }
+    qint64 bytesWritten() const { return m_bytesWritten; }
+
+private:
+    struct Slot {
+        QByteArray data;
+        qint64 offset;
+        int length;
+        bool pending;
+    };
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    static int writePacket(void *opaque, const uint8_t *buffer, int size);
+#else
+    static int writePacket(void *opaque, uint8_t *buffer, int size);
+#endif
+    static int64_t seekCallback(void *opaque, int64_t offset, int whence);
+    
+    int write(const uint8_t *buffer, int size);
+    int64_t seek(int64_t offset, int whence);
+    bool startChunk();
+    bool flushChunk();
+    bool writeDirect(const char *data, qint64 length, qint64 offset);
+    void chunkWritten(qint64 offset, qint64 length);
+    bool reapOne();
+    bool drain();
+    void closeFile();
+    void discard();
+    
+    Options m_options;
+    QString m_filePath;
+    QString m_partPath;
+    int m_fd;
+    AVIOContext *m_context;
+    qint64 m_position;
+    qint64 m_end;          // Largest offset written so far
+    qint64 m_bytesWritten;
+    qint64 m_droppedUpTo;  // Write-behind: start of the data still in the page cache
+    int m_error;           // First failure as an AVERROR code, or 0
+    
+    // Chunk buffers; one without io_uring. m_current is the chunk being
+    // filled, or -1.
+    UringQueue *m_ring;
+    QList<Slot> m_slots;
+    int m_current;
+};
+
+#endif // MEDIAWRITER_H
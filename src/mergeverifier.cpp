@@ -0,0 +1,214 @@
+#include "mergeverifier.h"
+#include "ffmpeghandler.h"
+#include "mediaio.h"
+#include "streamhasher.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QPair>
+#include <algorithm>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+// Stream durations may differ by timestamp rounding between time bases
+static const qint64 DURATION_TOLERANCE_MS = 100;
+
+MergeVerifier::MergeVerifier()
+    : m_cancelFlag(nullptr)
+    , m_compareHashes(false)
+{
+}
+
+MergeVerifier::Result MergeVerifier::verify(const QString &sourceFile, const MergeOutput &output, qint64 sourceOffsetMs)
+{
+    Result result;
+    QElapsedTimer timer;
+    timer.start();
+    
+    // Source, target, output
+    QList<AVFormatContext *> inputs;
+    inputs << MediaIO::openInput(sourceFile, MediaIO::scanOptions())
+           << MediaIO::openInput(output.targetFile, MediaIO::scanOptions())
+           << MediaIO::openInput(output.outputFile, MediaIO::scanOptions());
+    AVFormatContext *source = inputs[0];
+    AVFormatContext *target = inputs[1];
+    AVFormatContext *merged = inputs[2];
+    
+    auto finish = [&]() {
+        for (AVFormatContext *&input : inputs) {
+            MediaIO::closeInput(input);
+        }
+        result.passed = result.problems.isEmpty() && !(m_cancelFlag && *m_cancelFlag);
+        result.elapsedMs = timer.elapsed();
+        return result;
+    };
+    
+    if (!merged) {
+        result.problems << "cannot open the output";
+        return finish();
+    }
+    if (!source || !target) {
+        result.problems << QString("cannot open %1").arg(QFileInfo(!source ? sourceFile : output.targetFile).fileName());
+        return finish();
+    }
+    
+    // The plan, in output order: (input, stream) of the target's main video,
+    // then the selected tracks, as Remuxer maps them
+    QList<QPair<int, int>> expected;
+    for (unsigned int i = 0; i < target->nb_streams; ++i) {
+        const AVStream *stream = target->streams[i];
+        if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+            expected.append(qMakePair(1, static_cast<int>(i)));
+            break;
+        }
+    }
+    QList<QPair<QString, int>> tracks = output.selectedAudioTracks;
+    tracks += output.selectedSubtitleTracks;
+    for (const auto &track : tracks) {
+        expected.append(qMakePair(track.first == "source" ? 0 : 1, track.second));
+    }
+    
+    result.streamCount = merged->nb_streams;
+    if (static_cast<int>(merged->nb_streams) != expected.size()) {
+        result.problems << QString("%1 streams, expected %2").arg(merged->nb_streams).arg(expected.size());
+        return finish();
+    }
+    
+    QVector<QVector<int>> sourceDestinations(source->nb_streams);
+    QVector<QVector<int>> targetDestinations(target->nb_streams);
+    QVector<QVector<int>> outputDestinations(merged->nb_streams);
+    for (int i = 0; i < expected.size(); ++i) {
+        const AVFormatContext *input = inputs[expected[i].first];
+        const int streamIndex = expected[i].second;
+        if (streamIndex < 0 || streamIndex >= static_cast<int>(input->nb_streams)) {
+            result.problems << QString("stream %1: no stream %2 in the %3").arg(i).arg(streamIndex)
+                               .arg(expected[i].first == 0 ? "source" : "target");
+            continue;
+        }
+        
+        const AVCodecParameters *in = input->streams[streamIndex]->codecpar;
+        const AVCodecParameters *out = merged->streams[i]->codecpar;
+        if (in->codec_type != out->codec_type || in->codec_id != out->codec_id) {
+            result.problems << QString("stream %1: %2 %3, expected %4 %5").arg(i)
+                               .arg(av_get_media_type_string(out->codec_type)).arg(avcodec_get_name(out->codec_id))
+                               .arg(av_get_media_type_string(in->codec_type)).arg(avcodec_get_name(in->codec_id));
+        }
+        
+        (expected[i].first == 0 ? sourceDestinations : targetDestinations)[streamIndex].append(i);
+        outputDestinations[i].append(i);
+    }
+    if (!result.problems.isEmpty()) {
+        return finish();
+    }
+    
+    // Each file is read once; the source only when a track comes from it
+    QVector<StreamStats> inputStats(expected.size());
+    QVector<StreamStats> outputStats(expected.size());
+    const bool needsSource = std::any_of(sourceDestinations.begin(), sourceDestinations.end(),
+                                         [](const QVector<int> &destinations) { return !destinations.isEmpty(); });
+    if (needsSource) {
+        scan(source, sourceDestinations, sourceOffsetMs, sourceOffsetMs < 0, inputStats);
+    }
+    scan(target, targetDestinations, 0, false, inputStats);
+    
+    // A damaged input tail ends the merge as well, so it only matters in the output
+    const bool outputRead = scan(merged, outputDestinations, 0, false, outputStats);
+    if (m_cancelFlag && *m_cancelFlag) {
+        return finish();
+    }
+    if (!outputRead) {
+        result.problems << "read error in the output";
+        return finish();
+    }
+    
+    for (int i = 0; i < expected.size(); ++i) {
+        const StreamStats &in = inputStats[i];
+        const StreamStats &out = outputStats[i];
+        result.packetCount += out.packets;
+        
+        if (out.packets != in.packets) {
+            result.problems << QString("stream %1: %2 packets, expected %3").arg(i).arg(out.packets).arg(in.packets);
+            continue;
+        }
+        
+        const qint64 inDuration = in.endMs - in.startMs;
+        const qint64 outDuration = out.endMs - out.startMs;
+        if (qAbs(outDuration - inDuration) > DURATION_TOLERANCE_MS) {
+            result.problems << QString("stream %1: %2 ms long, expected %3 ms").arg(i).arg(outDuration).arg(inDuration);
+            continue;
+        }
+        
+        if (m_compareHashes && out.hash != in.hash) {
+            result.problems << QString("stream %1: payload differs").arg(i);
+        }
+    }
+    
+    return finish();
+}
+
+bool MergeVerifier::scan(AVFormatContext *input, const QVector<QVector<int>> &destinations, qint64 shiftMs, bool dropNegative,
+                         QVector<StreamStats> &stats) const
+{
+    // The demuxer can skip streams nobody asked for
+    for (unsigned int i = 0; i < input->nb_streams; ++i) {
+        input->streams[i]->discard = destinations[i].isEmpty() ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    }
+    
+    // Every input starts at zero, as in the merge, then moves by the offset
+    const qint64 shiftUs = (input->start_time != AV_NOPTS_VALUE ? -input->start_time : 0) + shiftMs * 1000;
+    
+    QVector<XXHash64> hashes(stats.size());
+    QVector<bool> started(stats.size(), false);
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        return false;
+    }
+    
+    int error;
+    while ((error = av_read_frame(input, packet)) >= 0) {
+        if (m_cancelFlag && *m_cancelFlag) {
+            av_packet_unref(packet);
+            break;
+        }
+        if (packet->stream_index >= destinations.size() || destinations[packet->stream_index].isEmpty()) {
+            av_packet_unref(packet);
+            continue;
+        }
+        
+        // Same arithmetic as Remuxer::copyPackets(), so the same packets are dropped
+        const AVStream *stream = input->streams[packet->stream_index];
+        const int64_t shift = av_rescale_q(shiftUs, AV_TIME_BASE_Q, stream->time_base);
+        const int64_t time = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        if (dropNegative && time != AV_NOPTS_VALUE && time + shift < 0) {
+            av_packet_unref(packet);
+            continue;
+        }
+        
+        const AVRational milliseconds = {1, 1000};
+        const qint64 startMs = time != AV_NOPTS_VALUE ? av_rescale_q(time + shift, stream->time_base, milliseconds) : 0;
+        const qint64 endMs = startMs + av_rescale_q(packet->duration, stream->time_base, milliseconds);
+        for (int slot : destinations[packet->stream_index]) {
+            StreamStats &entry = stats[slot];
+            entry.packets++;
+            if (time != AV_NOPTS_VALUE) {
+                entry.startMs = started[slot] ? qMin(entry.startMs, startMs) : startMs;
+                entry.endMs = started[slot] ? qMax(entry.endMs, endMs) : endMs;
+                started[slot] = true;
+            }
+            if (m_compareHashes) {
+                hashes[slot].update(packet->data, packet->size);
+            }
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    
+    if (m_compareHashes) {
+        for (int slot = 0; slot < stats.size(); ++slot) {
+            stats[slot].hash = hashes[slot].digest();
+        }
+    }
+    return error == AVERROR_EOF;
+}
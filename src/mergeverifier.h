@@ -0,0 +1,56 @@
+#ifndef MERGEVERIFIER_H
+#define MERGEVERIFIER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+
+struct MergeOutput;
+struct AVFormatContext;
+
+// Checks a finished merge against its plan by demuxing only. The output
+// must hold the target's video followed by the selected tracks, with the
+// codecs of the streams they were copied from, and each stream the packet
+// count and duration of its input after the source offset is applied.
+// Optionally the packet payloads are hashed on both sides as well.
+class MergeVerifier
+{
+public:
+    struct Result {
+        bool passed = false;
+        QStringList problems;     // One line per mismatch
+        int streamCount = 0;
+        qint64 packetCount = 0;   // Read from the output
+        qint64 elapsedMs = 0;
+    };
+    
+    MergeVerifier();
+    
+    void setCancelFlag(const std::atomic<bool> *cancelFlag) { m_cancelFlag = cancelFlag; }
+    // Payload hashes fail outputs whose muxer rewrites a bitstream, e.g. ADTS
+    // AAC from a transport stream stored in MP4
+    void setCompareHashes(bool enabled) { m_compareHashes = enabled; }
+    
+    // sourceOffsetMs as in FFmpegHandler::mergeTracks
+    Result verify(const QString &sourceFile, const MergeOutput &output, qint64 sourceOffsetMs);
+
+private:
+    struct StreamStats {
+        qint64 packets = 0;
+        qint64 startMs = 0;
+        qint64 endMs = 0;
+        quint64 hash = 0;
+    };
+    
+    // Reads every packet of input once. destinations[stream] lists where that
+    // stream's statistics go; timestamps move by shiftMs, and packets that end
+    // up before zero are skipped when dropNegative is set, as the merge does.
+    bool scan(AVFormatContext *input, const QVector<QVector<int>> &destinations, qint64 shiftMs, bool dropNegative,
+              QVector<StreamStats> &stats) const;
+    
+    const std::atomic<bool> *m_cancelFlag;
+    bool m_compareHashes;
+};
+
+#endif // MERGEVERIFIER_H
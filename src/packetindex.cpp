@@ -0,0 +1,224 @@
+#include "packetindex.h"
+#include "mediaio.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+// Keyframes this much earlier than the median GOP length were forced by a cut
+static const double EARLY_KEYFRAME_RATIO = 0.8;
+
+// Inter packets this many times larger than the upper quantile of their
+// neighbours carry a mostly intra-coded picture, i.e. a new shot
+static const double SIZE_SPIKE_FACTOR = 3.0;
+static const double SIZE_SPIKE_QUANTILE = 0.8;
+static const int SIZE_SPIKE_RADIUS = 12;
+
+// Candidates closer together than this are one cut
+static const qint64 MIN_CUT_SPACING_MS = 500;
+
+// Tolerances of the container sanity check
+static const qint64 DURATION_TOLERANCE_MS = 1000;
+static const double RELATIVE_TOLERANCE = 0.02;
+
+PacketIndex::PacketIndex()
+    : m_durationMs(0)
+    , m_containerDurationMs(0)
+    , m_containerFrameRate(0.0)
+{
+}
+
+bool PacketIndex::build(const QString &filePath, const std::atomic<bool> *cancelFlag)
+{
+    m_entries.clear();
+    m_keyframes.clear();
+    m_durationMs = 0;
+    m_containerDurationMs = 0;
+    m_containerFrameRate = 0.0;
+    
+    // One front-to-back pass over the whole file
+    AVFormatContext *formatContext = MediaIO::openInput(filePath, MediaIO::scanOptions());
+    if (!formatContext) {
+        return false;
+    }
+    
+    int streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (streamIndex < 0) {
+        MediaIO::closeInput(formatContext);
+        return false;
+    }
+    
+    // Only the video stream is indexed
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
+        if (static_cast<int>(i) != streamIndex) {
+            formatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    
+    AVStream *stream = formatContext->streams[streamIndex];
+    AVRational declaredRate = stream->avg_frame_rate.num > 0 ? stream->avg_frame_rate : stream->r_frame_rate;
+    m_containerFrameRate = (declaredRate.num > 0 && declaredRate.den > 0) ? av_q2d(declaredRate) : 0.0;
+    m_containerDurationMs = (formatContext->duration != AV_NOPTS_VALUE) ? formatContext->duration / 1000 : 0;
+    
+    const qint64 startTimeMs = (formatContext->start_time != AV_NOPTS_VALUE)
+                                   ? formatContext->start_time / 1000 : 0;
+    
+    AVPacket *packet = av_packet_alloc();
+    bool cancelled = false;
+    while (av_read_frame(formatContext, packet) >= 0) {
+        if (packet->stream_index == streamIndex) {
+            int64_t pts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+            if (pts != AV_NOPTS_VALUE) {
+                Entry entry;
+                // Rounded up, as FrameDecoder does: a seek to the millisecond
+                // must not land before the packet, on the previous keyframe
+                entry.ptsMs = av_rescale_q_rnd(pts, stream->time_base, AVRational{1, 1000}, AV_ROUND_UP) - startTimeMs;
+                entry.size = packet->size;
+                entry.keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+                m_entries.append(entry);
+            }
+        }
+        av_packet_unref(packet);
+        
+        if (cancelFlag && cancelFlag->load()) {
+            cancelled = true;
+            break;
+        }
+    }
+    
+    // Cleanup
+    av_packet_free(&packet);
+    MediaIO::closeInput(formatContext);
+    
+    if (cancelled) {
+        m_entries.clear();
+        return false;
+    }
+    
+    // Packets arrive in decode order; everything else works in presentation order
+    std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) {
+        return a.ptsMs < b.ptsMs;
+    });
+    
+    for (const Entry &entry : m_entries) {
+        if (entry.keyframe) {
+            m_keyframes.append(entry.ptsMs);
+        }
+    }
+    
+    if (!m_entries.isEmpty()) {
+        double rate = frameRate();
+        m_durationMs = m_entries.last().ptsMs + (rate > 0.0 ? qRound64(1000.0 / rate) : 0);
+    }
+    
+    qDebug() << "Indexed" << m_entries.size() << "packets," << m_keyframes.size() << "keyframes of" << filePath;
+    return !m_entries.isEmpty();
+}
+
+double PacketIndex::frameRate() const
+{
+    if (m_entries.size() < 2) {
+        return 0.0;
+    }
+    
+    qint64 span = m_entries.last().ptsMs - m_entries.first().ptsMs;
+    return span > 0 ? (m_entries.size() - 1) * 1000.0 / span : 0.0;
+}
+
+bool PacketIndex::isConsistent() const
+{
+    if (m_entries.isEmpty()) {
+        return false;
+    }
+    
+    if (m_containerDurationMs > 0) {
+        qint64 tolerance = qMax(DURATION_TOLERANCE_MS, static_cast<qint64>(m_durationMs * RELATIVE_TOLERANCE));
+        if (std::abs(m_containerDurationMs - m_durationMs) > tolerance) {
+            return false;
+        }
+    }
+    
+    double measuredRate = frameRate();
+    if (m_containerFrameRate > 0.0 && measuredRate > 0.0 &&
+        std::abs(m_containerFrameRate - measuredRate) > m_containerFrameRate * RELATIVE_TOLERANCE) {
+        return false;
+    }
+    
+    return true;
+}
+
+QVector<qint64> PacketIndex::keyframeSamples(qint64 startMs, qint64 endMs, qint64 minSpacingMs) const
+{
+    QVector<qint64> samples;
+    
+    auto keyframe = std::lower_bound(m_keyframes.constBegin(), m_keyframes.constEnd(), startMs);
+    for (; keyframe != m_keyframes.constEnd() && *keyframe < endMs; ++keyframe) {
+        if (samples.isEmpty() || *keyframe - samples.last() >= minSpacingMs) {
+            samples.append(*keyframe);
+        }
+    }
+    
+    return samples;
+}
+
+QVector<qint64> PacketIndex::sceneCutCandidates() const
+{
+    QVector<qint64> candidates;
+    
+    // Keyframes ahead of the usual cadence
+    if (m_keyframes.size() >= 3) {
+        std::vector<qint64> intervals;
+        intervals.reserve(m_keyframes.size() - 1);
+        for (int i = 1; i < m_keyframes.size(); ++i) {
+            intervals.push_back(m_keyframes[i] - m_keyframes[i - 1]);
+        }
+        std::nth_element(intervals.begin(), intervals.begin() + intervals.size() / 2, intervals.end());
+        qint64 medianInterval = intervals[intervals.size() / 2];
+        
+        for (int i = 1; i < m_keyframes.size(); ++i) {
+            if (m_keyframes[i] - m_keyframes[i - 1] < medianInterval * EARLY_KEYFRAME_RATIO) {
+                candidates.append(m_keyframes[i]);
+            }
+        }
+    }
+    
+    // Oversized inter packets. The upper quantile rather than the median of
+    // the neighbourhood, so that P frames among B frames do not count.
+    std::vector<qint32> neighbours;
+    for (int i = 0; i < m_entries.size(); ++i) {
+        if (m_entries[i].keyframe) {
+            continue;
+        }
+        
+        neighbours.clear();
+        for (int k = qMax(0, i - SIZE_SPIKE_RADIUS); k <= qMin(m_entries.size() - 1, i + SIZE_SPIKE_RADIUS); ++k) {
+            if (k != i) {
+                neighbours.push_back(m_entries[k].size);
+            }
+        }
+        if (neighbours.size() < static_cast<size_t>(SIZE_SPIKE_RADIUS)) {
+            continue;
+        }
+        
+        auto quantile = neighbours.begin() + static_cast<int>(neighbours.size() * SIZE_SPIKE_QUANTILE);
+        std::nth_element(neighbours.begin(), quantile, neighbours.end());
+        if (*quantile > 0 && m_entries[i].size > SIZE_SPIKE_FACTOR * *quantile) {
+            candidates.append(m_entries[i].ptsMs);
+        }
+    }
+    
+    std::sort(candidates.begin(), candidates.end());
+    QVector<qint64> cuts;
+    for (qint64 candidate : candidates) {
+        if (cuts.isEmpty() || candidate - cuts.last() >= MIN_CUT_SPACING_MS) {
+            cuts.append(candidate);
+        }
+    }
+    
+    return cuts;
+}
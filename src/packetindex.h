@@ -0,0 +1,53 @@
+#ifndef PACKETINDEX_H
+#define PACKETINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+// Timestamp, size and keyframe flag of every packet of a file's main video
+// stream. Built by demuxing only, so a whole film is indexed at disk speed.
+class PacketIndex
+{
+public:
+    struct Entry {
+        qint64 ptsMs; // Relative to the start of the file, rounded up
+        qint32 size;
+        bool keyframe;
+    };
+    
+    PacketIndex();
+    
+    bool build(const QString &filePath, const std::atomic<bool> *cancelFlag = nullptr);
+    
+    bool isEmpty() const { return m_entries.isEmpty(); }
+    int size() const { return m_entries.size(); }
+    const Entry &at(int index) const { return m_entries[index]; }
+    const QVector<qint64> &keyframes() const { return m_keyframes; }
+    
+    // Measured from the packets, and as declared by the container
+    qint64 durationMs() const { return m_durationMs; }
+    double frameRate() const;
+    qint64 containerDurationMs() const { return m_containerDurationMs; }
+    double containerFrameRate() const { return m_containerFrameRate; }
+    // False when the container's duration or frame rate disagree with the packets
+    bool isConsistent() const;
+    
+    // Keyframes in [startMs, endMs) at least minSpacingMs apart. Seeking to
+    // one of them decodes exactly one frame.
+    QVector<qint64> keyframeSamples(qint64 startMs, qint64 endMs, qint64 minSpacingMs) const;
+    
+    // Likely shot boundaries: keyframes placed ahead of the regular GOP
+    // cadence, and inter packets far larger than their neighbours. Encoders
+    // put both on cuts, so no frame has to be decoded to find them.
+    QVector<qint64> sceneCutCandidates() const;
+
+private:
+    QVector<Entry> m_entries; // Sorted by ptsMs
+    QVector<qint64> m_keyframes;
+    qint64 m_durationMs;
+    qint64 m_containerDurationMs;
+    double m_containerFrameRate;
+};
+
+#endif // PACKETINDEX_H
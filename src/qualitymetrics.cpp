@@ -0,0 +1,325 @@
+#include "qualitymetrics.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUALITYMETRICS_SSE2
+#include <emmintrin.h>
+#endif
+
+// SSIM stabilisers for 8 bit samples, (0.01 * 255)^2 and (0.03 * 255)^2
+static const double SSIM_C1 = 6.5025;
+static const double SSIM_C2 = 58.5225;
+
+// MS-SSIM scale weights of Wang, Simoncelli and Bovik, finest scale first
+static const double MS_SSIM_WEIGHTS[] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+static const int MS_SSIM_SCALES = 5;
+
+// SSIM windows are 2x2 of these blocks, so neighbouring windows share sums
+static const int BLOCK_SIZE = 4;
+
+namespace {
+
+struct BlockSums {
+    int sumA;
+    int sumB;
+    int sumSquares; // Of both planes
+    int sumProducts;
+};
+
+}
+
+static double windowSsim(double sumA, double sumB, double sumSquares, double sumProducts, double count)
+{
+    // SSIM from raw sums, with numerator and denominator scaled by count^2
+    double meanProduct = 2.0 * sumA * sumB + SSIM_C1 * count * count;
+    double meanSquares = sumA * sumA + sumB * sumB + SSIM_C1 * count * count;
+    double covariance = 2.0 * (sumProducts * count - sumA * sumB) + SSIM_C2 * count * count;
+    double variances = sumSquares * count - sumA * sumA - sumB * sumB + SSIM_C2 * count * count;
+    return (meanProduct * covariance) / (meanSquares * variances);
+}
+
+// Sums over one row of 4x4 blocks starting at a and b
+static void blockRowSums(const quint8 *a, const quint8 *b, int stride, int blocks, BlockSums *out)
+{
+    int block = 0;
+
+#ifdef QUALITYMETRICS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    
+    // Two blocks per iteration: eight 16 bit columns, four rows
+    for (; block + 2 <= blocks; block += 2) {
+        __m128i sumA = zero;
+        __m128i sumB = zero;
+        __m128i sumSquares = zero;
+        __m128i sumProducts = zero;
+        for (int row = 0; row < BLOCK_SIZE; ++row) {
+            const quint8 *rowA = a + row * stride + block * BLOCK_SIZE;
+            const quint8 *rowB = b + row * stride + block * BLOCK_SIZE;
+            __m128i pixelsA = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rowA)), zero);
+            __m128i pixelsB = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rowB)), zero);
+            
+            sumA = _mm_add_epi16(sumA, pixelsA);
+            sumB = _mm_add_epi16(sumB, pixelsB);
+            sumSquares = _mm_add_epi32(sumSquares, _mm_add_epi32(_mm_madd_epi16(pixelsA, pixelsA),
+                                                                  _mm_madd_epi16(pixelsB, pixelsB)));
+            sumProducts = _mm_add_epi32(sumProducts, _mm_madd_epi16(pixelsA, pixelsB));
+        }
+        
+        // Column pairs to 32 bit lanes; lanes 0-1 belong to the first block, 2-3 to the second
+        alignas(16) qint32 lanes[4][4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes[0]), _mm_madd_epi16(sumA, ones));
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes[1]), _mm_madd_epi16(sumB, ones));
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes[2]), sumSquares);
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes[3]), sumProducts);
+        
+        for (int half = 0; half < 2; ++half) {
+            BlockSums &sums = out[block + half];
+            sums.sumA = lanes[0][2 * half] + lanes[0][2 * half + 1];
+            sums.sumB = lanes[1][2 * half] + lanes[1][2 * half + 1];
+            sums.sumSquares = lanes[2][2 * half] + lanes[2][2 * half + 1];
+            sums.sumProducts = lanes[3][2 * half] + lanes[3][2 * half + 1];
+        }
+    }
+#endif
+
+    for (; block < blocks; ++block) {
+        BlockSums &sums = out[block];
+        sums = BlockSums{0, 0, 0, 0};
+        for (int row = 0; row < BLOCK_SIZE; ++row) {
+            const quint8 *rowA = a + row * stride + block * BLOCK_SIZE;
+            const quint8 *rowB = b + row * stride + block * BLOCK_SIZE;
+            for (int x = 0; x < BLOCK_SIZE; ++x) {
+                sums.sumA += rowA[x];
+                sums.sumB += rowB[x];
+                sums.sumSquares += rowA[x] * rowA[x] + rowB[x] * rowB[x];
+                sums.sumProducts += rowA[x] * rowB[x];
+            }
+        }
+    }
+}
+
+static quint64 rowSquaredError(const quint8 *a, const quint8 *b, int width)
+{
+    quint64 total = 0;
+    int x = 0;
+
+#ifdef QUALITYMETRICS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i accumulator = zero;
+    for (; x + 16 <= width; x += 16) {
+        __m128i pixelsA = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x));
+        __m128i pixelsB = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x));
+        __m128i low = _mm_sub_epi16(_mm_unpacklo_epi8(pixelsA, zero), _mm_unpacklo_epi8(pixelsB, zero));
+        __m128i high = _mm_sub_epi16(_mm_unpackhi_epi8(pixelsA, zero), _mm_unpackhi_epi8(pixelsB, zero));
+        accumulator = _mm_add_epi32(accumulator, _mm_madd_epi16(low, low));
+        accumulator = _mm_add_epi32(accumulator, _mm_madd_epi16(high, high));
+    }
+    
+    alignas(16) quint32 lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), accumulator);
+    total = static_cast<quint64>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    for (; x < width; ++x) {
+        int difference = a[x] - b[x];
+        total += difference * difference;
+    }
+    return total;
+}
+
+LumaPlane::LumaPlane()
+    : m_width(0)
+    , m_height(0)
+{
+}
+
+LumaPlane::LumaPlane(int width, int height)
+    : m_width(width)
+    , m_height(height)
+    , m_data(width * height)
+{
+}
+
+LumaPlane LumaPlane::fromImage(const QImage &image, int width, int height)
+{
+    if (image.isNull() || width <= 0 || height <= 0) {
+        return LumaPlane();
+    }
+    
+    QImage source = image;
+    if (source.width() != width || source.height() != height) {
+        source = source.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    if (source.format() != QImage::Format_RGB888) {
+        source = source.convertToFormat(QImage::Format_RGB888);
+    }
+    
+    LumaPlane plane(width, height);
+    for (int y = 0; y < height; ++y) {
+        const uchar *rgb = source.constScanLine(y);
+        quint8 *luma = plane.data() + y * width;
+        for (int x = 0; x < width; ++x) {
+            luma[x] = static_cast<quint8>((77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2] + 128) >> 8);
+            rgb += 3;
+        }
+    }
+    return plane;
+}
+
+LumaPlane LumaPlane::downscaled() const
+{
+    LumaPlane half(m_width / 2, m_height / 2);
+    
+    for (int y = 0; y < half.m_height; ++y) {
+        const quint8 *top = constData() + 2 * y * m_width;
+        const quint8 *bottom = top + m_width;
+        quint8 *out = half.data() + y * half.m_width;
+        int x = 0;
+
+#ifdef QUALITYMETRICS_SSE2
+        // Even and odd columns split into 16 bit lanes, rounded mean of four
+        const __m128i evenMask = _mm_set1_epi16(0x00FF);
+        const __m128i rounding = _mm_set1_epi16(2);
+        for (; x + 8 <= half.m_width; x += 8) {
+            __m128i rowTop = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top + 2 * x));
+            __m128i rowBottom = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + 2 * x));
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(rowTop, evenMask), _mm_srli_epi16(rowTop, 8)),
+                                        _mm_add_epi16(_mm_and_si128(rowBottom, evenMask), _mm_srli_epi16(rowBottom, 8)));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + x), _mm_packus_epi16(sum, sum));
+        }
+#endif
+
+        for (; x < half.m_width; ++x) {
+            out[x] = static_cast<quint8>((top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2);
+        }
+    }
+    return half;
+}
+
+double QualityMetrics::psnr(const LumaPlane &a, const LumaPlane &b)
+{
+    if (a.isNull() || a.width() != b.width() || a.height() != b.height()) {
+        return 0.0;
+    }
+    
+    quint64 squaredError = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        squaredError += rowSquaredError(a.constData() + y * a.width(), b.constData() + y * b.width(), a.width());
+    }
+    if (squaredError == 0) {
+        return MAX_PSNR;
+    }
+    
+    double meanSquaredError = static_cast<double>(squaredError) / (static_cast<double>(a.width()) * a.height());
+    return qMin(MAX_PSNR, 10.0 * std::log10(255.0 * 255.0 / meanSquaredError));
+}
+
+double QualityMetrics::ssim(const LumaPlane &a, const LumaPlane &b)
+{
+    if (a.isNull() || a.width() != b.width() || a.height() != b.height()) {
+        return 0.0;
+    }
+    
+    const int blocksX = a.width() / BLOCK_SIZE;
+    const int blocksY = a.height() / BLOCK_SIZE;
+    
+    // Too small for a single window: one global window over everything
+    if (blocksX < 2 || blocksY < 2) {
+        double sumA = 0.0;
+        double sumB = 0.0;
+        double sumSquares = 0.0;
+        double sumProducts = 0.0;
+        const int count = a.width() * a.height();
+        for (int i = 0; i < count; ++i) {
+            double pixelA = a.constData()[i];
+            double pixelB = b.constData()[i];
+            sumA += pixelA;
+            sumB += pixelB;
+            sumSquares += pixelA * pixelA + pixelB * pixelB;
+            sumProducts += pixelA * pixelB;
+        }
+        return windowSsim(sumA, sumB, sumSquares, sumProducts, count);
+    }
+    
+    // Two rows of block sums are enough; every window spans two block rows
+    std::vector<BlockSums> previous(blocksX);
+    std::vector<BlockSums> current(blocksX);
+    blockRowSums(a.constData(), b.constData(), a.width(), blocksX, previous.data());
+    
+    double total = 0.0;
+    for (int blockY = 1; blockY < blocksY; ++blockY) {
+        const int offset = blockY * BLOCK_SIZE * a.width();
+        blockRowSums(a.constData() + offset, b.constData() + offset, a.width(), blocksX, current.data());
+        
+        for (int blockX = 0; blockX + 1 < blocksX; ++blockX) {
+            const BlockSums *quad[4] = { &previous[blockX], &previous[blockX + 1], &current[blockX], &current[blockX + 1] };
+            double sumA = 0.0;
+            double sumB = 0.0;
+            double sumSquares = 0.0;
+            double sumProducts = 0.0;
+            for (const BlockSums *sums : quad) {
+                sumA += sums->sumA;
+                sumB += sums->sumB;
+                sumSquares += sums->sumSquares;
+                sumProducts += sums->sumProducts;
+            }
+            total += windowSsim(sumA, sumB, sumSquares, sumProducts, 4 * BLOCK_SIZE * BLOCK_SIZE);
+        }
+        std::swap(previous, current);
+    }
+    
+    return total / (static_cast<double>(blocksX - 1) * (blocksY - 1));
+}
+
+double QualityMetrics::msSsim(const LumaPlane &a, const LumaPlane &b)
+{
+    if (a.isNull() || a.width() != b.width() || a.height() != b.height()) {
+        return 0.0;
+    }
+    
+    LumaPlane scaledA = a;
+    LumaPlane scaledB = b;
+    double weightedLog = 0.0;
+    double weightSum = 0.0;
+    
+    // Coarser scales are dropped once a plane no longer fits a window
+    for (int scale = 0; scale < MS_SSIM_SCALES; ++scale) {
+        if (scale > 0) {
+            if (scaledA.width() < 4 * BLOCK_SIZE || scaledA.height() < 4 * BLOCK_SIZE) {
+                break;
+            }
+            scaledA = scaledA.downscaled();
+            scaledB = scaledB.downscaled();
+        }
+        
+        // Negative SSIM (inverted structure) has no real power
+        double value = qMax(1e-6, ssim(scaledA, scaledB));
+        weightedLog += MS_SSIM_WEIGHTS[scale] * std::log(value);
+        weightSum += MS_SSIM_WEIGHTS[scale];
+    }
+    
+    return std::exp(weightedLog / weightSum);
+}
+
+QualityMetrics::Scores QualityMetrics::compute(const QImage &a, const QImage &b, const Options &options)
+{
+    Scores scores;
+    scores.msSsim = -1.0;
+    
+    LumaPlane planeA = LumaPlane::fromImage(a, options.width, options.height);
+    LumaPlane planeB = LumaPlane::fromImage(b, options.width, options.height);
+    if (planeA.isNull() || planeB.isNull()) {
+        return scores;
+    }
+    
+    scores.psnr = psnr(planeA, planeB);
+    scores.ssim = ssim(planeA, planeB);
+    if (options.multiScale) {
+        scores.msSsim = msSsim(planeA, planeB);
+    }
+    return scores;
+}
@@ -0,0 +1,64 @@
+#ifndef QUALITYMETRICS_H
+#define QUALITYMETRICS_H
+
+#include <QImage>
+#include <QVector>
+
+// 8 bit luma plane, rows packed without padding
+class LumaPlane
+{
+public:
+    LumaPlane();
+    LumaPlane(int width, int height);
+    
+    // BT.601 full-range luma of the image, scaled to width x height first
+    // unless the image already has that size
+    static LumaPlane fromImage(const QImage &image, int width, int height);
+    
+    bool isNull() const { return m_width <= 0 || m_height <= 0; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    const quint8 *constData() const { return m_data.constData(); }
+    quint8 *data() { return m_data.data(); }
+    
+    // Half the size in both directions, each pixel the mean of a 2x2 block
+    LumaPlane downscaled() const;
+
+private:
+    int m_width;
+    int m_height;
+    QVector<quint8> m_data;
+};
+
+// Full-reference quality metrics between two frames of the same size.
+// Unlike the perceptual hash these tell a re-encode from the same encode
+// and put a number on the loss. The inner loops use SSE2 where available.
+class QualityMetrics
+{
+public:
+    struct Options {
+        bool enabled = false;   // Metrics cost an extra decode per sample
+        int width = 640;        // Resolution the luma planes are compared at
+        int height = 360;
+        bool multiScale = true; // Also compute the MS-SSIM approximation
+    };
+    
+    struct Scores {
+        double psnr = 0.0;   // dB, MAX_PSNR for identical planes
+        double ssim = 0.0;   // 0..1
+        double msSsim = 0.0; // 0..1, or -1 when not computed
+    };
+    
+    static constexpr double MAX_PSNR = 100.0;
+    
+    static double psnr(const LumaPlane &a, const LumaPlane &b);
+    // Mean SSIM over 8x8 windows on a 4 pixel grid
+    static double ssim(const LumaPlane &a, const LumaPlane &b);
+    // SSIM on up to five dyadic scales combined with the weights of Wang et
+    // al.; the full SSIM stands in for the contrast-structure term per scale
+    static double msSsim(const LumaPlane &a, const LumaPlane &b);
+    
+    static Scores compute(const QImage &a, const QImage &b, const Options &options);
+};
+
+#endif // QUALITYMETRICS_H
@@ -0,0 +1,349 @@
+#include "remuxer.h"
+#include "ffmpeghandler.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QVector>
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/mathematics.h>
+}
+
+// Bytes of one stream's packets: mkvmerge's statistics tags when present,
+// otherwise the nominal bit rate over the file's duration
+static qint64 streamSize(const AVFormatContext *input, const AVStream *stream)
+{
+    const AVDictionaryEntry *entry = av_dict_get(stream->metadata, "NUMBER_OF_BYTES", nullptr, AV_DICT_IGNORE_SUFFIX);
+    if (entry) {
+        return QString::fromUtf8(entry->value).toLongLong();
+    }
+    if (stream->codecpar->bit_rate > 0 && input->duration > 0) {
+        return av_rescale(stream->codecpar->bit_rate / 8, input->duration, AV_TIME_BASE);
+    }
+    return 0;
+}
+
+Remuxer::Remuxer()
+{
+}
+
+bool Remuxer::run(const QString &sourceFile, const QList<MergeOutput> &outputs, qint64 sourceOffsetMs)
+{
+    m_errorString.clear();
+    m_readStats = MediaIO::Stats();
+    
+    if (outputs.isEmpty()) {
+        return fail("Nothing to merge");
+    }
+    
+    bool success = open(sourceFile, outputs, sourceOffsetMs) && copyPackets(sourceOffsetMs);
+    return close(success, outputs);
+}
+
+bool Remuxer::open(const QString &sourceFile, const QList<MergeOutput> &outputs, qint64 sourceOffsetMs)
+{
+    // Every input is read once from start to end
+    MediaIO::Options ioOptions = m_ioOptions;
+    ioOptions.readahead = true;
+    ioOptions.sequential = true;
+    
+    QStringList inputFiles;
+    inputFiles << sourceFile;
+    for (const MergeOutput &output : outputs) {
+        inputFiles << output.targetFile;
+    }
+    
+    for (const QString &inputFile : inputFiles) {
+        AVFormatContext *input = MediaIO::openInput(inputFile, ioOptions);
+        if (!input) {
+            return fail(QString("Cannot open %1").arg(inputFile));
+        }
+        m_inputs.append(input);
+        m_routes.append(QList<Routes>(input->nb_streams));
+    }
+    
+    for (int output = 0; output < outputs.size(); ++output) {
+        if (!openOutput(output, outputs[output], sourceOffsetMs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Remuxer::openOutput(int output, const MergeOutput &mergeOutput, qint64 sourceOffsetMs)
+{
+    const QByteArray outputPath = mergeOutput.outputFile.toUtf8();
+    AVFormatContext *outputContext = nullptr;
+    if (avformat_alloc_output_context2(&outputContext, nullptr, nullptr, outputPath.constData()) < 0 || !outputContext) {
+        return fail(QString("No muxer for %1").arg(mergeOutput.outputFile));
+    }
+    m_outputs.append(outputContext);
+    m_writers.append(nullptr);
+    
+    // The target's main video, skipping cover art
+    const int targetInput = output + 1;
+    const AVFormatContext *target = m_inputs[targetInput];
+    int videoStream = -1;
+    for (unsigned int i = 0; i < target->nb_streams && videoStream < 0; ++i) {
+        const AVStream *stream = target->streams[i];
+        if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+            videoStream = i;
+        }
+    }
+    if (videoStream < 0) {
+        return fail(QString("No video stream in %1").arg(mergeOutput.targetFile));
+    }
+    if (!addStream(output, targetInput, videoStream)) {
+        return false;
+    }
+    
+    QList<QPair<QString, int>> tracks = mergeOutput.selectedAudioTracks;
+    tracks += mergeOutput.selectedSubtitleTracks;
+    for (const auto &track : tracks) {
+        if (track.first == "source" && !addStream(output, 0, track.second)) {
+            return false;
+        }
+        if (track.first == "target" && !addStream(output, targetInput, track.second)) {
+            return false;
+        }
+    }
+    
+    // Global metadata and chapters come from the first input, as with ffmpeg
+    av_dict_copy(&outputContext->metadata, m_inputs.first()->metadata, 0);
+    copyChapters(outputContext, sourceOffsetMs);
+    
+    if (!(outputContext->oformat->flags & AVFMT_NOFILE)) {
+        MediaWriter::Options writerOptions;
+        writerOptions.bufferSize = m_ioOptions.bufferSize;
+        writerOptions.queueDepth = m_ioOptions.readaheadBlocks;
+        writerOptions.ioUring = m_ioOptions.ioUring;
+        writerOptions.preallocateBytes = expectedSize(mergeOutput);
+        
+        MediaWriter *writer = new MediaWriter(writerOptions);
+        m_writers[output] = writer;
+        if (!writer->open(mergeOutput.outputFile)) {
+            return fail(QString("Cannot create %1").arg(mergeOutput.outputFile));
+        }
+        outputContext->pb = writer->context();
+        outputContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    if (avformat_write_header(outputContext, nullptr) < 0) {
+        return fail(QString("Cannot write the header of %1").arg(mergeOutput.outputFile));
+    }
+    return true;
+}
+
+qint64 Remuxer::expectedSize(const MergeOutput &mergeOutput) const
+{
+    // The whole target plus the tracks taken from the source; commit() trims
+    // whatever is not used
+    qint64 bytes = QFileInfo(mergeOutput.targetFile).size();
+    
+    const AVFormatContext *source = m_inputs.first();
+    QList<QPair<QString, int>> tracks = mergeOutput.selectedAudioTracks;
+    tracks += mergeOutput.selectedSubtitleTracks;
+    for (const auto &track : tracks) {
+        if (track.first == "source" && track.second >= 0 && track.second < static_cast<int>(source->nb_streams)) {
+            bytes += streamSize(source, source->streams[track.second]);
+        }
+    }
+    return bytes;
+}
+
+bool Remuxer::addStream(int output, int input, int streamIndex)
+{
+    const AVFormatContext *inputContext = m_inputs[input];
+    if (streamIndex < 0 || streamIndex >= static_cast<int>(inputContext->nb_streams)) {
+        return fail(QString("No stream %1 in %2").arg(streamIndex).arg(QString::fromUtf8(inputContext->url)));
+    }
+    
+    const AVStream *inputStream = inputContext->streams[streamIndex];
+    AVStream *outputStream = avformat_new_stream(m_outputs[output], nullptr);
+    if (!outputStream || avcodec_parameters_copy(outputStream->codecpar, inputStream->codecpar) < 0) {
+        return fail("Cannot create an output stream");
+    }
+    
+    // Tags are container specific; the muxer picks its own
+    outputStream->codecpar->codec_tag = 0;
+    outputStream->time_base = inputStream->time_base;
+    outputStream->disposition = inputStream->disposition;
+    av_dict_copy(&outputStream->metadata, inputStream->metadata, 0);
+    
+    m_routes[input][streamIndex].append(qMakePair(output, outputStream->index));
+    return true;
+}
+
+void Remuxer::copyChapters(AVFormatContext *outputContext, qint64 sourceOffsetMs) const
+{
+    const AVFormatContext *source = m_inputs.first();
+    if (source->nb_chapters == 0) {
+        return;
+    }
+    
+    // avformat_free_context() releases these along with the context
+    outputContext->chapters = static_cast<AVChapter **>(av_calloc(source->nb_chapters, sizeof(AVChapter *)));
+    if (!outputContext->chapters) {
+        return;
+    }
+    
+    const qint64 startTime = source->start_time != AV_NOPTS_VALUE ? source->start_time : 0;
+    for (unsigned int i = 0; i < source->nb_chapters; ++i) {
+        const AVChapter *chapter = source->chapters[i];
+        const int64_t shift = av_rescale_q(sourceOffsetMs * 1000 - startTime, AV_TIME_BASE_Q, chapter->time_base);
+        
+        // Chapters moved before the start go with the source packets there
+        if (chapter->end + shift <= 0) {
+            continue;
+        }
+        
+        AVChapter *copy = static_cast<AVChapter *>(av_mallocz(sizeof(AVChapter)));
+        if (!copy) {
+            return;
+        }
+        copy->id = chapter->id;
+        copy->time_base = chapter->time_base;
+        copy->start = qMax<int64_t>(0, chapter->start + shift);
+        copy->end = chapter->end + shift;
+        av_dict_copy(&copy->metadata, chapter->metadata, 0);
+        outputContext->chapters[outputContext->nb_chapters++] = copy;
+    }
+}
+
+bool Remuxer::copyPackets(qint64 sourceOffsetMs)
+{
+    // Timestamp shift per input in AV_TIME_BASE units: every input starts at
+    // zero, as with ffmpeg, and the source then moves by the offset
+    QVector<qint64> shifts;
+    for (const AVFormatContext *input : m_inputs) {
+        shifts.append(input->start_time != AV_NOPTS_VALUE ? -input->start_time : 0);
+    }
+    shifts[0] += sourceOffsetMs * 1000;
+    
+    // An advance drops the start of the source; seek there instead of reading
+    // it. On failure everything before is read and dropped.
+    if (sourceOffsetMs < 0) {
+        av_seek_frame(m_inputs.first(), -1, -shifts[0], AVSEEK_FLAG_BACKWARD);
+    }
+    
+    AVPacket *packet = av_packet_alloc();
+    AVPacket *copy = av_packet_alloc();
+    if (!packet || !copy) {
+        av_packet_free(&packet);
+        av_packet_free(&copy);
+        return fail("Out of memory");
+    }
+    
+    QVector<qint64> lastDts(m_inputs.size(), INT64_MIN);
+    QVector<bool> finished(m_inputs.size(), false);
+    bool success = true;
+    
+    while (success) {
+        // Read from the input furthest behind, which keeps the muxers'
+        // interleaving queues short
+        int input = -1;
+        for (int i = 0; i < m_inputs.size(); ++i) {
+            if (!finished[i] && (input < 0 || lastDts[i] < lastDts[input])) {
+                input = i;
+            }
+        }
+        if (input < 0) {
+            break;
+        }
+        
+        const int result = av_read_frame(m_inputs[input], packet);
+        if (result < 0) {
+            // A damaged tail ends that input, as it does for ffmpeg
+            if (result != AVERROR_EOF) {
+                qWarning() << "Remuxer: read error in" << m_inputs[input]->url;
+            }
+            finished[input] = true;
+            continue;
+        }
+        
+        // Streams that appear mid-file were not mapped
+        if (packet->stream_index >= m_routes[input].size() || m_routes[input][packet->stream_index].isEmpty()) {
+            av_packet_unref(packet);
+            continue;
+        }
+        
+        const AVStream *stream = m_inputs[input]->streams[packet->stream_index];
+        const int64_t shift = av_rescale_q(shifts[input], AV_TIME_BASE_Q, stream->time_base);
+        if (packet->pts != AV_NOPTS_VALUE) {
+            packet->pts += shift;
+        }
+        if (packet->dts != AV_NOPTS_VALUE) {
+            packet->dts += shift;
+            lastDts[input] = av_rescale_q(packet->dts, stream->time_base, AV_TIME_BASE_Q);
+        }
+        
+        const int64_t time = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        if (input == 0 && sourceOffsetMs < 0 && time != AV_NOPTS_VALUE && time < 0) {
+            av_packet_unref(packet);
+            continue;
+        }
+        
+        for (const QPair<int, int> &route : m_routes[input][packet->stream_index]) {
+            AVFormatContext *outputContext = m_outputs[route.first];
+            if (av_packet_ref(copy, packet) < 0) {
+                success = fail("Out of memory");
+                break;
+            }
+            copy->stream_index = route.second;
+            copy->pos = -1;
+            av_packet_rescale_ts(copy, stream->time_base, outputContext->streams[route.second]->time_base);
+            
+            // Takes the reference, whether it succeeds or not
+            if (av_interleaved_write_frame(outputContext, copy) < 0) {
+                success = fail(QString("Cannot write %1").arg(QString::fromUtf8(outputContext->url)));
+                break;
+            }
+        }
+        av_packet_unref(packet);
+    }
+    
+    av_packet_free(&packet);
+    av_packet_free(&copy);
+    
+    if (!success) {
+        return false;
+    }
+    for (AVFormatContext *outputContext : m_outputs) {
+        if (av_write_trailer(outputContext) < 0) {
+            return fail(QString("Cannot finish %1").arg(QString::fromUtf8(outputContext->url)));
+        }
+    }
+    return true;
+}
+
+bool Remuxer::close(bool success, const QList<MergeOutput> &outputs)
+{
+    for (AVFormatContext *input : m_inputs) {
+        m_readStats += MediaIO::inputStats(input);
+    }
+    for (AVFormatContext *&input : m_inputs) {
+        MediaIO::closeInput(input);
+    }
+    m_inputs.clear();
+    m_routes.clear();
+    
+    // Outputs are written to .part files; queued writes can still fail
+    // while they are committed, and abandoned ones are removed
+    for (int output = 0; output < m_outputs.size(); ++output) {
+        MediaWriter *writer = m_writers[output];
+        if (writer && success && !writer->commit()) {
+            success = fail(QString("Cannot write %1").arg(outputs[output].outputFile));
+        }
+        avformat_free_context(m_outputs[output]);
+    }
+    qDeleteAll(m_writers);
+    m_outputs.clear();
+    m_writers.clear();
+    
+    return success;
+}
+
+bool Remuxer::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
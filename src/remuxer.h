@@ -0,0 +1,58 @@
+#ifndef REMUXER_H
+#define REMUXER_H
+
+#include "mediaio.h"
+#include "mediawriter.h"
+#include <QString>
+#include <QList>
+#include <QPair>
+
+struct MergeOutput;
+
+// In-process stream copy of a track merge. The source and the targets are
+// read through MediaIO with readahead, outputs are written through
+// MediaWriter, and every source packet is handed to all outputs that take
+// its stream, so a fan-out reads the source once.
+// Produces the same files as the ffmpeg command line merge: target video,
+// selected tracks, global metadata and chapters from the source.
+class Remuxer
+{
+public:
+    Remuxer();
+    
+    // Buffer size and io_uring apply to the outputs as well
+    void setIOOptions(const MediaIO::Options &options) { m_ioOptions = options; }
+    
+    // sourceOffsetMs as in FFmpegHandler::mergeTracks. Outputs appear under
+    // their names only once complete and synced.
+    bool run(const QString &sourceFile, const QList<MergeOutput> &outputs, qint64 sourceOffsetMs);
+    
+    QString errorString() const { return m_errorString; }
+    // Reads of the last run, over all inputs
+    MediaIO::Stats readStats() const { return m_readStats; }
+
+private:
+    // Where packets of one input stream go: (output, output stream) pairs
+    typedef QList<QPair<int, int>> Routes;
+    
+    bool open(const QString &sourceFile, const QList<MergeOutput> &outputs, qint64 sourceOffsetMs);
+    bool openOutput(int output, const MergeOutput &mergeOutput, qint64 sourceOffsetMs);
+    // Preallocation for an output
+    qint64 expectedSize(const MergeOutput &mergeOutput) const;
+    bool addStream(int output, int input, int streamIndex);
+    void copyChapters(AVFormatContext *outputContext, qint64 sourceOffsetMs) const;
+    bool copyPackets(qint64 sourceOffsetMs);
+    // Returns false if an output could not be completed
+    bool close(bool success, const QList<MergeOutput> &outputs);
+    bool fail(const QString &message);
+    
+    MediaIO::Options m_ioOptions;
+    QList<AVFormatContext *> m_inputs;   // Source first, then one target per output
+    QList<AVFormatContext *> m_outputs;
+    QList<MediaWriter *> m_writers;      // Per output; null for formats without a file
+    QList<QList<Routes>> m_routes;       // Per input, per stream
+    QString m_errorString;
+    MediaIO::Stats m_readStats;
+};
+
+#endif // REMUXER_H
@@ -0,0 +1,156 @@
+#include "signaturecache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+static const char SIGNATURE_MAGIC[8] = { 'V', 'M', 'S', 'I', 'G', 'T', 'R', 'K' };
+
+// Bump whenever FrameSignature or the way it is computed changes
+static const quint32 SIGNATURE_FORMAT_VERSION = 1;
+
+static const qint64 IDENTITY_CHUNK_SIZE = 1024 * 1024;
+
+SignatureCache::SignatureCache()
+    : m_directory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/signatures")
+{
+}
+
+SignatureCache::SignatureCache(const QString &directory)
+    : m_directory(directory)
+{
+}
+
+QByteArray SignatureCache::fileIdentity(const QString &videoPath)
+{
+    QFile file(videoPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(file.read(IDENTITY_CHUNK_SIZE));
+    
+    if (file.size() > IDENTITY_CHUNK_SIZE) {
+        file.seek(qMax(IDENTITY_CHUNK_SIZE, file.size() - IDENTITY_CHUNK_SIZE));
+        hash.addData(file.read(IDENTITY_CHUNK_SIZE));
+    }
+    
+    return hash.result();
+}
+
+quint32 SignatureCache::optionFlags(const VideoFingerprinter::Options &options)
+{
+    return (options.keyframesOnly ? 0x1 : 0) | (options.skipNonReference ? 0x2 : 0);
+}
+
+QString SignatureCache::cacheFilePath(const QByteArray &identity, const VideoFingerprinter::Options &options) const
+{
+    QByteArray key = identity;
+    key += QByteArray::number(options.sampleRate, 'g', 10);
+    key += QByteArray::number(optionFlags(options));
+    
+    QString name = QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex());
+    return m_directory + "/" + name + ".vmsig";
+}
+
+bool SignatureCache::load(const QString &videoPath, const VideoFingerprinter::Options &options,
+                          SignatureTrack &track) const
+{
+    QFileInfo videoInfo(videoPath);
+    QByteArray identity = fileIdentity(videoPath);
+    if (identity.isEmpty()) {
+        return false;
+    }
+    
+    auto file = std::make_shared<QFile>(cacheFilePath(identity, options));
+    if (!file->exists() || !file->open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    
+    qint64 fileSize = file->size();
+    if (fileSize < static_cast<qint64>(sizeof(FileHeader))) {
+        return false;
+    }
+    
+    // Map once and point the track straight at the signature array; the
+    // mapping stays valid for as long as the track (and thus the QFile) lives
+    const uchar *data = file->map(0, fileSize);
+    if (!data) {
+        return false;
+    }
+    
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(FileHeader));
+    
+    bool valid = std::memcmp(header.magic, SIGNATURE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == SIGNATURE_FORMAT_VERSION &&
+                 header.signatureSize == sizeof(FrameSignature) &&
+                 header.fileSize == static_cast<quint64>(videoInfo.size()) &&
+                 header.modifiedMs == videoInfo.lastModified().toMSecsSinceEpoch() &&
+                 std::memcmp(header.identity, identity.constData(), qMin(static_cast<int>(identity.size()), static_cast<int>(sizeof(header.identity)))) == 0 &&
+                 qFuzzyCompare(header.sampleRate, options.sampleRate) &&
+                 header.optionFlags == optionFlags(options) &&
+                 header.signatureCount <= static_cast<quint64>((fileSize - sizeof(FileHeader)) / sizeof(FrameSignature));
+    
+    if (!valid) {
+        qDebug() << "Ignoring stale signature cache" << file->fileName();
+        return false;
+    }
+    
+    const FrameSignature *signatures = reinterpret_cast<const FrameSignature *>(data + sizeof(FileHeader));
+    track = SignatureTrack(file, signatures, static_cast<int>(header.signatureCount),
+                           header.sampleRate, header.durationMs);
+    
+    qDebug() << "Loaded" << track.size() << "cached signatures for" << videoPath;
+    return true;
+}
+
+bool SignatureCache::store(const QString &videoPath, const VideoFingerprinter::Options &options,
+                           const SignatureTrack &track) const
+{
+    QFileInfo videoInfo(videoPath);
+    QByteArray identity = fileIdentity(videoPath);
+    if (identity.isEmpty() || track.isEmpty()) {
+        return false;
+    }
+    
+    if (!QDir().mkpath(m_directory)) {
+        qWarning() << "Cannot create signature cache directory" << m_directory;
+        return false;
+    }
+    
+    FileHeader header;
+    std::memset(&header, 0, sizeof(FileHeader));
+    std::memcpy(header.magic, SIGNATURE_MAGIC, sizeof(header.magic));
+    header.version = SIGNATURE_FORMAT_VERSION;
+    header.signatureSize = sizeof(FrameSignature);
+    header.fileSize = static_cast<quint64>(videoInfo.size());
+    header.modifiedMs = videoInfo.lastModified().toMSecsSinceEpoch();
+    std::memcpy(header.identity, identity.constData(), qMin(static_cast<int>(identity.size()), static_cast<int>(sizeof(header.identity))));
+    header.sampleRate = options.sampleRate;
+    header.optionFlags = optionFlags(options);
+    header.durationMs = track.durationMs();
+    header.signatureCount = static_cast<quint64>(track.size());
+    
+    // QSaveFile only replaces the old file once everything has been written
+    QSaveFile file(cacheFilePath(identity, options));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    
+    file.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+    file.write(reinterpret_cast<const char *>(track.constData()),
+               static_cast<qint64>(track.size()) * sizeof(FrameSignature));
+    
+    if (!file.commit()) {
+        qWarning() << "Failed to write signature cache for" << videoPath;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef SIGNATURECACHE_H
+#define SIGNATURECACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include "videofingerprint.h"
+
+// On-disk store for signature tracks. Each track is one file: a fixed header
+// followed by the raw FrameSignature array, so loading is a single mmap.
+// Files are keyed by the identity of the video (size, mtime and a hash of
+// its first and last megabyte) plus the fingerprint options.
+class SignatureCache
+{
+public:
+    // Uses <cache location>/signatures
+    SignatureCache();
+    explicit SignatureCache(const QString &directory);
+    
+    QString directory() const { return m_directory; }
+    
+    bool load(const QString &videoPath, const VideoFingerprinter::Options &options, SignatureTrack &track) const;
+    bool store(const QString &videoPath, const VideoFingerprinter::Options &options, const SignatureTrack &track) const;
+    
+    // Cheap content identity: reads at most 2 MB regardless of file size
+    static QByteArray fileIdentity(const QString &videoPath);
+
+private:
+    struct FileHeader {
+        char magic[8];
+        quint32 version;
+        quint32 signatureSize;
+        quint64 fileSize;
+        qint64 modifiedMs;
+        char identity[24];      // SHA-1 of the first/last MB, zero padded
+        double sampleRate;
+        quint32 optionFlags;
+        quint32 reserved;
+        qint64 durationMs;
+        quint64 signatureCount;
+    };
+    
+    QString cacheFilePath(const QByteArray &identity, const VideoFingerprinter::Options &options) const;
+    static quint32 optionFlags(const VideoFingerprinter::Options &options);
+    
+    QString m_directory;
+};
+
+#endif // SIGNATURECACHE_H
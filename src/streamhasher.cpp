@@ -0,0 +1,288 @@
+#include "streamhasher.h"
+#include "mediaio.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QtEndian>
+#include <cstring>
+
+static const quint64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const quint64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const quint64 PRIME64_3 = 0x165667B19E3779F9ULL;
+static const quint64 PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const quint64 PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+// Packets between two progress reports of a lockstep comparison
+static const int PROGRESS_INTERVAL_PACKETS = 256;
+
+static inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 round64(quint64 accumulator, quint64 input)
+{
+    accumulator += input * PRIME64_2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * PRIME64_1;
+}
+
+static inline quint64 mergeRound64(quint64 hash, quint64 accumulator)
+{
+    hash ^= round64(0, accumulator);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+XXHash64::XXHash64(quint64 seed)
+{
+    reset(seed);
+}
+
+void XXHash64::reset(quint64 seed)
+{
+    m_seed = seed;
+    m_accumulators[0] = seed + PRIME64_1 + PRIME64_2;
+    m_accumulators[1] = seed + PRIME64_2;
+    m_accumulators[2] = seed;
+    m_accumulators[3] = seed - PRIME64_1;
+    m_totalLength = 0;
+    m_bufferSize = 0;
+}
+
+void XXHash64::update(const void *data, size_t length)
+{
+    const unsigned char *input = static_cast<const unsigned char *>(data);
+    m_totalLength += length;
+    
+    // Top up a partial stripe left over from the previous call
+    if (m_bufferSize > 0) {
+        size_t fill = qMin(length, sizeof(m_buffer) - m_bufferSize);
+        std::memcpy(m_buffer + m_bufferSize, input, fill);
+        m_bufferSize += fill;
+        input += fill;
+        length -= fill;
+        
+        if (m_bufferSize < sizeof(m_buffer)) {
+            return;
+        }
+        for (int lane = 0; lane < 4; ++lane) {
+            m_accumulators[lane] = round64(m_accumulators[lane], qFromLittleEndian<quint64>(m_buffer + lane * 8));
+        }
+        m_bufferSize = 0;
+    }
+    
+    // Whole 32 byte stripes straight from the input
+    while (length >= 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            m_accumulators[lane] = round64(m_accumulators[lane], qFromLittleEndian<quint64>(input + lane * 8));
+        }
+        input += 32;
+        length -= 32;
+    }
+    
+    if (length > 0) {
+        std::memcpy(m_buffer, input, length);
+        m_bufferSize = length;
+    }
+}
+
+quint64 XXHash64::digest() const
+{
+    quint64 hash;
+    if (m_totalLength >= 32) {
+        hash = rotateLeft(m_accumulators[0], 1) + rotateLeft(m_accumulators[1], 7) +
+               rotateLeft(m_accumulators[2], 12) + rotateLeft(m_accumulators[3], 18);
+        for (int lane = 0; lane < 4; ++lane) {
+            hash = mergeRound64(hash, m_accumulators[lane]);
+        }
+    } else {
+        hash = m_seed + PRIME64_5;
+    }
+    hash += m_totalLength;
+    
+    const unsigned char *tail = m_buffer;
+    size_t remaining = m_bufferSize;
+    while (remaining >= 8) {
+        hash ^= round64(0, qFromLittleEndian<quint64>(tail));
+        hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+        tail += 8;
+        remaining -= 8;
+    }
+    if (remaining >= 4) {
+        hash ^= static_cast<quint64>(qFromLittleEndian<quint32>(tail)) * PRIME64_1;
+        hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+        tail += 4;
+        remaining -= 4;
+    }
+    while (remaining > 0) {
+        hash ^= (*tail) * PRIME64_5;
+        hash = rotateLeft(hash, 11) * PRIME64_1;
+        tail++;
+        remaining--;
+    }
+    
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+quint64 XXHash64::hash(const void *data, size_t length, quint64 seed)
+{
+    XXHash64 state(seed);
+    state.update(data, length);
+    return state.digest();
+}
+
+StreamHasher::StreamHasher()
+    : m_formatContext(nullptr)
+    , m_packet(nullptr)
+    , m_streamIndex(-1)
+    , m_fileSize(0)
+    , m_packetCount(0)
+    , m_byteCount(0)
+{
+}
+
+StreamHasher::~StreamHasher()
+{
+    close();
+}
+
+bool StreamHasher::open(const QString &filePath)
+{
+    close();
+    
+    m_formatContext = MediaIO::openInput(filePath, MediaIO::scanOptions());
+    if (!m_formatContext) {
+        return false;
+    }
+    
+    m_streamIndex = av_find_best_stream(m_formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (m_streamIndex < 0) {
+        close();
+        return false;
+    }
+    
+    // The demuxer can skip everything but the video payload
+    for (unsigned int i = 0; i < m_formatContext->nb_streams; i++) {
+        if (static_cast<int>(i) != m_streamIndex) {
+            m_formatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    
+    m_packet = av_packet_alloc();
+    m_fileSize = QFileInfo(filePath).size();
+    m_streamHash.reset();
+    m_packetCount = 0;
+    m_byteCount = 0;
+    return true;
+}
+
+void StreamHasher::close()
+{
+    av_packet_free(&m_packet);
+    MediaIO::closeInput(m_formatContext);
+    m_streamIndex = -1;
+}
+
+QString StreamHasher::streamDescription() const
+{
+    if (!m_formatContext || m_streamIndex < 0) {
+        return QString();
+    }
+    
+    const AVCodecParameters *parameters = m_formatContext->streams[m_streamIndex]->codecpar;
+    return QString("%1 %2x%3")
+        .arg(QString::fromLatin1(avcodec_get_name(parameters->codec_id)))
+        .arg(parameters->width)
+        .arg(parameters->height);
+}
+
+bool StreamHasher::nextPacket(quint64 &packetHash, int &packetSize)
+{
+    if (!m_formatContext || !m_packet) {
+        return false;
+    }
+    
+    while (av_read_frame(m_formatContext, m_packet) >= 0) {
+        if (m_packet->stream_index != m_streamIndex) {
+            av_packet_unref(m_packet);
+            continue;
+        }
+        
+        // Only the payload counts; timestamps and side data are container business
+        packetHash = XXHash64::hash(m_packet->data, static_cast<size_t>(m_packet->size));
+        packetSize = m_packet->size;
+        m_streamHash.update(m_packet->data, static_cast<size_t>(m_packet->size));
+        m_packetCount++;
+        m_byteCount += m_packet->size;
+        
+        av_packet_unref(m_packet);
+        return true;
+    }
+    
+    return false;
+}
+
+int StreamHasher::progress() const
+{
+    if (!m_formatContext || !m_formatContext->pb || m_fileSize <= 0) {
+        return 0;
+    }
+    return static_cast<int>(qBound<qint64>(0, avio_tell(m_formatContext->pb) * 100 / m_fileSize, 100));
+}
+
+bool StreamHasher::streamsIdentical(const QString &filePathA, const QString &filePathB,
+                                    qint64 &packetCount, qint64 &byteCount,
+                                    const std::atomic<bool> *cancelFlag,
+                                    const std::function<void(int)> &progress)
+{
+    packetCount = 0;
+    byteCount = 0;
+    
+    StreamHasher hasherA;
+    StreamHasher hasherB;
+    if (!hasherA.open(filePathA) || !hasherB.open(filePathB)) {
+        return false;
+    }
+    
+    // Different codecs or picture sizes cannot share a bitstream
+    if (hasherA.streamDescription() != hasherB.streamDescription()) {
+        return false;
+    }
+    
+    while (!(cancelFlag && cancelFlag->load())) {
+        quint64 hashA = 0;
+        quint64 hashB = 0;
+        int sizeA = 0;
+        int sizeB = 0;
+        bool hasA = hasherA.nextPacket(hashA, sizeA);
+        bool hasB = hasherB.nextPacket(hashB, sizeB);
+        
+        if (hasA != hasB) {
+            qDebug() << "Video streams differ in length after" << hasherA.packetCount() << "packets";
+            return false;
+        }
+        
+        if (!hasA) {
+            // Both ended together; the running hashes are only a final cross-check
+            packetCount = hasherA.packetCount();
+            byteCount = hasherA.byteCount();
+            return packetCount > 0 && hasherA.streamHash() == hasherB.streamHash();
+        }
+        
+        if (sizeA != sizeB || hashA != hashB) {
+            qDebug() << "Video streams differ at packet" << hasherA.packetCount();
+            return false;
+        }
+        
+        if (progress && hasherA.packetCount() % PROGRESS_INTERVAL_PACKETS == 0) {
+            progress(hasherA.progress());
+        }
+    }
+    
+    return false;
+}
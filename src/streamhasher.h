@@ -0,0 +1,81 @@
+#ifndef STREAMHASHER_H
+#define STREAMHASHER_H
+
+#include <QString>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// Streaming XXH64. Not cryptographic, but fast enough to hash packets at
+// disk speed, and its output is identical to the reference implementation.
+class XXHash64
+{
+public:
+    explicit XXHash64(quint64 seed = 0);
+    
+    void reset(quint64 seed = 0);
+    void update(const void *data, size_t length);
+    quint64 digest() const;
+    
+    static quint64 hash(const void *data, size_t length, quint64 seed = 0);
+
+private:
+    quint64 m_accumulators[4];
+    quint64 m_seed;
+    quint64 m_totalLength;
+    unsigned char m_buffer[32];
+    size_t m_bufferSize;
+};
+
+// Reads the packets of a file's main video stream without decoding them.
+// Two remuxes of the same encode carry the same packet payloads even when
+// their containers differ, so comparing packet hashes finds them without
+// decoding a single frame.
+class StreamHasher
+{
+public:
+    StreamHasher();
+    ~StreamHasher();
+    
+    StreamHasher(const StreamHasher &) = delete;
+    StreamHasher &operator=(const StreamHasher &) = delete;
+    
+    bool open(const QString &filePath);
+    void close();
+    
+    // Codec and picture size of the video stream, e.g. "h264 1920x1080"
+    QString streamDescription() const;
+    
+    // Hashes the payload of the next video packet; false at the end of the
+    // stream or on a read error
+    bool nextPacket(quint64 &packetHash, int &packetSize);
+    
+    // XXH64 over all payloads read so far
+    quint64 streamHash() const { return m_streamHash.digest(); }
+    qint64 packetCount() const { return m_packetCount; }
+    qint64 byteCount() const { return m_byteCount; }
+    // Fraction of the file read so far, 0..100
+    int progress() const;
+    
+    // Reads both files in lockstep and stops at the first packet that
+    // differs, so different encodes are rejected after a few packets
+    static bool streamsIdentical(const QString &filePathA, const QString &filePathB,
+                                 qint64 &packetCount, qint64 &byteCount,
+                                 const std::atomic<bool> *cancelFlag = nullptr,
+                                 const std::function<void(int)> &progress = std::function<void(int)>());
+
+private:
+    AVFormatContext *m_formatContext;
+    AVPacket *m_packet;
+    int m_streamIndex;
+    qint64 m_fileSize;
+    XXHash64 m_streamHash;
+    qint64 m_packetCount;
+    qint64 m_byteCount;
+};
+
+#endif // STREAMHASHER_H
@@ -0,0 +1,457 @@
+#include "timealignment.h"
+#include "crosscorrelation.h"
+#include <QDebug>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Linear warps tried by the fit: B = scale * A. PAL sources run 24 or
+// 23.976 fps film at 25 fps, NTSC pulldown slows 24 fps down to 23.976.
+static const double CANDIDATE_SCALES[] = {
+    1.0,
+    24.0 / 25.0,
+    25.0 / 24.0,
+    (24000.0 / 1001.0) / 25.0,
+    25.0 / (24000.0 / 1001.0),
+    1000.0 / 1001.0,
+    1001.0 / 1000.0
+};
+
+// A scale other than 1.0 has to correlate this much better to be taken
+static const double SCALE_SWITCH_MARGIN = 1.05;
+
+static const int MIN_SERIES_LENGTH = 20;
+
+// The warp runs on a coarser grid than the signatures to bound rows * band
+static const double WARP_MIN_STEP_MS = 250.0;
+// Extra cost of holding one video while the other advances, so that the
+// path does not wander through static shots
+static const double WARP_SKIP_PENALTY = 0.05;
+// Deviations are median filtered over this many rows on each side
+static const int WARP_MEDIAN_RADIUS = 4;
+// Shorter stretches at one deviation are transitions, not segments
+static const qint64 WARP_MIN_SEGMENT_MS = 3000;
+
+enum WarpStep : quint8 {
+    StepNone,
+    StepStart,
+    StepDiagonal,
+    StepUp,   // A advances, B holds: material missing from B
+    StepLeft  // B advances, A holds: material missing from A
+};
+
+TimeMap::TimeMap()
+    : m_valid(false)
+    , m_scale(1.0)
+    , m_interceptMs(0.0)
+{
+}
+
+TimeMap::TimeMap(double scale, double interceptMs, const QVector<Anchor> &anchors)
+    : m_valid(scale > 0.0)
+    , m_scale(scale)
+    , m_interceptMs(interceptMs)
+    , m_anchors(anchors)
+{
+}
+
+TimeMap TimeMap::constantOffset(qint64 offsetMs)
+{
+    return TimeMap(1.0, static_cast<double>(-offsetMs));
+}
+
+bool TimeMap::hasDrift() const
+{
+    return m_valid && (isPiecewise() || std::abs(m_scale - 1.0) > 1e-6);
+}
+
+qint64 TimeMap::mapToB(qint64 positionA) const
+{
+    if (!m_valid) {
+        return positionA;
+    }
+    if (m_anchors.isEmpty()) {
+        return qRound64(m_scale * positionA + m_interceptMs);
+    }
+    
+    auto next = std::upper_bound(m_anchors.constBegin(), m_anchors.constEnd(), positionA,
+                                 [](qint64 value, const Anchor &anchor) { return value < anchor.positionA; });
+    if (next == m_anchors.constBegin()) {
+        return next->positionB + qRound64(m_scale * (positionA - next->positionA));
+    }
+    
+    const Anchor &previous = *(next - 1);
+    if (next == m_anchors.constEnd()) {
+        return previous.positionB + qRound64(m_scale * (positionA - previous.positionA));
+    }
+    
+    double fraction = static_cast<double>(positionA - previous.positionA) / (next->positionA - previous.positionA);
+    return previous.positionB + qRound64(fraction * (next->positionB - previous.positionB));
+}
+
+qint64 TimeMap::mapToA(qint64 positionB) const
+{
+    if (!m_valid) {
+        return positionB;
+    }
+    if (m_anchors.isEmpty()) {
+        return qRound64((positionB - m_interceptMs) / m_scale);
+    }
+    
+    auto next = std::upper_bound(m_anchors.constBegin(), m_anchors.constEnd(), positionB,
+                                 [](qint64 value, const Anchor &anchor) { return value < anchor.positionB; });
+    if (next == m_anchors.constBegin()) {
+        return next->positionA + qRound64((positionB - next->positionB) / m_scale);
+    }
+    
+    const Anchor &previous = *(next - 1);
+    if (next == m_anchors.constEnd()) {
+        return previous.positionA + qRound64((positionB - previous.positionB) / m_scale);
+    }
+    
+    double fraction = static_cast<double>(positionB - previous.positionB) / (next->positionB - previous.positionB);
+    return previous.positionA + qRound64(fraction * (next->positionA - previous.positionA));
+}
+
+double TimeMap::rateAt(qint64 positionA) const
+{
+    if (!m_valid) {
+        return 1.0;
+    }
+    
+    auto next = std::upper_bound(m_anchors.constBegin(), m_anchors.constEnd(), positionA,
+                                 [](qint64 value, const Anchor &anchor) { return value < anchor.positionA; });
+    if (next == m_anchors.constBegin() || next == m_anchors.constEnd()) {
+        return m_scale;
+    }
+    
+    const Anchor &previous = *(next - 1);
+    return static_cast<double>(next->positionB - previous.positionB) / (next->positionA - previous.positionA);
+}
+
+TimeAligner::TimeAligner()
+    : m_maxOffsetMs(5 * 60 * 1000)
+    , m_bandWidthMs(30 * 1000)
+    , m_cancelFlag(nullptr)
+{
+}
+
+void TimeAligner::correlationSeries(const SignatureTrack &track, double intervalMs,
+                                    QVector<double> &lumaSeries, QVector<double> &hashSeries)
+{
+    lumaSeries.clear();
+    hashSeries.clear();
+    if (track.isEmpty() || track.at(track.size() - 1).ptsMs < 0 || intervalMs <= 0.0) {
+        return;
+    }
+    
+    // Put the signatures on a uniform grid; grid slots without a signature of
+    // their own (skipped frames, gaps) repeat the previous one
+    int length = static_cast<int>(track.at(track.size() - 1).ptsMs / intervalMs) + 1;
+    QVector<int> gridIndex(length, -1);
+    for (int i = 0; i < track.size(); ++i) {
+        if (track.at(i).ptsMs >= 0) {
+            gridIndex[static_cast<int>(track.at(i).ptsMs / intervalMs)] = i;
+        }
+    }
+    for (int i = 1; i < length; ++i) {
+        if (gridIndex[i] < 0) {
+            gridIndex[i] = gridIndex[i - 1];
+        }
+    }
+    
+    // Frame-to-frame changes rather than absolute values, so that brightness
+    // or colour grading differences between encodes do not matter
+    lumaSeries.resize(length);
+    hashSeries.resize(length);
+    lumaSeries[0] = 0.0;
+    hashSeries[0] = 0.0;
+    for (int i = 1; i < length; ++i) {
+        if (gridIndex[i] < 0 || gridIndex[i - 1] < 0) {
+            lumaSeries[i] = 0.0;
+            hashSeries[i] = 0.0;
+            continue;
+        }
+        
+        const FrameSignature &previous = track.at(gridIndex[i - 1]);
+        const FrameSignature &current = track.at(gridIndex[i]);
+        lumaSeries[i] = current.lumaMean - previous.lumaMean;
+        hashSeries[i] = VideoFingerprinter::hammingDistance(previous.perceptualHash, current.perceptualHash);
+    }
+    
+    CrossCorrelation::normalize(lumaSeries);
+    CrossCorrelation::normalize(hashSeries);
+}
+
+TimeAligner::Result TimeAligner::align(const SignatureTrack &trackA, const SignatureTrack &trackB) const
+{
+    Result result;
+    result.valid = false;
+    result.confidence = 0.0;
+    
+    if (trackA.isEmpty() || trackB.isEmpty()) {
+        return result;
+    }
+    
+    double scale = 1.0;
+    double interceptMs = 0.0;
+    double linearConfidence = 0.0;
+    if (!fitLinear(trackA, trackB, scale, interceptMs, linearConfidence)) {
+        return result;
+    }
+    
+    QVector<TimeMap::Anchor> anchors;
+    double pathSimilarity = 0.0;
+    if (warp(trackA, trackB, scale, interceptMs, anchors, pathSimilarity)) {
+        result.map = TimeMap(scale, interceptMs, anchors);
+        result.confidence = linearConfidence * 0.5 + pathSimilarity * 0.5;
+    } else {
+        result.map = TimeMap(scale, interceptMs);
+        result.confidence = linearConfidence;
+    }
+    result.valid = !isCancelled();
+    
+    qDebug() << "Time alignment: scale" << scale << "intercept" << interceptMs << "ms,"
+             << anchors.size() << "anchors, confidence" << result.confidence;
+    return result;
+}
+
+bool TimeAligner::fitLinear(const SignatureTrack &trackA, const SignatureTrack &trackB,
+                            double &scale, double &interceptMs, double &confidence) const
+{
+    const double intervalMs = 1000.0 / qMax(0.1, trackA.sampleRate());
+    
+    QVector<double> lumaA, hashA;
+    correlationSeries(trackA, intervalMs, lumaA, hashA);
+    if (lumaA.size() < MIN_SERIES_LENGTH) {
+        return false;
+    }
+    
+    double bestScore = -std::numeric_limits<double>::infinity();
+    for (double candidate : CANDIDATE_SCALES) {
+        if (isCancelled()) {
+            return false;
+        }
+        
+        // Sampling B on a grid stretched by the candidate scale undoes the
+        // speed change, after which only a constant lag remains
+        QVector<double> lumaB, hashB;
+        correlationSeries(trackB, intervalMs * candidate, lumaB, hashB);
+        if (lumaB.size() < MIN_SERIES_LENGTH) {
+            continue;
+        }
+        
+        int maxLag = static_cast<int>(qMin<qint64>(static_cast<qint64>(m_maxOffsetMs / intervalMs),
+                                                   lumaA.size() + lumaB.size()));
+        int minOverlap = qMax(MIN_SERIES_LENGTH, static_cast<int>(qMin(lumaA.size(), lumaB.size()) / 4));
+        
+        QVector<double> correlation = CrossCorrelation::correlate(lumaA, lumaB, maxLag, minOverlap);
+        QVector<double> hashCorrelation = CrossCorrelation::correlate(hashA, hashB, maxLag, minOverlap);
+        for (int i = 0; i < correlation.size(); ++i) {
+            correlation[i] = (correlation[i] + hashCorrelation[i]) / 2.0;
+        }
+        
+        int exclusionRadius = qMax(2, static_cast<int>(1000.0 / intervalMs));
+        CrossCorrelation::Peak peak = CrossCorrelation::findPeak(correlation, maxLag, exclusionRadius);
+        if (!peak.valid || peak.value <= 0.0) {
+            continue;
+        }
+        
+        double score = (candidate == 1.0) ? peak.value : peak.value / SCALE_SWITCH_MARGIN;
+        qDebug() << "  Scale" << candidate << "correlation" << peak.value << "at lag" << peak.lag;
+        if (score > bestScore) {
+            bestScore = score;
+            
+            // b[k + lag] matches a[k]: B time (k + lag) * interval * scale, A time k * interval
+            scale = candidate;
+            interceptMs = peak.lag * intervalMs * candidate;
+            double separation = qBound(0.0, (peak.value - qMax(0.0, peak.secondValue)) / peak.value, 1.0);
+            confidence = qMin(1.0, peak.value) * 0.5 + separation * 0.5;
+        }
+    }
+    
+    return std::isfinite(bestScore);
+}
+
+bool TimeAligner::warp(const SignatureTrack &trackA, const SignatureTrack &trackB, double scale, double interceptMs,
+                       QVector<TimeMap::Anchor> &anchors, double &pathSimilarity) const
+{
+    anchors.clear();
+    pathSimilarity = 0.0;
+    
+    const double stepMs = qMax(WARP_MIN_STEP_MS, 1000.0 / qMax(0.1, trackA.sampleRate()));
+    const qint64 endA = trackA.at(trackA.size() - 1).ptsMs;
+    const qint64 endB = trackB.at(trackB.size() - 1).ptsMs;
+    
+    // Rows cover the part of A that the linear warp puts inside B
+    const double startRowMs = qMax(0.0, -interceptMs / scale);
+    const double stopRowMs = qMin(static_cast<double>(endA), (endB - interceptMs) / scale);
+    if (stopRowMs - startRowMs < MIN_SERIES_LENGTH * stepMs) {
+        return false;
+    }
+    
+    const int rows = static_cast<int>((stopRowMs - startRowMs) / stepMs) + 1;
+    const int columns = static_cast<int>(endB / stepMs) + 1;
+    const int radius = qMax(1, static_cast<int>(m_bandWidthMs / stepMs));
+    const int width = 2 * radius + 1;
+    
+    auto rowPosition = [&](int row) { return startRowMs + row * stepMs; };
+    auto linearB = [&](int row) { return scale * rowPosition(row) + interceptMs; };
+    auto bandStart = [&](int row) { return qRound(linearB(row) / stepMs) - radius; };
+    
+    QVector<int> columnSignature(columns);
+    for (int column = 0; column < columns; ++column) {
+        columnSignature[column] = trackB.indexAt(qRound64(column * stepMs));
+    }
+    
+    // Only two rows of accumulated cost are kept; the path is recovered from
+    // one byte per cell, so memory is rows * band rather than rows * columns
+    const double infinity = std::numeric_limits<double>::infinity();
+    std::vector<double> previous(width, infinity);
+    std::vector<double> current(width, infinity);
+    std::vector<quint8> steps(static_cast<size_t>(rows) * width, StepNone);
+    
+    for (int row = 0; row < rows; ++row) {
+        if ((row & 0xFF) == 0 && isCancelled()) {
+            return false;
+        }
+        
+        const FrameSignature &signatureA = trackA.at(trackA.indexAt(qRound64(rowPosition(row))));
+        const int start = bandStart(row);
+        const int previousStart = (row > 0) ? bandStart(row - 1) : 0;
+        quint8 *rowSteps = steps.data() + static_cast<size_t>(row) * width;
+        
+        for (int cell = 0; cell < width; ++cell) {
+            current[cell] = infinity;
+            int column = start + cell;
+            if (column < 0 || column >= columns) {
+                continue;
+            }
+            
+            double cost = 1.0 - VideoFingerprinter::similarity(signatureA, trackB.at(columnSignature[column]));
+            
+            // The path may start anywhere in the first row
+            if (row == 0) {
+                current[cell] = cost;
+                rowSteps[cell] = StepStart;
+                continue;
+            }
+            
+            double best = infinity;
+            quint8 step = StepNone;
+            int diagonal = column - 1 - previousStart;
+            if (diagonal >= 0 && diagonal < width && previous[diagonal] < best) {
+                best = previous[diagonal];
+                step = StepDiagonal;
+            }
+            int up = column - previousStart;
+            if (up >= 0 && up < width && previous[up] + WARP_SKIP_PENALTY < best) {
+                best = previous[up] + WARP_SKIP_PENALTY;
+                step = StepUp;
+            }
+            if (cell > 0 && current[cell - 1] + WARP_SKIP_PENALTY < best) {
+                best = current[cell - 1] + WARP_SKIP_PENALTY;
+                step = StepLeft;
+            }
+            
+            if (step != StepNone) {
+                current[cell] = best + cost;
+                rowSteps[cell] = step;
+            }
+        }
+        
+        std::swap(previous, current);
+    }
+    
+    // ...and may end anywhere in the last one
+    int cell = static_cast<int>(std::min_element(previous.begin(), previous.end()) - previous.begin());
+    if (!std::isfinite(previous[cell])) {
+        return false;
+    }
+    
+    // Walk back and keep, for every row, the first column the path visits
+    QVector<int> matchedColumn(rows, -1);
+    double similaritySum = 0.0;
+    int pathLength = 0;
+    int row = rows - 1;
+    while (row >= 0) {
+        int column = bandStart(row) + cell;
+        matchedColumn[row] = column;
+        
+        const FrameSignature &signatureA = trackA.at(trackA.indexAt(qRound64(rowPosition(row))));
+        similaritySum += VideoFingerprinter::similarity(signatureA, trackB.at(columnSignature[column]));
+        pathLength++;
+        
+        quint8 step = steps[static_cast<size_t>(row) * width + cell];
+        if (step == StepLeft) {
+            cell--;
+        } else if (step == StepDiagonal) {
+            row--;
+            cell = column - 1 - bandStart(row);
+        } else if (step == StepUp) {
+            row--;
+            cell = column - bandStart(row);
+        } else {
+            break;
+        }
+    }
+    pathSimilarity = similaritySum / qMax(1, pathLength);
+    
+    // Deviation of the path from the linear warp, median filtered so single
+    // mismatched frames do not split segments
+    QVector<double> deviation(rows);
+    for (int i = 0; i < rows; ++i) {
+        deviation[i] = matchedColumn[i] * stepMs - linearB(i);
+    }
+    QVector<double> smoothed(rows);
+    std::vector<double> window;
+    for (int i = 0; i < rows; ++i) {
+        window.assign(deviation.constBegin() + qMax(0, i - WARP_MEDIAN_RADIUS),
+                      deviation.constBegin() + qMin(rows, i + WARP_MEDIAN_RADIUS + 1));
+        std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+        smoothed[i] = window[window.size() / 2];
+    }
+    
+    // Runs of (nearly) constant deviation become segments with an anchor at
+    // each end; everything between two segments is interpolated
+    const double tolerance = 2.0 * stepMs;
+    const int minSegmentRows = qMax(1, static_cast<int>(WARP_MIN_SEGMENT_MS / stepMs));
+    bool deviates = false;
+    int first = 0;
+    for (int i = 1; i <= rows; ++i) {
+        if (i < rows && std::abs(smoothed[i] - smoothed[first]) <= tolerance) {
+            continue;
+        }
+        
+        if (i - first >= minSegmentRows) {
+            double mean = 0.0;
+            for (int k = first; k < i; ++k) {
+                mean += smoothed[k];
+            }
+            mean /= (i - first);
+            deviates = deviates || std::abs(mean) > tolerance;
+            
+            for (int k : { first, i - 1 }) {
+                TimeMap::Anchor anchor;
+                anchor.positionA = qRound64(rowPosition(k));
+                anchor.positionB = qRound64(linearB(k) + mean);
+                if (!anchors.isEmpty()) {
+                    anchor.positionB = qMax(anchor.positionB, anchors.last().positionB);
+                    if (anchor.positionA <= anchors.last().positionA) {
+                        continue;
+                    }
+                }
+                anchors.append(anchor);
+            }
+        }
+        first = i;
+    }
+    
+    // A path that never leaves the linear warp needs no anchors
+    if (!deviates) {
+        anchors.clear();
+    }
+    return true;
+}
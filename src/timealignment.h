@@ -0,0 +1,85 @@
+#ifndef TIMEALIGNMENT_H
+#define TIMEALIGNMENT_H
+
+#include <QVector>
+#include <atomic>
+#include "videofingerprint.h"
+
+// Maps positions in video A to positions in video B. The base is a linear
+// warp B = scale * A + intercept; anchors, when present, replace it with a
+// piecewise linear map (cuts, inserted scenes) and the linear warp only
+// extrapolates past the first and last anchor.
+class TimeMap
+{
+public:
+    struct Anchor {
+        qint64 positionA;
+        qint64 positionB;
+    };
+    
+    TimeMap();
+    TimeMap(double scale, double interceptMs, const QVector<Anchor> &anchors = QVector<Anchor>());
+    
+    // Same convention as VideoComparator offsets: A(t) == B(t - offsetMs)
+    static TimeMap constantOffset(qint64 offsetMs);
+    
+    bool isValid() const { return m_valid; }
+    bool isPiecewise() const { return !m_anchors.isEmpty(); }
+    // True when the map is more than a constant offset
+    bool hasDrift() const;
+    
+    double scale() const { return m_scale; }
+    double interceptMs() const { return m_interceptMs; }
+    const QVector<Anchor> &anchors() const { return m_anchors; }
+    
+    qint64 mapToB(qint64 positionA) const;
+    qint64 mapToA(qint64 positionB) const;
+    // How fast B advances per millisecond of A around positionA
+    double rateAt(qint64 positionA) const;
+
+private:
+    bool m_valid;
+    double m_scale;
+    double m_interceptMs;
+    QVector<Anchor> m_anchors; // Non-decreasing in both A and B
+};
+
+// Fits a TimeMap between two signature tracks: first the best linear warp
+// out of the common frame-rate conversions, then a banded dynamic time warp
+// around it that turns cuts and inserts into anchors
+class TimeAligner
+{
+public:
+    struct Result {
+        bool valid;
+        TimeMap map;
+        double confidence; // 0..1
+    };
+    
+    TimeAligner();
+    
+    void setMaxOffset(qint64 maxOffsetMs) { m_maxOffsetMs = maxOffsetMs; }
+    // How far the piecewise map may move away from the linear warp
+    void setBandWidth(qint64 bandWidthMs) { m_bandWidthMs = bandWidthMs; }
+    void setCancelFlag(const std::atomic<bool> *cancelFlag) { m_cancelFlag = cancelFlag; }
+    
+    Result align(const SignatureTrack &trackA, const SignatureTrack &trackB) const;
+    
+    // Frame-to-frame luma and hash changes of a track on a uniform grid of
+    // intervalMs (in the track's own time), normalized for correlation
+    static void correlationSeries(const SignatureTrack &track, double intervalMs,
+                                  QVector<double> &lumaSeries, QVector<double> &hashSeries);
+
+private:
+    bool isCancelled() const { return m_cancelFlag && m_cancelFlag->load(); }
+    bool fitLinear(const SignatureTrack &trackA, const SignatureTrack &trackB,
+                   double &scale, double &interceptMs, double &confidence) const;
+    bool warp(const SignatureTrack &trackA, const SignatureTrack &trackB, double scale, double interceptMs,
+              QVector<TimeMap::Anchor> &anchors, double &pathSimilarity) const;
+    
+    qint64 m_maxOffsetMs;
+    qint64 m_bandWidthMs;
+    const std::atomic<bool> *m_cancelFlag;
+};
+
+#endif // TIMEALIGNMENT_H
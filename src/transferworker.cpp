@@ -4,6 +4,7 @@
 
 TransferWorker::TransferWorker(QObject *parent)
     : QObject(parent)
+    , m_sourceOffsetMs(0)
 {
 }
 
@@ -11,13 +12,15 @@ void TransferWorker::setTransferJob(const QString &sourceFile,
                                    const QString &targetFile,
                                    const QString &outputFile,
                                    const QList<QPair<QString, int>> &selectedAudioTracks,
-                                   const QList<QPair<QString, int>> &selectedSubtitleTracks)
+                                   const QList<QPair<QString, int>> &selectedSubtitleTracks,
+                                   qint64 sourceOffsetMs)
 {
     m_sourceFile = sourceFile;
     m_targetFile = targetFile;
     m_outputFile = outputFile;
     m_selectedAudioTracks = selectedAudioTracks;
     m_selectedSubtitleTracks = selectedSubtitleTracks;
+    m_sourceOffsetMs = sourceOffsetMs;
 }
 
 void TransferWorker::startTransfer()
@@ -28,13 +31,43 @@ void TransferWorker::startTransfer()
     try {
         FFmpegHandler handler;
         
-        bool success = handler.mergeTracks(
-            m_sourceFile,
-            m_targetFile,
-            m_outputFile,
-            m_selectedAudioTracks,
-            m_selectedSubtitleTracks
-        );
+        MergeOutput output;
+        output.targetFile = m_targetFile;
+        output.outputFile = m_outputFile;
+        output.selectedAudioTracks = m_selectedAudioTracks;
+        output.selectedSubtitleTracks = m_selectedSubtitleTracks;
+        
+        QList<MergeOutput> outputs;
+        outputs.append(output);
+        
+        for (const QPair<QString, QString> &extraTarget : m_extraTargets) {
+            MergeOutput extra;
+            extra.targetFile = extraTarget.first;
+            extra.outputFile = extraTarget.second;
+            for (const QPair<QString, int> &track : m_selectedAudioTracks) {
+                if (track.first == "source") {
+                    extra.selectedAudioTracks.append(track);
+                }
+            }
+            for (const QPair<QString, int> &track : m_selectedSubtitleTracks) {
+                if (track.first == "source") {
+                    extra.selectedSubtitleTracks.append(track);
+                }
+            }
+            for (const AudioTrackInfo &track : handler.getAudioTracks(extra.targetFile)) {
+                extra.selectedAudioTracks.append(qMakePair(QString("target"), track.index));
+            }
+            for (const SubtitleTrackInfo &track : handler.getSubtitleTracks(extra.targetFile)) {
+                extra.selectedSubtitleTracks.append(qMakePair(QString("target"), track.index));
+            }
+            outputs.append(extra);
+        }
+        
+        if (outputs.size() > 1) {
+            emit logMessage(QString("Writing %1 outputs from one read of the source").arg(outputs.size()));
+        }
+        
+        bool success = handler.mergeTracksFanOut(m_sourceFile, outputs, m_sourceOffsetMs);
         
         if (success) {
             emit logMessage("Track transfer completed successfully!");
@@ -16,7 +16,11 @@ public:
                        const QString &targetFile,
                        const QString &outputFile,
                        const QList<QPair<QString, int>> &selectedAudioTracks,
-                       const QList<QPair<QString, int>> &selectedSubtitleTracks);
+                       const QList<QPair<QString, int>> &selectedSubtitleTracks,
+                       qint64 sourceOffsetMs = 0);
+    // Further (target, output) pairs merged in the same run; each keeps all of
+    // its own audio and subtitle tracks next to the selected source tracks
+    void setExtraTargets(const QList<QPair<QString, QString>> &extraTargets) { m_extraTargets = extraTargets; }
 
 public slots:
     void startTransfer();
@@ -31,6 +35,8 @@ private:
     QString m_outputFile;
     QList<QPair<QString, int>> m_selectedAudioTracks;
     QList<QPair<QString, int>> m_selectedSubtitleTracks;
+    qint64 m_sourceOffsetMs;
+    QList<QPair<QString, QString>> m_extraTargets;
 };
 
 #endif // TRANSFERWORKER_H
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "uringqueue.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <cerrno>
+#endif
+
+UringQueue::UringQueue(int depth)
+    : m_ring(nullptr)
+    , m_depth(qMax(1, depth))
+    , m_pending(0)
+    , m_retired(false)
+{
+#ifdef HAVE_LIBURING
+    io_uring *ring = new io_uring;
+    if (io_uring_queue_init(m_depth, ring, 0) == 0) {
+        m_ring = ring;
+    } else {
+        // Kernels before 5.1, or io_uring disabled by policy
+        delete ring;
+    }
+#endif
+}
+
+UringQueue::~UringQueue()
+{
+#ifdef HAVE_LIBURING
+    if (m_ring) {
+        // The kernel may still write into buffers owned by the caller
+        quint64 tag;
+        int result;
+        while (m_pending > 0 && waitCompletion(&tag, &result)) {
+        }
+        io_uring_queue_exit(m_ring);
+        delete m_ring;
+    }
+#endif
+}
+
+bool UringQueue::isAvailable()
+{
+#ifdef HAVE_LIBURING
+    static const bool available = UringQueue(1).isValid();
+    return available;
+#else
+    return false;
+#endif
+}
+
+bool UringQueue::submitRead(int fd, void *buffer, unsigned int length, qint64 offset, quint64 tag)
+{
+#ifdef HAVE_LIBURING
+    if (!m_ring || m_retired || m_pending >= m_depth) {
+        return false;
+    }
+    
+    io_uring_sqe *entry = io_uring_get_sqe(m_ring);
+    if (!entry) {
+        return false;
+    }
+    io_uring_prep_read(entry, fd, buffer, length, offset);
+    io_uring_sqe_set_data64(entry, tag);
+    return submitPrepared();
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(buffer);
+    Q_UNUSED(length);
+    Q_UNUSED(offset);
+    Q_UNUSED(tag);
+    return false;
+#endif
+}
+
+bool UringQueue::submitWrite(int fd, const void *buffer, unsigned int length, qint64 offset, quint64 tag)
+{
+#ifdef HAVE_LIBURING
+    if (!m_ring || m_retired || m_pending >= m_depth) {
+        return false;
+    }
+    
+    io_uring_sqe *entry = io_uring_get_sqe(m_ring);
+    if (!entry) {
+        return false;
+    }
+    io_uring_prep_write(entry, fd, buffer, length, offset);
+    io_uring_sqe_set_data64(entry, tag);
+    return submitPrepared();
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(buffer);
+    Q_UNUSED(length);
+    Q_UNUSED(offset);
+    Q_UNUSED(tag);
+    return false;
+#endif
+}
+
+bool UringQueue::submitPrepared()
+{
+#ifdef HAVE_LIBURING
+    int submitted = io_uring_submit(m_ring);
+    if (submitted >= 1) {
+        m_pending++;
+        return true;
+    }
+    
+    // The entry stays published in the submission ring, where the next
+    // submit would send it long after the caller fell back to pread/pwrite
+    // on the same buffer. The ring takes nothing new from here on, and this
+    // entry is pushed until the kernel has it, reaping completions to make
+    // room when the completion ring is full.
+    m_retired = true;
+    while (submitted < 1) {
+        if (submitted != -EINTR && submitted != -EAGAIN && submitted != -EBUSY) {
+            // Refused for good; with the ring retired nothing sends it later
+            return false;
+        }
+        if (submitted == -EBUSY) {
+            quint64 tag;
+            int result;
+            if (m_completed.size() >= m_pending || !reapCompletion(&tag, &result)) {
+                return false;
+            }
+            m_completed.append(qMakePair(tag, result));
+        }
+        submitted = io_uring_submit(m_ring);
+    }
+    
+    // In flight like any other request; its completion is waited for as usual
+    m_pending++;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool UringQueue::waitCompletion(quint64 *tag, int *result)
+{
+#ifdef HAVE_LIBURING
+    if (!m_ring || m_pending == 0) {
+        return false;
+    }
+    
+    if (!m_completed.isEmpty()) {
+        const QPair<quint64, int> completed = m_completed.takeFirst();
+        *tag = completed.first;
+        *result = completed.second;
+    } else if (!reapCompletion(tag, result)) {
+        return false;
+    }
+    m_pending--;
+    return true;
+#else
+    Q_UNUSED(tag);
+    Q_UNUSED(result);
+    return false;
+#endif
+}
+
+bool UringQueue::reapCompletion(quint64 *tag, int *result)
+{
+#ifdef HAVE_LIBURING
+    io_uring_cqe *completion = nullptr;
+    int error;
+    do {
+        error = io_uring_wait_cqe(m_ring, &completion);
+    } while (error == -EINTR);
+    if (error < 0) {
+        return false;
+    }
+    
+    *tag = io_uring_cqe_get_data64(completion);
+    *result = completion->res;
+    io_uring_cqe_seen(m_ring, completion);
+    return true;
+#else
+    Q_UNUSED(tag);
+    Q_UNUSED(result);
+    return false;
+#endif
+}
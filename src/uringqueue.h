@@ -0,0 +1,52 @@
+#ifndef URINGQUEUE_H
+#define URINGQUEUE_H
+
+#include <QtGlobal>
+#include <QList>
+#include <QPair>
+
+struct io_uring;
+
+// Positioned reads and writes submitted through one io_uring, for keeping
+// several large requests in flight from a single thread. Built only with
+// liburing (HAVE_LIBURING); otherwise, or when the kernel refuses a ring,
+// isValid() is false and callers use pread/pwrite. A ring whose submit
+// fails takes no further requests, so callers fall back the same way.
+class UringQueue
+{
+public:
+    explicit UringQueue(int depth);
+    ~UringQueue();
+    
+    // Whether a ring can be set up on this build and kernel
+    static bool isAvailable();
+    
+    bool isValid() const { return m_ring != nullptr; }
+    int depth() const { return m_depth; }
+    int pending() const { return m_pending; }
+    
+    // tag comes back from waitCompletion(); buffer must stay valid until then.
+    // False means the request was not, and will never be, sent to the kernel.
+    bool submitRead(int fd, void *buffer, unsigned int length, qint64 offset, quint64 tag);
+    bool submitWrite(int fd, const void *buffer, unsigned int length, qint64 offset, quint64 tag);
+    // Blocks until a request completes; result is bytes transferred or -errno
+    bool waitCompletion(quint64 *tag, int *result);
+
+private:
+    UringQueue(const UringQueue &) = delete;
+    UringQueue &operator=(const UringQueue &) = delete;
+    
+    // Submits the entry just prepared in the ring
+    bool submitPrepared();
+    // Blocks until the kernel posts a completion, bypassing m_completed
+    bool reapCompletion(quint64 *tag, int *result);
+    
+    io_uring *m_ring;
+    int m_depth;
+    int m_pending; // Submitted and not yet returned by waitCompletion()
+    bool m_retired;
+    // Completions reaped while a failed submit was retried
+    QList<QPair<quint64, int>> m_completed;
+};
+
+#endif // URINGQUEUE_H
@@ -1,5 +1,9 @@
 #include "videocomparator.h"
 #include "ffmpeghandler.h"
+#include "framedecoder.h"
+#include "crosscorrelation.h"
+#include "audioaligner.h"
+#include "streamhasher.h"
 #include <QDebug>
 #include <QCryptographicHash>
 #include <QtMath>
@@ -7,53 +11,81 @@
 #include <numeric>
 #include <cmath>
 
+// Frames are decoded straight to this size; every feature works on a downscaled
+// copy anyway, and small frames keep the in-flight memory of parallel workers low
+static const int ANALYSIS_WIDTH = 320;
+static const int ANALYSIS_HEIGHT = 240;
+
+// Offsets are verified on at most this many evenly spaced signatures of video A
+static const int MAX_OFFSET_TEST_SIGNATURES = 4000;
+
+// Offset search range and the minimum number of grid samples worth correlating
+static const qint64 MAX_OFFSET_SEARCH_MS = 5 * 60 * 1000;
+static const int MIN_CORRELATION_SAMPLES = 20;
+
+// Audio matches at least this confident are taken without looking at the picture
+static const double AUDIO_CONFIDENCE_THRESHOLD = 0.6;
+
+// Frames less similar than this rule out identical videos
+static const double MIN_FRAME_THRESHOLD = 0.75;
+
+// Divergence scans sample the timeline this coarsely, and count positions
+// below the per-frame threshold as divergent
+static const qint64 DIVERGENCE_SCAN_STEP_MS = 1000;
+static const double DIVERGENCE_THRESHOLD = MIN_FRAME_THRESHOLD;
+
+// Sequential test of the auto comparison. A frame pair of identical videos
+// falls below the per-frame threshold with at most SPRT_MISMATCH_IDENTICAL
+// probability, one of different videos with at least SPRT_MISMATCH_DIFFERENT.
+// Sampling stops once either hypothesis is SPRT_CONFIDENCE likely.
+static const double SPRT_MISMATCH_IDENTICAL = 0.01;
+static const double SPRT_MISMATCH_DIFFERENT = 0.30;
+static const double SPRT_CONFIDENCE = 0.99;
+static const int SPRT_MIN_SAMPLES = 8;
+static const int SPRT_MAX_SAMPLES = 48;
+
 VideoComparator::VideoComparator(QObject *parent)
     : QObject(parent)
     , m_videoAOffset(0)
     , m_videoBOffset(0)
     , m_videoDuration1(0)
     , m_videoDuration2(0)
-    , m_comparisonTimer(new QTimer(this))
     , m_isComparing(false)
     , m_isAutoComparing(false)
     , m_isDetectingOffset(false)
-    , m_currentTimestamp(0)
+    , m_cancelRequested(false)
     , m_videoDuration(0)
-    , m_currentSampleIndex(0)
-    , m_currentOffsetIndex(0)
 {
-    connect(m_comparisonTimer, &QTimer::timeout, this, &VideoComparator::performFrameComparison);
-    m_comparisonTimer->setInterval(100);
-    
     // Initialize frame cache with reasonable size (100 frames ~= 100MB)
     m_frameCache.setMaxCost(100);
 }
 
 VideoComparator::~VideoComparator()
 {
-    stopComparison();
+    cancel();
 }
 
 void VideoComparator::setVideo(int index, const QString &filePath)
 {
-    QMutexLocker locker(&m_mutex);
+    // A running job would keep comparing the old file, so stop it first
+    cancel();
     
     FFmpegHandler handler;
+    qint64 duration = handler.getVideoDuration(filePath);
+    
+    QMutexLocker locker(&m_mutex);
     
     if (index == 0) {
         m_videoPath1 = filePath;
-        m_videoDuration1 = handler.getVideoDuration(filePath);
-        // Clear cached frames for video 1
-        m_cachedFramesVideo1.clear();
+        m_videoDuration1 = duration;
     } else if (index == 1) {
         m_videoPath2 = filePath;
-        m_videoDuration2 = handler.getVideoDuration(filePath);
-        // Clear cached frames for video 2
-        m_cachedFramesVideo2.clear();
+        m_videoDuration2 = duration;
     }
     
     // Clear frame cache when videos change
     m_frameCache.clear();
+    m_packetIndexes.clear();
     
     if (!m_videoPath1.isEmpty() && !m_videoPath2.isEmpty()) {
         m_videoDuration = qMin(m_videoDuration1, m_videoDuration2);
@@ -73,57 +105,277 @@ void VideoComparator::setVideoOffset(int index, qint64 offsetMs)
     }
 }
 
-void VideoComparator::startComparison()
+void VideoComparator::setTimeMap(const TimeMap &map)
 {
-    if (m_videoPath1.isEmpty() || m_videoPath2.isEmpty()) {
-        qWarning() << "Cannot start comparison: both videos must be loaded";
-        return;
+    QMutexLocker locker(&m_mutex);
+    m_timeMap = map;
+}
+
+void VideoComparator::cancel()
+{
+    if (isBusy()) {
+        m_cancelRequested = true;
     }
-    
+}
+
+bool VideoComparator::isBusy() const
+{
+    return m_isComparing || m_isAutoComparing || m_isDetectingOffset;
+}
+
+void VideoComparator::setFingerprintOptions(const VideoFingerprinter::Options &options)
+{
     QMutexLocker locker(&m_mutex);
-    m_isComparing = true;
-    m_currentTimestamp = 0;
-    m_results.clear();
+    m_fingerprintOptions = options;
+}
+
+void VideoComparator::setQualityOptions(const QualityMetrics::Options &options)
+{
+    QMutexLocker locker(&m_mutex);
+    m_qualityOptions = options;
+}
+
+QualityMetrics::Options VideoComparator::qualityOptions() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_qualityOptions;
+}
+
+QString VideoComparator::qualitySummary(const QList<QualityMetrics::Scores> &scores)
+{
+    if (scores.isEmpty()) {
+        return QString();
+    }
+    
+    QualityMetrics::Scores mean;
+    double worstSsim = 1.0;
+    bool multiScale = true;
+    for (const QualityMetrics::Scores &score : scores) {
+        mean.psnr += score.psnr;
+        mean.ssim += score.ssim;
+        mean.msSsim += score.msSsim;
+        worstSsim = qMin(worstSsim, score.ssim);
+        multiScale = multiScale && score.msSsim >= 0.0;
+    }
     
-    m_comparisonTimer->start();
+    QString summary = QString("Quality over %1 frame pairs: PSNR %2 dB, SSIM %3 (worst %4)")
+                          .arg(scores.size())
+                          .arg(mean.psnr / scores.size(), 0, 'f', 2)
+                          .arg(mean.ssim / scores.size(), 0, 'f', 4)
+                          .arg(worstSsim, 0, 'f', 4);
+    if (multiScale) {
+        summary += QString(", MS-SSIM %1").arg(mean.msSsim / scores.size(), 0, 'f', 4);
+    }
+    return summary;
 }
 
-void VideoComparator::stopComparison()
+qint64 VideoComparator::checkedDuration(const QString &videoPath, const PacketIndex &index, qint64 declaredMs)
+{
+    // The container's word on duration is checked against the packets
+    if (index.isConsistent()) {
+        return declaredMs;
+    }
+    
+    qWarning() << "Container of" << videoPath << "declares" << index.containerDurationMs() << "ms at"
+               << index.containerFrameRate() << "fps, packets span" << index.durationMs() << "ms at"
+               << index.frameRate() << "fps";
+    return index.durationMs();
+}
+
+VideoComparator::VideoPair VideoComparator::currentPair() const
 {
     QMutexLocker locker(&m_mutex);
-    m_isComparing = false;
-    m_comparisonTimer->stop();
     
-    if (!m_results.isEmpty()) {
-        emit comparisonComplete(m_results);
+    VideoPair pair;
+    pair.path1 = m_videoPath1;
+    pair.path2 = m_videoPath2;
+    pair.offsetA = m_videoAOffset;
+    pair.offsetB = m_videoBOffset;
+    pair.timeMap = m_timeMap;
+    pair.duration1 = m_videoDuration1;
+    pair.duration2 = m_videoDuration2;
+    return pair;
+}
+
+qint64 VideoComparator::positionInB(const VideoPair &pair, qint64 positionA)
+{
+    if (pair.timeMap.isValid()) {
+        return pair.timeMap.mapToB(positionA);
+    }
+    return positionA - pair.offsetA + pair.offsetB;
+}
+
+bool VideoComparator::overlapInA(const VideoPair &pair, qint64 &startA, qint64 &endA)
+{
+    if (pair.timeMap.isValid()) {
+        startA = qMax(0LL, pair.timeMap.mapToA(0));
+        endA = qMin(pair.duration1, pair.timeMap.mapToA(pair.duration2));
+    } else {
+        qint64 effectiveStartTime = qMax(0LL, qMax(-pair.offsetA, -pair.offsetB));
+        qint64 effectiveEndTime = qMin(pair.duration1 - pair.offsetA, pair.duration2 - pair.offsetB);
+        startA = effectiveStartTime + pair.offsetA;
+        endA = effectiveEndTime + pair.offsetA;
+    }
+    return endA > startA;
+}
+
+void VideoComparator::framePositions(const VideoPair &pair, qint64 timestamp, qint64 &positionA, qint64 &positionB)
+{
+    // Apply offsets to timestamps
+    positionA = timestamp + pair.offsetA;
+    positionB = timestamp + pair.offsetB;
+    
+    // A fitted time map replaces the offsets; the timeline is then video A's
+    if (pair.timeMap.isValid()) {
+        positionA = timestamp;
+        positionB = pair.timeMap.mapToB(timestamp);
+    }
+    
+    // Ensure timestamps are within valid bounds
+    positionA = qMax(0LL, qMin(positionA, pair.duration1 - 1));
+    positionB = qMax(0LL, qMin(positionB, pair.duration2 - 1));
+}
+
+bool VideoComparator::beginJob(std::atomic<bool> &jobFlag, const char *jobName)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_videoPath1.isEmpty() || m_videoPath2.isEmpty()) {
+            qWarning() << "Cannot start" << jobName << ": both videos must be loaded";
+            return false;
+        }
+    }
+    
+    if (isBusy()) {
+        qWarning() << "Another operation is already in progress";
+        return false;
+    }
+    
+    m_cancelRequested = false;
+    jobFlag = true;
+    return true;
+}
+
+bool VideoComparator::startComparison()
+{
+    if (!beginJob(m_isComparing, "comparison")) {
+        return false;
+    }
+    
+    QMetaObject::invokeMethod(this, &VideoComparator::performFrameComparison, Qt::QueuedConnection);
+    return true;
+}
+
+void VideoComparator::stopComparison()
+{
+    if (m_isComparing) {
+        m_cancelRequested = true;
     }
 }
 
 void VideoComparator::performFrameComparison()
 {
-    if (!m_isComparing) {
-        return;
+    const VideoPair pair = currentPair();
+    m_results.clear();
+    
+    std::shared_ptr<const PacketIndex> index = packetIndex(pair.path1);
+    const qint64 durationA = index ? checkedDuration(pair.path1, *index, pair.duration1) : pair.duration1;
+    const qint64 duration = qMin(durationA, pair.duration2);
+    
+    // Timeline positions are video A's shifted by its offset, unless a time map is set
+    const qint64 shiftA = pair.timeMap.isValid() ? 0 : pair.offsetA;
+    
+    // Samples land on keyframes of video A where possible, so each one costs a
+    // seek and a single decoded frame instead of decoding up from the last keyframe
+    QVector<qint64> timestamps;
+    if (index && !index->keyframes().isEmpty()) {
+        for (qint64 keyframe : index->keyframeSamples(shiftA, duration + shiftA, 1000)) {
+            timestamps.append(keyframe - shiftA);
+        }
+    }
+    if (timestamps.isEmpty()) {
+        for (qint64 timestamp = 0; timestamp < duration; timestamp += 1000) {
+            timestamps.append(timestamp);
+        }
     }
     
-    double similarity = compareFramesAtTimestamp(m_currentTimestamp);
+    QVector<qint64> sceneCuts = index ? index->sceneCutCandidates() : QVector<qint64>();
     
-    ComparisonResult result;
-    result.similarity = similarity;
-    result.timestamp = m_currentTimestamp;
-    result.description = QString("Similarity: %1%").arg(similarity * 100, 0, 'f', 2);
+    // One session per file for the similarity samples instead of reopening
+    // the file for each; video A's seeks go straight to its keyframes
+    FrameDecoder decoderA;
+    FrameDecoder decoderB;
+    decoderA.setOutputSize(ANALYSIS_WIDTH, ANALYSIS_HEIGHT);
+    decoderB.setOutputSize(ANALYSIS_WIDTH, ANALYSIS_HEIGHT);
+    if (index) {
+        decoderA.setKeyframes(index->keyframes());
+    }
+    if (!decoderA.open(pair.path1) || !decoderB.open(pair.path2)) {
+        qWarning() << "Comparison sessions could not be opened";
+    }
     
-    m_results.append(result);
-    emit frameCompared(m_currentTimestamp, similarity);
+    // Quality metrics get their own sessions at their own resolution
+    QualityMetrics::Options qualityOptions = this->qualityOptions();
+    FrameDecoder qualityDecoderA;
+    FrameDecoder qualityDecoderB;
+    if (qualityOptions.enabled) {
+        qualityDecoderA.setOutputSize(qualityOptions.width, qualityOptions.height);
+        qualityDecoderB.setOutputSize(qualityOptions.width, qualityOptions.height);
+        if (index) {
+            qualityDecoderA.setKeyframes(index->keyframes());
+        }
+        if (!qualityDecoderA.open(pair.path1) || !qualityDecoderB.open(pair.path2)) {
+            qWarning() << "Quality metrics disabled: videos could not be opened";
+            qualityOptions.enabled = false;
+        }
+    }
     
-    if (m_videoDuration > 0) {
-        int progress = (m_currentTimestamp * 100) / m_videoDuration;
-        emit comparisonProgress(progress);
+    for (int i = 0; i < timestamps.size() && !isCancelled(); ++i) {
+        qint64 timestamp = timestamps[i];
+        double similarity = compareFramesAtTimestamp(pair, timestamp, decoderA, decoderB);
+        
+        auto cut = std::lower_bound(sceneCuts.constBegin(), sceneCuts.constEnd(), timestamp + shiftA);
+        bool onSceneCut = cut != sceneCuts.constEnd() && *cut == timestamp + shiftA;
+        
+        ComparisonResult result;
+        result.similarity = similarity;
+        result.timestamp = timestamp;
+        result.description = QString("Similarity: %1%%2").arg(similarity * 100, 0, 'f', 2)
+                                                         .arg(onSceneCut ? " (scene cut)" : "");
+        result.hasQuality = false;
+        
+        if (qualityOptions.enabled) {
+            qint64 positionA = 0;
+            qint64 positionB = 0;
+            framePositions(pair, timestamp, positionA, positionB);
+            QImage frameA = qualityDecoderA.frameAt(positionA);
+            QImage frameB = qualityDecoderB.frameAt(positionB);
+            if (!frameA.isNull() && !frameB.isNull()) {
+                result.quality = QualityMetrics::compute(frameA, frameB, qualityOptions);
+                result.hasQuality = true;
+                result.description += QString(", PSNR: %1 dB, SSIM: %2")
+                                          .arg(result.quality.psnr, 0, 'f', 2)
+                                          .arg(result.quality.ssim, 0, 'f', 4);
+                if (result.quality.msSsim >= 0.0) {
+                    result.description += QString(", MS-SSIM: %1").arg(result.quality.msSsim, 0, 'f', 4);
+                }
+            }
+        }
+        
+        m_results.append(result);
+        emit frameCompared(timestamp, similarity);
+        emit comparisonProgress(static_cast<int>(((i + 1) * 100) / timestamps.size()));
     }
     
-    m_currentTimestamp += 1000;
+    m_isComparing = false;
+    
+    if (isCancelled()) {
+        emit operationCancelled();
+        return;
+    }
     
-    if (m_currentTimestamp >= m_videoDuration) {
-        stopComparison();
+    if (!m_results.isEmpty()) {
+        emit comparisonComplete(m_results);
     }
 }
 
@@ -250,12 +502,13 @@ bool VideoComparator::isSceneChange(const QImage &prevFrame, const QImage &curre
 }
 
 // FRAME MANAGEMENT
-VideoComparator::FrameInfo VideoComparator::extractFrameInfo(const QString &videoPath, qint64 timestamp)
+VideoComparator::FrameInfo VideoComparator::computeFrameInfo(const QImage &image)
 {
-    FFmpegHandler handler;
     FrameInfo info;
-    
-    info.image = handler.extractFrame(videoPath, timestamp);
+    info.image = image;
+    info.perceptualHash = 0;
+    info.edgeDensity = 0.0;
+    info.isSceneChange = false;
     
     if (!info.image.isNull()) {
         info.perceptualHash = computePerceptualHash(info.image);
@@ -267,54 +520,113 @@ VideoComparator::FrameInfo VideoComparator::extractFrameInfo(const QString &vide
     return info;
 }
 
-VideoComparator::FrameInfo VideoComparator::getCachedOrExtractFrame(const QString &videoPath, qint64 timestamp)
+VideoComparator::FrameInfo VideoComparator::extractFrameInfo(FrameDecoder &decoder, qint64 timestamp)
+{
+    if (!decoder.isOpen()) {
+        return computeFrameInfo(QImage());
+    }
+    
+    return computeFrameInfo(decoder.frameAt(timestamp));
+}
+
+VideoComparator::FrameInfo VideoComparator::getCachedOrExtractFrame(FrameDecoder &decoder, const QString &videoPath,
+                                                                    qint64 timestamp)
 {
     QString cacheKey = QString("%1_%2").arg(videoPath).arg(timestamp);
     
     // Check cache first
-    if (m_frameCache.contains(cacheKey)) {
-        return *m_frameCache.object(cacheKey);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_frameCache.contains(cacheKey)) {
+            return *m_frameCache.object(cacheKey);
+        }
     }
     
-    // Extract and cache if not found
-    FrameInfo info = extractFrameInfo(videoPath, timestamp);
+    // Extract without holding the lock, then cache
+    FrameInfo info = extractFrameInfo(decoder, timestamp);
+    
+    QMutexLocker locker(&m_mutex);
     m_frameCache.insert(cacheKey, new FrameInfo(info));
     
     return info;
 }
 
-void VideoComparator::preloadFramesForOffsetDetection()
+// SIGNATURE TRACKS
+SignatureTrack VideoComparator::signatureTrack(const QString &videoPath, const VideoFingerprinter::Options &options,
+                                               int progressBase, int progressSpan)
 {
-    qDebug() << "=== Preloading frames for simple cross-correlation ===";
+    // A video we have fingerprinted before is just mapped from the cache
+    SignatureTrack track;
+    if (m_signatureCache.load(videoPath, options, track)) {
+        emit comparisonProgress(progressBase + progressSpan);
+        return track;
+    }
     
-    // Clear caches
-    m_cachedFramesVideo1.clear();
-    m_cachedFramesVideo2.clear();
+    VideoFingerprinter fingerprinter;
+    fingerprinter.setOptions(options);
+    fingerprinter.setCancelFlag(&m_cancelRequested);
+    fingerprinter.setProgressCallback([this, progressBase, progressSpan](int percentage) {
+        emit comparisonProgress(progressBase + (percentage * progressSpan) / 100);
+    });
     
-    // Simple approach: extract frames every 500ms for first 20 seconds
-    qint64 duration = qMin(m_videoDuration1, m_videoDuration2);
-    qint64 sampleDuration = qMin(duration, qint64(20000)); // First 20 seconds
-    qint64 maxOffset = 15000; // ±15 seconds
+    track = fingerprinter.compute(videoPath);
+    if (!track.isEmpty()) {
+        m_signatureCache.store(videoPath, options, track);
+    }
+    return track;
+}
+
+bool VideoComparator::loadSignatureTracks(const VideoPair &pair, SignatureTrack &trackA, SignatureTrack &trackB,
+                                          int progressBase, int progressSpan)
+{
+    VideoFingerprinter::Options options;
+    {
+        QMutexLocker locker(&m_mutex);
+        options = m_fingerprintOptions;
+    }
     
-    qDebug() << "Sampling duration:" << sampleDuration << "ms";
-    qDebug() << "Max offset range: ±" << maxOffset << "ms";
+    if (trackA.isEmpty()) {
+        trackA = signatureTrack(pair.path1, options, progressBase, progressSpan / 2);
+    }
+    if (isCancelled()) {
+        return false;
+    }
     
-    // Extract frames from video 1 every 500ms
-    for (qint64 t = 2000; t < sampleDuration; t += 500) { // Start at 2s to skip intro
-        m_cachedFramesVideo1[t] = extractFrameInfo(m_videoPath1, t);
+    if (trackB.isEmpty()) {
+        trackB = signatureTrack(pair.path2, options, progressBase + progressSpan / 2, progressSpan - progressSpan / 2);
+    }
+    if (isCancelled()) {
+        return false;
     }
     
-    // Extract frames from video 2 with extended range to cover all offset possibilities
-    qint64 startTime = qMax(0LL, 2000 - maxOffset);
-    qint64 endTime = qMin(m_videoDuration2, sampleDuration + maxOffset);
+    qDebug() << "Signature tracks - A:" << trackA.size() << "signatures, B:" << trackB.size() << "signatures";
+    return !trackA.isEmpty() && !trackB.isEmpty();
+}
+
+double VideoComparator::compareSignaturesAt(const SignatureTrack &trackB, const FrameSignature &signatureA,
+                                            qint64 timestampB)
+{
+    int index = trackB.indexAt(timestampB);
+    if (index < 0) {
+        return -1.0;
+    }
     
-    for (qint64 t = startTime; t < endTime; t += 500) {
-        m_cachedFramesVideo2[t] = extractFrameInfo(m_videoPath2, t);
+    // No signature near enough (gap, or outside video B)
+    qint64 tolerance = static_cast<qint64>(1000.0 / qMax(0.1, trackB.sampleRate()));
+    if (std::abs(trackB.at(index).ptsMs - timestampB) > tolerance) {
+        return -1.0;
     }
     
-    qDebug() << "Loaded" << m_cachedFramesVideo1.size() << "reference frames from video A";
-    qDebug() << "Loaded" << m_cachedFramesVideo2.size() << "search frames from video B";
-    qDebug() << "Video B range:" << startTime << "ms to" << endTime << "ms";
+    // Samples of the two videos rarely land on the same frame, so also try the
+    // neighbours; this keeps scene cuts from looking like mismatches
+    double best = VideoFingerprinter::similarity(signatureA, trackB.at(index));
+    if (index > 0) {
+        best = qMax(best, VideoFingerprinter::similarity(signatureA, trackB.at(index - 1)));
+    }
+    if (index + 1 < trackB.size()) {
+        best = qMax(best, VideoFingerprinter::similarity(signatureA, trackB.at(index + 1)));
+    }
+    return best;
 }
 
 // MULTI-METRIC FRAME COMPARISON - OPTIMIZED FOR QUALITY DIFFERENCES
@@ -358,288 +670,239 @@ double VideoComparator::compareFrameInfo(const FrameInfo &frame1, const FrameInf
     return totalSimilarity;
 }
 
-double VideoComparator::compareFramesAtTimestamp(qint64 timestamp)
+double VideoComparator::compareFramesAtTimestamp(const VideoPair &pair, qint64 timestamp,
+                                                 FrameDecoder &decoderA, FrameDecoder &decoderB)
 {
-    // Apply offsets to timestamps
-    qint64 timestamp1 = timestamp + m_videoAOffset;
-    qint64 timestamp2 = timestamp + m_videoBOffset;
-    
-    // Ensure timestamps are within valid bounds
-    timestamp1 = qMax(0LL, qMin(timestamp1, m_videoDuration1 - 1));
-    timestamp2 = qMax(0LL, qMin(timestamp2, m_videoDuration2 - 1));
+    qint64 timestamp1 = 0;
+    qint64 timestamp2 = 0;
+    framePositions(pair, timestamp, timestamp1, timestamp2);
     
     // Get frame info (cached or extracted)
-    FrameInfo frame1 = getCachedOrExtractFrame(m_videoPath1, timestamp1);
-    FrameInfo frame2 = getCachedOrExtractFrame(m_videoPath2, timestamp2);
+    FrameInfo frame1 = getCachedOrExtractFrame(decoderA, pair.path1, timestamp1);
+    FrameInfo frame2 = getCachedOrExtractFrame(decoderB, pair.path2, timestamp2);
     
     return compareFrameInfo(frame1, frame2);
 }
 
-// SMART SAMPLING
-QList<qint64> VideoComparator::generateSmartSampleTimestamps(qint64 duration)
+std::shared_ptr<const PacketIndex> VideoComparator::packetIndex(const QString &videoPath)
 {
-    QList<qint64> timestamps;
-    
-    if (duration <= 0) {
-        return timestamps;
+    if (std::shared_ptr<const PacketIndex> cached = cachedPacketIndex(videoPath)) {
+        return cached;
     }
     
-    // Start earlier to catch offsets better - only skip first 500ms for black frames
-    qint64 startTime = qMin(500LL, duration / 20);
-    qint64 endTime = duration - 500;
-    
-    if (endTime <= startTime) {
-        timestamps.append((startTime + endTime) / 2);
-        return timestamps;
+    // Demuxing the whole file without the lock; failed builds are not cached
+    auto index = std::make_shared<PacketIndex>();
+    if (!index->build(videoPath, &m_cancelRequested)) {
+        return nullptr;
     }
     
-    // Strategic sampling points with more early samples
-    // 1. Very early content (critical for offset detection)
-    timestamps.append(startTime);
-    timestamps.append(startTime + 500);
-    timestamps.append(startTime + 1000);
-    timestamps.append(startTime + 1500);
-    timestamps.append(startTime + 2000);
-    timestamps.append(startTime + 3000);
-    timestamps.append(startTime + 5000);
-    timestamps.append(startTime + 7500);
-    timestamps.append(startTime + 10000);
-    timestamps.append(startTime + 15000);
-    
-    // 2. Detect scene changes for additional sampling points
-    QList<qint64> sceneChanges = detectSceneChanges(
-        m_videoPath1, startTime, qMin(startTime + 30000, endTime));
-    
-    // Add up to 5 scene change points
-    for (int i = 0; i < qMin(5, sceneChanges.size()); ++i) {
-        timestamps.append(sceneChanges[i]);
-    }
+    QMutexLocker locker(&m_mutex);
+    m_packetIndexes.insert(videoPath, index);
+    return index;
+}
+
+std::shared_ptr<const PacketIndex> VideoComparator::cachedPacketIndex(const QString &videoPath)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_packetIndexes.value(videoPath);
+}
+
+// SCENE DETECTION
+QList<qint64> VideoComparator::detectSceneChanges(const SignatureTrack &track, qint64 startMs, qint64 endMs)
+{
+    QList<qint64> sceneChanges;
     
-    // 3. Some regular intervals through the rest
-    qint64 step = (endTime - startTime) / 5;
-    for (int i = 1; i < 5; ++i) {
-        timestamps.append(startTime + i * step);
+    for (int i = qMax(1, track.lowerBound(startMs)); i < track.size() && track.at(i).ptsMs <= endMs; ++i) {
+        if (VideoFingerprinter::isSceneChange(track.at(i - 1), track.at(i))) {
+            sceneChanges.append(track.at(i).ptsMs);
+        }
     }
     
-    // Remove duplicates and sort
-    std::sort(timestamps.begin(), timestamps.end());
-    timestamps.erase(std::unique(timestamps.begin(), timestamps.end()), timestamps.end());
-    
-    // Limit to reasonable number but allow more samples
-    if (timestamps.size() > 20) {
-        timestamps = timestamps.mid(0, 20);
+    return sceneChanges;
+}
+
+// OFFSET DETECTION
+bool VideoComparator::findOptimalOffset(OffsetStrategy strategy)
+{
+    if (!beginJob(m_isDetectingOffset, "offset detection")) {
+        return false;
     }
     
-    return timestamps;
+    QMetaObject::invokeMethod(this, [this, strategy]() {
+        if (strategy == DriftOffset) {
+            performTimeAlignment();
+        } else {
+            performOffsetDetection(strategy);
+        }
+    }, Qt::QueuedConnection);
+    return true;
 }
 
-QList<qint64> VideoComparator::detectSceneChanges(const QString &videoPath, qint64 startMs, qint64 endMs)
+void VideoComparator::performOffsetDetection(OffsetStrategy strategy)
 {
-    QList<qint64> sceneChanges;
+    const VideoPair pair = currentPair();
     
-    FFmpegHandler handler;
-    QImage prevFrame;
-    qint64 step = 500; // Check every 500ms
+    qDebug() << "=== Starting Offset Detection ===";
+    qDebug() << "Video A duration:" << pair.duration1 << "ms";
+    qDebug() << "Video B duration:" << pair.duration2 << "ms";
+    
+    qint64 bestOffset = 0;
+    double confidence = 0.0;
+    bool found = false;
     
-    for (qint64 t = startMs; t <= endMs; t += step) {
-        QImage currentFrame = handler.extractFrame(videoPath, t);
+    // Audio is cheap to decode and survives re-edits and regrades, so it goes first
+    if (strategy != VisualOffset) {
+        int progressSpan = (strategy == AudioOffset) ? 100 : 30;
         
-        if (!prevFrame.isNull() && !currentFrame.isNull()) {
-            if (isSceneChange(prevFrame, currentFrame)) {
-                sceneChanges.append(t);
-            }
-        }
+        AudioAligner aligner;
+        aligner.setCancelFlag(&m_cancelRequested);
+        aligner.setProgressCallback([this, progressSpan](int percentage) {
+            emit comparisonProgress((percentage * progressSpan) / 100);
+        });
         
-        prevFrame = currentFrame;
+        AudioAligner::Result audio = aligner.align(pair.path1, pair.path2);
+        if (audio.valid) {
+            bestOffset = audio.offsetMs;
+            confidence = audio.confidence;
+            found = true;
+        }
+    }
+    
+    // The picture decides when there is no usable audio match, or when it is the better one
+    if (!isCancelled() && strategy != AudioOffset && (!found || confidence < AUDIO_CONFIDENCE_THRESHOLD)) {
+        int progressBase = (strategy == VisualOffset) ? 0 : 30;
         
-        // Limit scene changes to avoid too many
-        if (sceneChanges.size() >= 10) {
-            break;
+        // Fingerprinting dominates; the correlation itself is near instant
+        SignatureTrack trackA;
+        SignatureTrack trackB;
+        qint64 visualOffset = 0;
+        double visualConfidence = 0.0;
+        if (loadSignatureTracks(pair, trackA, trackB, progressBase, 90 - progressBase) &&
+            estimateOffset(trackA, trackB, visualOffset, visualConfidence) &&
+            (!found || visualConfidence > confidence)) {
+            bestOffset = visualOffset;
+            confidence = visualConfidence;
+            found = true;
         }
     }
     
-    return sceneChanges;
-}
-
-// HIERARCHICAL OFFSET DETECTION
-QList<qint64> VideoComparator::generateHierarchicalOffsetCandidates(qint64 maxOffsetMs)
-{
-    QList<qint64> candidates;
+    if (isCancelled()) {
+        m_isDetectingOffset = false;
+        emit operationCancelled();
+        return;
+    }
     
-    // Start with coarse 1-second steps for speed
-    for (qint64 offset = -maxOffsetMs; offset <= maxOffsetMs; offset += 1000) {
-        candidates.append(offset);
+    if (!found) {
+        qDebug() << "Offset detection found no usable correlation";
     }
     
-    qDebug() << "Generated" << candidates.size() << "coarse candidates with 1s steps";
-    return candidates;
+    emit comparisonProgress(100);
+    m_isDetectingOffset = false;
+    emit optimalOffsetFound(bestOffset, confidence);
 }
 
-void VideoComparator::findOptimalOffset()
+bool VideoComparator::estimateOffset(const SignatureTrack &trackA, const SignatureTrack &trackB,
+                                     qint64 &offsetMs, double &confidence)
 {
-    if (m_videoPath1.isEmpty() || m_videoPath2.isEmpty()) {
-        qWarning() << "Cannot find optimal offset: both videos must be loaded";
-        return;
-    }
+    qint64 intervalMs = qMax<qint64>(1, qRound64(1000.0 / qMax(0.1, trackA.sampleRate())));
     
-    QMutexLocker locker(&m_mutex);
+    QVector<double> lumaA, hashA, lumaB, hashB;
+    TimeAligner::correlationSeries(trackA, intervalMs, lumaA, hashA);
+    TimeAligner::correlationSeries(trackB, intervalMs, lumaB, hashB);
     
-    if (m_isComparing || m_isAutoComparing || m_isDetectingOffset) {
-        qWarning() << "Another operation is already in progress";
-        return;
+    if (lumaA.size() < MIN_CORRELATION_SAMPLES || lumaB.size() < MIN_CORRELATION_SAMPLES) {
+        return false;
     }
     
-    m_isDetectingOffset = true;
-    m_currentOffsetIndex = 0;
-    m_offsetSimilarityMap.clear();
+    int maxLag = static_cast<int>(qMin<qint64>(MAX_OFFSET_SEARCH_MS / intervalMs, lumaA.size() + lumaB.size()));
+    int minOverlap = qMax(MIN_CORRELATION_SAMPLES, static_cast<int>(qMin(lumaA.size(), lumaB.size()) / 4));
     
-    qDebug() << "=== Starting Offset Detection ===";
-    qDebug() << "Video A duration:" << m_videoDuration1 << "ms";
-    qDebug() << "Video B duration:" << m_videoDuration2 << "ms";
+    QVector<double> lumaCorrelation = CrossCorrelation::correlate(lumaA, lumaB, maxLag, minOverlap);
+    QVector<double> hashCorrelation = CrossCorrelation::correlate(hashA, hashB, maxLag, minOverlap);
+    
+    QVector<double> correlation(lumaCorrelation.size());
+    for (int i = 0; i < correlation.size(); ++i) {
+        correlation[i] = (lumaCorrelation[i] + hashCorrelation[i]) / 2.0;
+    }
+    
+    // The runner-up must be at least a second away to count as a competing match
+    int exclusionRadius = qMax(2, static_cast<int>(1000 / intervalMs));
+    CrossCorrelation::Peak peak = CrossCorrelation::findPeak(correlation, maxLag, exclusionRadius);
+    if (!peak.valid || peak.value <= 0.0) {
+        return false;
+    }
     
-    // Preload frames for fast comparison
-    preloadFramesForOffsetDetection();
+    // The peak says B(t + lag) shows what A shows at t. The offset used by the
+    // player and setVideoOffset() is the opposite: A(t) matches B(t - offset).
+    qint64 lagMs = qRound64(peak.lag * intervalMs);
+    offsetMs = -lagMs;
     
-    // Generate hierarchical offset candidates - increase range to 15 seconds
-    m_offsetCandidates = generateHierarchicalOffsetCandidates(15000);
+    // Confidence from the height of the peak and its distance to the runner-up
+    double separation = qBound(0.0, (peak.value - qMax(0.0, peak.secondValue)) / peak.value, 1.0);
+    confidence = qMin(1.0, peak.value) * 0.5 + separation * 0.5;
     
-    qDebug() << "Starting offset detection with" << m_offsetCandidates.size() 
-             << "candidates (range: ±15 seconds)";
+    double similarity = testOffsetWithSignatures(trackA, trackB, lagMs);
+    qDebug() << "Offset detection complete. Best offset:" << offsetMs << "ms"
+             << "correlation:" << peak.value << "runner-up:" << peak.secondValue
+             << "similarity:" << (similarity * 100) << "% confidence:" << (confidence * 100) << "%";
     
-    QTimer::singleShot(0, this, &VideoComparator::performOffsetDetection);
+    return true;
 }
 
-void VideoComparator::performOffsetDetection()
+void VideoComparator::performTimeAlignment()
 {
-    if (!m_isDetectingOffset || m_currentOffsetIndex >= m_offsetCandidates.size()) {
-        // Phase 1 complete - find best coarse offset
-        if (!m_offsetSimilarityMap.isEmpty()) {
-            qint64 bestCoarseOffset = 0;
-            double bestSimilarity = 0.0;
-            
-            for (auto it = m_offsetSimilarityMap.constBegin(); it != m_offsetSimilarityMap.constEnd(); ++it) {
-                if (it.value() > bestSimilarity) {
-                    bestSimilarity = it.value();
-                    bestCoarseOffset = it.key();
-                }
-            }
-            
-            // Phase 2: Fine-tune around best coarse offset
-            if (m_currentOffsetIndex >= m_offsetCandidates.size() && bestSimilarity > 0.4) {
-                // Check if we need to do fine-tuning
-                bool needsFineTuning = false;
-                for (qint64 offset : m_offsetCandidates) {
-                    if (std::abs(offset - bestCoarseOffset) == 500) {
-                        needsFineTuning = true;
-                        break;
-                    }
-                }
-                
-                if (needsFineTuning && m_offsetCandidates.last() >= 100) {
-                    // Generate fine-tuning candidates with wider range
-                    m_offsetCandidates.clear();
-                    for (qint64 offset = bestCoarseOffset - 750; offset <= bestCoarseOffset + 750; offset += 25) {
-                        if (!m_offsetSimilarityMap.contains(offset)) {
-                            m_offsetCandidates.append(offset);
-                        }
-                    }
-                    
-                    if (!m_offsetCandidates.isEmpty()) {
-                        m_currentOffsetIndex = 0;
-                        qDebug() << "Fine-tuning around" << bestCoarseOffset << "ms with" 
-                                << m_offsetCandidates.size() << "candidates";
-                        QTimer::singleShot(1, this, &VideoComparator::performOffsetDetection);
-                        return;
-                    }
-                }
-            }
-            
-            // Final result
-            qint64 bestOffset = 0;
-            double bestFinalSimilarity = 0.0;
-            
-            for (auto it = m_offsetSimilarityMap.constBegin(); it != m_offsetSimilarityMap.constEnd(); ++it) {
-                if (it.value() > bestFinalSimilarity) {
-                    bestFinalSimilarity = it.value();
-                    bestOffset = it.key();
-                }
-            }
-            
-            double confidence = calculateConfidenceScore(m_offsetSimilarityMap, bestOffset);
-            
-            qDebug() << "Offset detection complete. Best offset:" << bestOffset << "ms"
-                     << "with similarity:" << (bestFinalSimilarity * 100) << "% and confidence:" 
-                     << (confidence * 100) << "%";
-            
-            emit optimalOffsetFound(bestOffset, confidence);
-        }
-        
+    const VideoPair pair = currentPair();
+    
+    TimeAligner::Result result;
+    result.valid = false;
+    result.confidence = 0.0;
+    
+    // Fingerprinting dominates; fitting and warping the tracks takes seconds
+    SignatureTrack trackA;
+    SignatureTrack trackB;
+    if (loadSignatureTracks(pair, trackA, trackB, 0, 90)) {
+        TimeAligner aligner;
+        aligner.setMaxOffset(MAX_OFFSET_SEARCH_MS);
+        aligner.setCancelFlag(&m_cancelRequested);
+        result = aligner.align(trackA, trackB);
+    }
+    
+    if (isCancelled()) {
         m_isDetectingOffset = false;
-        m_cachedFramesVideo1.clear();
-        m_cachedFramesVideo2.clear();
+        emit operationCancelled();
         return;
     }
     
-    // Test current offset candidate
-    qint64 offsetToTest = m_offsetCandidates[m_currentOffsetIndex];
-    double similarity = testOffsetWithCache(offsetToTest);
-    m_offsetSimilarityMap[offsetToTest] = similarity;
-    
-    // Update progress
-    int progress = ((m_currentOffsetIndex + 1) * 100) / m_offsetCandidates.size();
-    emit comparisonProgress(progress);
-    
-    m_currentOffsetIndex++;
-    
-    // Minimal delay for speed
-    QTimer::singleShot(1, this, &VideoComparator::performOffsetDetection);
+    emit comparisonProgress(100);
+    m_isDetectingOffset = false;
+    emit timeAlignmentFound(result.valid ? result.map : TimeMap(), result.confidence);
 }
 
-double VideoComparator::testOffsetWithCache(qint64 offset)
+double VideoComparator::testOffsetWithSignatures(const SignatureTrack &trackA, const SignatureTrack &trackB,
+                                                 qint64 offset)
 {
-    QList<double> similarities;
+    double similaritySum = 0.0;
     int validComparisons = 0;
     
-    qDebug() << "=== Testing offset" << offset << "ms ===";
-    
-    // For each reference frame in video A
-    for (auto it = m_cachedFramesVideo1.constBegin(); it != m_cachedFramesVideo1.constEnd(); ++it) {
-        qint64 timestampA = it.key();
-        // Find corresponding frame in video B
-        qint64 timestampB = timestampA + offset;
-        
-        qDebug() << "  Looking for Video A@" << timestampA << "ms -> Video B@" << timestampB << "ms";
-        
-        // Check if we have the corresponding frame in video B
-        if (m_cachedFramesVideo2.contains(timestampB)) {
-            const FrameInfo &frameA = it.value();
-            const FrameInfo &frameB = m_cachedFramesVideo2[timestampB];
-            
-            if (!frameA.image.isNull() && !frameB.image.isNull()) {
-                double similarity = compareFrameInfo(frameA, frameB);
-                similarities.append(similarity);
-                validComparisons++;
-                
-                qDebug() << "    Comparison" << validComparisons << ": similarity =" << (similarity * 100) << "%";
-                
-                // Log high similarity matches with more detail
-                if (similarity > 0.6) {
-                    int hashDist = hammingDistance(frameA.perceptualHash, frameB.perceptualHash);
-                    qDebug() << "    ** Good match: hash distance =" << hashDist << "/64";
-                }
-            }
-        } else {
-            qDebug() << "    No frame available at" << timestampB << "ms in video B";
+    // Video A@t is matched against video B@(t + offset) across the whole
+    // file; long files are thinned out evenly to bound the cost per candidate
+    int stride = qMax(1, trackA.size() / MAX_OFFSET_TEST_SIGNATURES);
+    for (int i = 0; i < trackA.size(); i += stride) {
+        const FrameSignature &signatureA = trackA.at(i);
+        double similarity = compareSignaturesAt(trackB, signatureA, signatureA.ptsMs + offset);
+        if (similarity >= 0.0) {
+            similaritySum += similarity;
+            validComparisons++;
         }
     }
     
-    if (similarities.isEmpty()) {
+    if (validComparisons == 0) {
         qDebug() << "  No valid comparisons for offset" << offset << "ms";
         return 0.0;
     }
     
     // Use simple average for better interpretability
-    double avgSimilarity = std::accumulate(similarities.begin(), similarities.end(), 0.0) / similarities.size();
+    double avgSimilarity = similaritySum / validComparisons;
     
     qDebug() << "  RESULT: offset" << offset << "ms -> avg similarity" << (avgSimilarity * 100) 
              << "% from" << validComparisons << "comparisons";
@@ -647,115 +910,458 @@ double VideoComparator::testOffsetWithCache(qint64 offset)
     return avgSimilarity;
 }
 
-// CONFIDENCE CALCULATION
-double VideoComparator::calculateConfidenceScore(const QMap<qint64, double> &offsetSimilarityMap, qint64 bestOffset)
+// AUTO COMPARISON
+bool VideoComparator::startAutoComparison()
 {
-    if (offsetSimilarityMap.size() < 3) {
-        return 0.0;
+    if (!beginJob(m_isAutoComparing, "auto comparison")) {
+        return false;
     }
     
-    double bestSimilarity = offsetSimilarityMap[bestOffset];
-    
-    // Calculate statistics
-    QList<double> allSimilarities = offsetSimilarityMap.values();
-    std::sort(allSimilarities.begin(), allSimilarities.end());
-    
-    double median = allSimilarities[allSimilarities.size() / 2];
-    double q75 = allSimilarities[allSimilarities.size() * 3 / 4];
-    
-    // Confidence based on how much better the best is compared to others
-    double separation = (bestSimilarity - q75) / (1.0 - q75 + 0.001);
-    separation = qMax(0.0, qMin(1.0, separation));
-    
-    // Also consider absolute similarity value
-    double absoluteConfidence = qMax(0.0, (bestSimilarity - 0.7) / 0.3);
-    absoluteConfidence = qMin(1.0, absoluteConfidence);
-    
-    // Combined confidence
-    double confidence = separation * 0.6 + absoluteConfidence * 0.4;
-    
-    return confidence;
+    QMetaObject::invokeMethod(this, &VideoComparator::performAutoComparison, Qt::QueuedConnection);
+    return true;
 }
 
-// AUTO COMPARISON
-void VideoComparator::startAutoComparison()
+void VideoComparator::performAutoComparison()
 {
-    if (m_videoPath1.isEmpty() || m_videoPath2.isEmpty()) {
-        qWarning() << "Cannot start auto comparison: both videos must be loaded";
+    const VideoPair pair = currentPair();
+    
+    qint64 startA = 0;
+    qint64 endA = 0;
+    if (!overlapInA(pair, startA, endA)) {
+        qWarning() << "Invalid effective duration due to offsets";
+        m_isAutoComparing = false;
+        emit autoComparisonComplete(0.0, false, "Cannot compare: offsets result in no overlapping video content.");
         return;
     }
     
-    QMutexLocker locker(&m_mutex);
-    
-    if (m_isComparing || m_isAutoComparing) {
-        qWarning() << "Comparison already in progress";
+    // Remuxes of one encode carry the same video packets. When the videos are
+    // aligned as they are, identical packet payloads settle the comparison
+    // at disk speed; the first differing packet sends it on to fingerprinting.
+    bool aligned = pair.timeMap.isValid() ? (!pair.timeMap.hasDrift() && pair.timeMap.mapToB(0) == 0)
+                                          : pair.offsetA == pair.offsetB;
+    qint64 packetCount = 0;
+    qint64 byteCount = 0;
+    if (aligned && StreamHasher::streamsIdentical(pair.path1, pair.path2, packetCount, byteCount, &m_cancelRequested,
+                                                  [this](int percentage) { emit comparisonProgress(percentage); })) {
+        QString summary = QString("Video streams are bit-identical: %1 packets (%2 MB) match.\n"
+                                  "No frames needed decoding.\n"
+                                  "Verdict: Videos are IDENTICAL")
+                              .arg(packetCount)
+                              .arg(byteCount / (1024.0 * 1024.0), 0, 'f', 1);
+        
+        qDebug() << "Auto comparison complete:" << summary;
+        m_isAutoComparing = false;
+        emit comparisonProgress(100);
+        emit autoComparisonComplete(1.0, true, summary);
         return;
     }
     
-    m_isAutoComparing = true;
-    m_currentSampleIndex = 0;
-    m_autoSimilarityResults.clear();
+    // Fingerprinting both files dominates the cost. Unless both are cached,
+    // first try to settle the verdict on a few decoded frame pairs. Quality
+    // metrics are measured on those pairs, so they are decoded either way then.
+    VideoFingerprinter::Options options;
+    {
+        QMutexLocker locker(&m_mutex);
+        options = m_fingerprintOptions;
+    }
+    SignatureTrack trackA;
+    SignatureTrack trackB;
+    bool cached = m_signatureCache.load(pair.path1, options, trackA) && m_signatureCache.load(pair.path2, options, trackB);
+    
+    const bool runSequential = !cached || qualityOptions().enabled;
+    bool sequentialIdentical = false;
+    QList<double> sequentialResults;
+    QList<QualityMetrics::Scores> qualityScores;
+    if (runSequential && sequentialVerdict(pair, startA, endA, sequentialIdentical, sequentialResults, qualityScores)) {
+        double overallSimilarity = calculateOverallSimilarity(sequentialResults);
+        QString summary = QString("Analyzed %1 frames (sequential test, stopped at %2% confidence).\n"
+                                  "Average similarity: %3%\n")
+                              .arg(sequentialResults.size())
+                              .arg(SPRT_CONFIDENCE * 100, 0, 'f', 0)
+                              .arg(overallSimilarity * 100, 0, 'f', 1);
+        if (!qualityScores.isEmpty()) {
+            summary += qualitySummary(qualityScores) + "\n";
+        }
+        summary += QString("Verdict: Videos are %1").arg(sequentialIdentical ? "IDENTICAL" : "DIFFERENT");
+        
+        qDebug() << "Auto comparison complete:" << summary;
+        m_isAutoComparing = false;
+        emit comparisonProgress(100);
+        emit autoComparisonComplete(overallSimilarity, sequentialIdentical, summary);
+        return;
+    }
     
-    // Calculate effective duration
-    qint64 effectiveStartTime = qMax(0LL, qMax(-m_videoAOffset, -m_videoBOffset));
-    qint64 effectiveEndTime = qMin(m_videoDuration1 - m_videoAOffset, m_videoDuration2 - m_videoBOffset);
-    qint64 effectiveDuration = qMax(0LL, effectiveEndTime - effectiveStartTime);
+    if (isCancelled()) {
+        m_isAutoComparing = false;
+        emit operationCancelled();
+        return;
+    }
     
-    if (effectiveDuration <= 0) {
-        qWarning() << "Invalid effective duration due to offsets";
+    // Tracks found in the cache above are kept, so nothing is hashed twice
+    if (!loadSignatureTracks(pair, trackA, trackB, runSequential ? 20 : 0, runSequential ? 80 : 100)) {
         m_isAutoComparing = false;
-        emit autoComparisonComplete(0.0, false, "Cannot compare: offsets result in no overlapping video content.");
+        if (isCancelled()) {
+            emit operationCancelled();
+        } else {
+            emit autoComparisonComplete(0.0, false, "Cannot compare: videos could not be fingerprinted.");
+        }
         return;
     }
     
-    m_autoSampleTimestamps = generateSmartSampleTimestamps(effectiveDuration);
+    // Compare every signature of video A inside the overlapping range with
+    // the matching position in video B
+    QList<double> similarityResults;
+    for (int i = trackA.lowerBound(startA); i < trackA.size() && trackA.at(i).ptsMs < endA; ++i) {
+        const FrameSignature &signatureA = trackA.at(i);
+        double similarity = compareSignaturesAt(trackB, signatureA, positionInB(pair, signatureA.ptsMs));
+        if (similarity >= 0.0) {
+            similarityResults.append(similarity);
+        }
+    }
     
-    // Adjust timestamps to start from effective start time
-    for (int i = 0; i < m_autoSampleTimestamps.size(); ++i) {
-        m_autoSampleTimestamps[i] += effectiveStartTime;
+    // Scene cuts of A that have a counterpart in B are a cheap check on the edit
+    QList<qint64> sceneChangesA = detectSceneChanges(trackA, startA, endA);
+    QList<qint64> sceneChangesB = detectSceneChanges(trackB, positionInB(pair, startA), positionInB(pair, endA));
+    qint64 cutTolerance = static_cast<qint64>(2000.0 / qMax(0.1, trackB.sampleRate()));
+    int matchedSceneChanges = 0;
+    for (qint64 cutA : sceneChangesA) {
+        qint64 cutB = positionInB(pair, cutA);
+        for (qint64 candidate : sceneChangesB) {
+            if (std::abs(candidate - cutB) <= cutTolerance) {
+                matchedSceneChanges++;
+                break;
+            }
+        }
     }
     
-    qDebug() << "Starting auto comparison with" << m_autoSampleTimestamps.size() << "samples";
+    m_isAutoComparing = false;
     
-    QTimer::singleShot(0, this, &VideoComparator::performAutoComparison);
+    if (!similarityResults.isEmpty()) {
+        double overallSimilarity = calculateOverallSimilarity(similarityResults);
+        bool identical = determineIfIdentical(overallSimilarity, similarityResults);
+        
+        QString summary = QString("Analyzed %1 frames across video duration.\n"
+                                "Average similarity: %2%\n"
+                                "Scene changes matched: %3 of %4\n")
+                        .arg(similarityResults.size())
+                        .arg(overallSimilarity * 100, 0, 'f', 1)
+                        .arg(matchedSceneChanges)
+                        .arg(sceneChangesA.size());
+        if (!qualityScores.isEmpty()) {
+            summary += qualitySummary(qualityScores) + "\n";
+        }
+        summary += QString("Verdict: Videos are %1").arg(identical ? "IDENTICAL" : "DIFFERENT");
+        
+        qDebug() << "Auto comparison complete:" << summary;
+        emit autoComparisonComplete(overallSimilarity, identical, summary);
+    } else {
+        emit autoComparisonComplete(0.0, false, "Cannot compare: no frames could be sampled.");
+    }
 }
 
-void VideoComparator::performAutoComparison()
+bool VideoComparator::sequentialVerdict(const VideoPair &pair, qint64 startA, qint64 endA,
+                                        bool &identical, QList<double> &similarities,
+                                        QList<QualityMetrics::Scores> &quality)
 {
-    if (!m_isAutoComparing || m_currentSampleIndex >= m_autoSampleTimestamps.size()) {
-        // Comparison complete
-        if (!m_autoSimilarityResults.isEmpty()) {
-            double overallSimilarity = calculateOverallSimilarity(m_autoSimilarityResults);
-            bool identical = determineIfIdentical(overallSimilarity, m_autoSimilarityResults);
-            
-            QString summary = QString("Analyzed %1 frames across video duration.\n"
-                                    "Average similarity: %2%\n"
-                                    "Verdict: Videos are %3")
-                            .arg(m_autoSimilarityResults.size())
-                            .arg(overallSimilarity * 100, 0, 'f', 1)
-                            .arg(identical ? "IDENTICAL" : "DIFFERENT");
-            
-            qDebug() << "Auto comparison complete:" << summary;
-            emit autoComparisonComplete(overallSimilarity, identical, summary);
+    similarities.clear();
+    quality.clear();
+    
+    // Candidate positions: keyframes of A when an earlier job already indexed
+    // it, since a seek to them decodes a single frame. Building the index here
+    // would demux all of A before the first sample.
+    QVector<qint64> positions;
+    std::shared_ptr<const PacketIndex> index = cachedPacketIndex(pair.path1);
+    if (index) {
+        positions = index->keyframeSamples(startA, endA, 1000);
+    }
+    if (positions.size() < SPRT_MAX_SAMPLES) {
+        positions.clear();
+        for (int i = 0; i < SPRT_MAX_SAMPLES; ++i) {
+            positions.append(startA + (endA - startA) * (2 * i + 1) / (2 * SPRT_MAX_SAMPLES));
+        }
+    }
+    
+    // With quality metrics on, frames are decoded at their resolution; the
+    // signatures scale them down anyway
+    const QualityMetrics::Options qualityOptions = this->qualityOptions();
+    const int width = qualityOptions.enabled ? qualityOptions.width : ANALYSIS_WIDTH;
+    const int height = qualityOptions.enabled ? qualityOptions.height : ANALYSIS_HEIGHT;
+    FrameDecoder decoderA;
+    FrameDecoder decoderB;
+    decoderA.setOutputSize(width, height);
+    decoderB.setOutputSize(width, height);
+    if (index) {
+        decoderA.setKeyframes(index->keyframes());
+    }
+    if (!decoderA.open(pair.path1) || !decoderB.open(pair.path2)) {
+        return false;
+    }
+    
+    // Wald's thresholds on the log likelihood ratio of identical over different
+    const double acceptIdentical = std::log(SPRT_CONFIDENCE / (1.0 - SPRT_CONFIDENCE));
+    const double acceptDifferent = -acceptIdentical;
+    const double matchWeight = std::log((1.0 - SPRT_MISMATCH_IDENTICAL) / (1.0 - SPRT_MISMATCH_DIFFERENT));
+    const double mismatchWeight = std::log(SPRT_MISMATCH_IDENTICAL / SPRT_MISMATCH_DIFFERENT);
+    
+    double logLikelihoodRatio = 0.0;
+    std::vector<bool> visited(positions.size(), false);
+    for (int k = 0; k < SPRT_MAX_SAMPLES && !isCancelled(); ++k) {
+        // Van der Corput order spreads the first samples over the whole range
+        double fraction = 0.0;
+        double digit = 0.5;
+        for (int n = k + 1; n > 0; n >>= 1, digit /= 2.0) {
+            if (n & 1) {
+                fraction += digit;
+            }
+        }
+        int slot = qMin(static_cast<int>(fraction * positions.size()), positions.size() - 1);
+        while (visited[slot]) {
+            slot = (slot + 1) % positions.size();
+        }
+        visited[slot] = true;
+        
+        qint64 positionA = positions[slot];
+        qint64 positionB = positionInB(pair, positionA);
+        QImage frameA = decoderA.frameAt(positionA);
+        QImage frameB = decoderB.frameAt(positionB);
+        emit comparisonProgress((20 * (k + 1)) / SPRT_MAX_SAMPLES);
+        if (frameA.isNull() || frameB.isNull()) {
+            continue;
+        }
+        
+        FrameSignature signatureA = VideoFingerprinter::computeSignature(frameA, positionA);
+        double similarity = VideoFingerprinter::similarity(signatureA, VideoFingerprinter::computeSignature(frameB, positionB));
+        
+        // The two frames may straddle a cut; the next frame of B settles it
+        if (similarity < MIN_FRAME_THRESHOLD && decoderB.decodeNextFrame()) {
+            QImage nextB = decoderB.convertCurrentFrame();
+            if (!nextB.isNull()) {
+                double nextSimilarity = VideoFingerprinter::similarity(
+                    signatureA, VideoFingerprinter::computeSignature(nextB, positionB));
+                if (nextSimilarity > similarity) {
+                    similarity = nextSimilarity;
+                    frameB = nextB;
+                }
+            }
+        }
+        
+        similarities.append(similarity);
+        if (qualityOptions.enabled) {
+            quality.append(QualityMetrics::compute(frameA, frameB, qualityOptions));
+        }
+        logLikelihoodRatio += (similarity >= MIN_FRAME_THRESHOLD) ? matchWeight : mismatchWeight;
+        
+        if (similarities.size() < SPRT_MIN_SAMPLES) {
+            continue;
+        }
+        
+        if (logLikelihoodRatio <= acceptDifferent) {
+            identical = false;
+            return true;
         }
         
+        // Identical also has to pass the regular verdict on the samples taken
+        if (logLikelihoodRatio >= acceptIdentical &&
+            determineIfIdentical(calculateOverallSimilarity(similarities), similarities)) {
+            identical = true;
+            return true;
+        }
+    }
+    
+    qDebug() << "Sequential test undecided after" << similarities.size() << "samples";
+    return false;
+}
+
+// DIVERGENCE SCAN
+bool VideoComparator::startDivergenceScan()
+{
+    if (!beginJob(m_isAutoComparing, "divergence scan")) {
+        return false;
+    }
+    
+    QMetaObject::invokeMethod(this, &VideoComparator::performDivergenceScan, Qt::QueuedConnection);
+    return true;
+}
+
+void VideoComparator::performDivergenceScan()
+{
+    VideoPair pair = currentPair();
+    QList<DivergentRange> ranges;
+    
+    // The packets of video A give its real length, its frame duration and
+    // its likely cuts without decoding anything
+    std::shared_ptr<const PacketIndex> index = packetIndex(pair.path1);
+    if (index) {
+        pair.duration1 = checkedDuration(pair.path1, *index, pair.duration1);
+    }
+    const QVector<qint64> sceneCuts = index ? index->sceneCutCandidates() : QVector<qint64>();
+    
+    qint64 startA = 0;
+    qint64 endA = 0;
+    if (!overlapInA(pair, startA, endA)) {
         m_isAutoComparing = false;
+        emit divergenceScanComplete(ranges, "Cannot scan: offsets result in no overlapping video content.");
         return;
     }
     
-    // Compare current sample
-    qint64 timestamp = m_autoSampleTimestamps[m_currentSampleIndex];
-    double similarity = compareFramesAtTimestamp(timestamp);
-    m_autoSimilarityResults.append(similarity);
+    SignatureTrack trackA;
+    SignatureTrack trackB;
+    if (!loadSignatureTracks(pair, trackA, trackB, 0, 80)) {
+        m_isAutoComparing = false;
+        if (isCancelled()) {
+            emit operationCancelled();
+        } else {
+            emit divergenceScanComplete(ranges, "Cannot scan: videos could not be fingerprinted.");
+        }
+        return;
+    }
     
-    // Update progress
-    int progress = ((m_currentSampleIndex + 1) * 100) / m_autoSampleTimestamps.size();
-    emit comparisonProgress(progress);
+    // Coarse pass over the signature tracks; no decoding beyond the tracks themselves
+    struct Sample {
+        qint64 positionA;
+        double similarity; // -1 when video B has nothing at that position
+    };
+    QVector<Sample> samples;
+    int stride = qMax(1, qRound(trackA.sampleRate() * DIVERGENCE_SCAN_STEP_MS / 1000.0));
+    for (int i = trackA.lowerBound(startA); i < trackA.size() && trackA.at(i).ptsMs < endA; i += stride) {
+        const FrameSignature &signatureA = trackA.at(i);
+        Sample sample;
+        sample.positionA = signatureA.ptsMs;
+        sample.similarity = compareSignaturesAt(trackB, signatureA, positionInB(pair, signatureA.ptsMs));
+        samples.append(sample);
+    }
     
-    m_currentSampleIndex++;
+    // Boundaries between agreeing and disagreeing samples are bisected on
+    // decoded frames, so each anomaly costs a logarithmic number of decodes.
+    // With quality metrics on, the frames come at their resolution and each
+    // range gets one more pair from its middle.
+    const QualityMetrics::Options qualityOptions = this->qualityOptions();
+    FrameDecoder decoderA;
+    FrameDecoder decoderB;
+    decoderA.setOutputSize(qualityOptions.enabled ? qualityOptions.width : ANALYSIS_WIDTH,
+                           qualityOptions.enabled ? qualityOptions.height : ANALYSIS_HEIGHT);
+    decoderB.setOutputSize(qualityOptions.enabled ? qualityOptions.width : ANALYSIS_WIDTH,
+                           qualityOptions.enabled ? qualityOptions.height : ANALYSIS_HEIGHT);
+    if (index) {
+        decoderA.setKeyframes(index->keyframes());
+    }
+    bool canRefine = decoderA.open(pair.path1) && decoderB.open(pair.path2);
+    
+    const qint64 frameMs = (index && index->frameRate() > 0.0) ? qMax<qint64>(1, qRound64(1000.0 / index->frameRate())) : 40;
+    int decodedPairs = 0;
+    
+    auto matchesAt = [&](qint64 positionA) {
+        QImage frameA = decoderA.frameAt(positionA);
+        QImage frameB = decoderB.frameAt(positionInB(pair, positionA));
+        decodedPairs++;
+        return compareFrameInfo(computeFrameInfo(frameA), computeFrameInfo(frameB)) >= DIVERGENCE_THRESHOLD;
+    };
+    
+    // Returns the divergent position next to the agreeing one, to within a frame
+    auto refine = [&](qint64 agreeing, qint64 divergent) {
+        while (canRefine && std::abs(divergent - agreeing) > frameMs && !isCancelled()) {
+            qint64 middle = agreeing + (divergent - agreeing) / 2;
+            if (matchesAt(middle)) {
+                agreeing = middle;
+            } else {
+                divergent = middle;
+            }
+        }
+        return divergent;
+    };
+    
+    // A range that starts and ends on cuts is a shot that was replaced,
+    // inserted or removed, rather than damage inside a shot
+    auto onSceneCut = [&](qint64 positionA) {
+        auto cut = std::lower_bound(sceneCuts.constBegin(), sceneCuts.constEnd(), positionA - 2 * frameMs);
+        return cut != sceneCuts.constEnd() && *cut <= positionA + 2 * frameMs;
+    };
+    
+    auto isDivergent = [](const Sample &sample) { return sample.similarity < DIVERGENCE_THRESHOLD; };
+    
+    int first = 0;
+    while (first < samples.size() && !isCancelled()) {
+        if (!isDivergent(samples[first])) {
+            first++;
+            continue;
+        }
+        
+        int last = first;
+        while (last + 1 < samples.size() && isDivergent(samples[last + 1])) {
+            last++;
+        }
+        
+        DivergentRange range;
+        range.startMs = (first == 0) ? startA : refine(samples[first - 1].positionA, samples[first].positionA);
+        range.endMs = (last + 1 == samples.size()) ? endA
+                                                   : refine(samples[last + 1].positionA, samples[last].positionA) + frameMs;
+        range.meanSimilarity = 0.0;
+        range.minSimilarity = 1.0;
+        range.sampleCount = last - first + 1;
+        range.unmatchedSamples = 0;
+        for (int i = first; i <= last; ++i) {
+            double similarity = qMax(0.0, samples[i].similarity);
+            range.meanSimilarity += similarity;
+            range.minSimilarity = qMin(range.minSimilarity, similarity);
+            if (samples[i].similarity < 0.0) {
+                range.unmatchedSamples++;
+            }
+        }
+        range.meanSimilarity /= range.sampleCount;
+        
+        // The ends of the timeline count as cuts, but not both at once
+        const bool startsAtEdge = first == 0;
+        const bool endsAtEdge = last + 1 == samples.size();
+        range.boundedByCuts = !(startsAtEdge && endsAtEdge) &&
+                              (startsAtEdge || onSceneCut(range.startMs)) && (endsAtEdge || onSceneCut(range.endMs));
+        
+        range.hasQuality = false;
+        const qint64 middleA = range.startMs + (range.endMs - range.startMs) / 2;
+        const qint64 middleB = positionInB(pair, middleA);
+        if (qualityOptions.enabled && canRefine && range.unmatchedSamples < range.sampleCount &&
+            middleB >= 0 && middleB < pair.duration2) {
+            QImage frameA = decoderA.frameAt(middleA);
+            QImage frameB = decoderB.frameAt(middleB);
+            decodedPairs++;
+            if (!frameA.isNull() && !frameB.isNull()) {
+                range.quality = QualityMetrics::compute(frameA, frameB, qualityOptions);
+                range.hasQuality = true;
+            }
+        }
+        ranges.append(range);
+        
+        emit comparisonProgress(80 + (20 * (last + 1)) / samples.size());
+        first = last + 1;
+    }
+    
+    m_isAutoComparing = false;
+    
+    if (isCancelled()) {
+        emit operationCancelled();
+        return;
+    }
+    
+    qint64 divergentMs = 0;
+    int cutRanges = 0;
+    for (const DivergentRange &range : ranges) {
+        divergentMs += range.endMs - range.startMs;
+        cutRanges += range.boundedByCuts ? 1 : 0;
+    }
+    
+    QString summary = QString("Scanned %1 positions over %2 s of video A.\n"
+                              "Divergent ranges: %3 (%4 s in total), %5 frame pairs decoded to locate them.")
+                          .arg(samples.size())
+                          .arg((endA - startA) / 1000.0, 0, 'f', 1)
+                          .arg(ranges.size())
+                          .arg(divergentMs / 1000.0, 0, 'f', 1)
+                          .arg(decodedPairs);
+    if (cutRanges > 0) {
+        summary += QString("\n%1 of the ranges lie between scene cuts, as for edited shots.").arg(cutRanges);
+    }
     
-    // Small delay to allow UI updates
-    QTimer::singleShot(20, this, &VideoComparator::performAutoComparison);
+    qDebug() << "Divergence scan complete:" << summary;
+    emit comparisonProgress(100);
+    emit divergenceScanComplete(ranges, summary);
 }
 
 double VideoComparator::calculateOverallSimilarity(const QList<double> &similarities)
@@ -771,7 +1377,6 @@ double VideoComparator::calculateOverallSimilarity(const QList<double> &similari
 bool VideoComparator::determineIfIdentical(double overallSimilarity, const QList<double> &similarities)
 {
     const double OVERALL_THRESHOLD = 0.85; // Slightly lower with better metrics
-    const double MIN_FRAME_THRESHOLD = 0.75;
     const double HIGH_SIMILARITY_THRESHOLD = 0.90;
     const double HIGH_SIMILARITY_RATIO = 0.70;
     
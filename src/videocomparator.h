@@ -3,14 +3,21 @@
 
 #include <QObject>
 #include <QString>
-#include <QTimer>
 #include <QThread>
 #include <QMutex>
 #include <QMap>
 #include <QCache>
 #include <QImage>
 #include <QVector>
+#include <atomic>
 #include <memory>
+#include "videofingerprint.h"
+#include "signaturecache.h"
+#include "timealignment.h"
+#include "packetindex.h"
+#include "qualitymetrics.h"
+
+class FrameDecoder;
 
 class VideoComparator : public QObject
 {
@@ -20,17 +27,60 @@ public:
     explicit VideoComparator(QObject *parent = nullptr);
     ~VideoComparator();
     
+    // What offset detection looks at. Auto tries the audio first and falls
+    // back to the picture when there is no audio or the match is ambiguous.
+    // Drift fits a TimeMap to the picture instead of a single offset, for
+    // frame-rate conversions and re-edits, and reports it with timeAlignmentFound.
+    enum OffsetStrategy {
+        VisualOffset,
+        AudioOffset,
+        AutoOffset,
+        DriftOffset
+    };
+    
+    // Job API - safe to call from any thread. The actual work is queued onto
+    // the thread this object lives in (MainWindow moves it to a worker thread).
+    // Jobs return false without any signal when a video is missing or another
+    // job is still running.
     void setVideo(int index, const QString &filePath);
     void setVideoOffset(int index, qint64 offsetMs);
-    void startComparison();
+    // A valid map takes precedence over the offsets; pass TimeMap() to clear it
+    void setTimeMap(const TimeMap &map);
+    bool startComparison();
     void stopComparison();
-    void startAutoComparison();
-    void findOptimalOffset();
+    bool startAutoComparison();
+    // Scans the whole aligned timeline and reports where the videos differ
+    bool startDivergenceScan();
+    bool findOptimalOffset(OffsetStrategy strategy = AutoOffset);
+    void cancel();
+    bool isBusy() const;
+    
+    // Controls how densely auto-compare, offset and scene detection fingerprint the videos
+    void setFingerprintOptions(const VideoFingerprinter::Options &options);
+    // Full-reference metrics on the frame pairs that auto-compare decodes, the
+    // middle of each divergent range and every sample of startComparison();
+    // off by default
+    void setQualityOptions(const QualityMetrics::Options &options);
     
     struct ComparisonResult {
         double similarity;
         qint64 timestamp;
         QString description;
+        bool hasQuality;                // Whether quality holds measured values
+        QualityMetrics::Scores quality;
+    };
+    
+    // Stretch of video A that has no matching picture in video B
+    struct DivergentRange {
+        qint64 startMs;        // Video A positions, refined to frame precision
+        qint64 endMs;
+        double meanSimilarity; // Over the coarse samples inside the range
+        double minSimilarity;
+        int sampleCount;
+        int unmatchedSamples;  // Samples with no counterpart in video B at all
+        bool hasQuality;       // Whether quality holds measured values
+        QualityMetrics::Scores quality; // Of the frame pair in the middle of the range
+        bool boundedByCuts;    // Starts and ends on likely scene cuts of video A
     };
     
     struct FrameInfo {
@@ -46,48 +96,77 @@ signals:
     void comparisonComplete(const QList<ComparisonResult> &results);
     void frameCompared(qint64 timestamp, double similarity);
     void autoComparisonComplete(double overallSimilarity, bool videosIdentical, const QString &summary);
+    void divergenceScanComplete(const QList<VideoComparator::DivergentRange> &ranges, const QString &summary);
     void optimalOffsetFound(qint64 optimalOffset, double confidence);
+    void timeAlignmentFound(const TimeMap &map, double confidence);
+    void operationCancelled();
 
 private slots:
     void performFrameComparison();
     void performAutoComparison();
-    void performOffsetDetection();
+    void performDivergenceScan();
 
 private:
-    // Video paths and metadata
+    // Snapshot of the loaded videos, taken once when a job starts so the
+    // worker never reads state the GUI thread may be changing
+    struct VideoPair {
+        QString path1;
+        QString path2;
+        qint64 offsetA;
+        qint64 offsetB;
+        TimeMap timeMap;
+        qint64 duration1;
+        qint64 duration2;
+    };
+    
+    VideoPair currentPair() const;
+    bool beginJob(std::atomic<bool> &jobFlag, const char *jobName);
+    bool isCancelled() const { return m_cancelRequested.load(); }
+    QualityMetrics::Options qualityOptions() const;
+    // One line of mean scores, empty when there are none
+    static QString qualitySummary(const QList<QualityMetrics::Scores> &scores);
+    void performOffsetDetection(OffsetStrategy strategy);
+    void performTimeAlignment();
+    // Position in video B that shows what video A shows at positionA
+    static qint64 positionInB(const VideoPair &pair, qint64 positionA);
+    // Range of video A that has a counterpart in video B
+    static bool overlapInA(const VideoPair &pair, qint64 &startA, qint64 &endA);
+    // Positions in both files of a comparison timeline timestamp, clamped to the files
+    static void framePositions(const VideoPair &pair, qint64 timestamp, qint64 &positionA, qint64 &positionB);
+    // declaredMs, or the span of the packets when the container disagrees with them
+    static qint64 checkedDuration(const QString &videoPath, const PacketIndex &index, qint64 declaredMs);
+    
+    // Video paths and metadata (guarded by m_mutex)
     QString m_videoPath1;
     QString m_videoPath2;
     qint64 m_videoAOffset;
     qint64 m_videoBOffset;
+    TimeMap m_timeMap;
     qint64 m_videoDuration1;
     qint64 m_videoDuration2;
     
     // Comparison state
-    QTimer *m_comparisonTimer;
-    QMutex m_mutex;
-    bool m_isComparing;
-    bool m_isAutoComparing;
-    bool m_isDetectingOffset;
-    qint64 m_currentTimestamp;
+    mutable QMutex m_mutex;
+    std::atomic<bool> m_isComparing;
+    std::atomic<bool> m_isAutoComparing;
+    std::atomic<bool> m_isDetectingOffset;
+    std::atomic<bool> m_cancelRequested;
     qint64 m_videoDuration;
+    VideoFingerprinter::Options m_fingerprintOptions;
+    QualityMetrics::Options m_qualityOptions;
     
-    // Frame cache for performance
+    // Frame cache for performance (guarded by m_mutex)
     QCache<QString, FrameInfo> m_frameCache;
     
-    // Auto comparison state
-    QList<qint64> m_autoSampleTimestamps;
-    int m_currentSampleIndex;
-    QList<double> m_autoSimilarityResults;
+    // Persistent signature tracks, so videos seen before are not decoded again
+    SignatureCache m_signatureCache;
     
-    // Offset detection state
-    QList<qint64> m_offsetCandidates;
-    int m_currentOffsetIndex;
-    QMap<qint64, double> m_offsetSimilarityMap;
-    QMap<qint64, FrameInfo> m_cachedFramesVideo1;
-    QMap<qint64, FrameInfo> m_cachedFramesVideo2;
+    // Packet indexes of the loaded videos, built on first use (guarded by m_mutex)
+    QMap<QString, std::shared_ptr<const PacketIndex>> m_packetIndexes;
     
     // Core comparison methods
-    double compareFramesAtTimestamp(qint64 timestamp);
+    double compareFramesAtTimestamp(const VideoPair &pair, qint64 timestamp,
+                                    FrameDecoder &decoderA, FrameDecoder &decoderB);
     double compareFrameInfo(const FrameInfo &frame1, const FrameInfo &frame2);
     
     // Perceptual hashing
@@ -100,19 +179,36 @@ private:
     bool isSceneChange(const QImage &prevFrame, const QImage &currentFrame);
     
     // Frame management
-    FrameInfo extractFrameInfo(const QString &videoPath, qint64 timestamp);
-    FrameInfo getCachedOrExtractFrame(const QString &videoPath, qint64 timestamp);
-    void preloadFramesForOffsetDetection();
+    FrameInfo computeFrameInfo(const QImage &image);
+    // decoder is a session on videoPath, kept open across samples
+    FrameInfo extractFrameInfo(FrameDecoder &decoder, qint64 timestamp);
+    FrameInfo getCachedOrExtractFrame(FrameDecoder &decoder, const QString &videoPath, qint64 timestamp);
+    std::shared_ptr<const PacketIndex> packetIndex(const QString &videoPath);
+    // Lookup only: null unless an index of videoPath has already been built
+    std::shared_ptr<const PacketIndex> cachedPacketIndex(const QString &videoPath);
+    
+    // Signature tracks
+    SignatureTrack signatureTrack(const QString &videoPath, const VideoFingerprinter::Options &options,
+                                  int progressBase, int progressSpan);
+    // Tracks that are not empty on entry are kept as they are
+    bool loadSignatureTracks(const VideoPair &pair, SignatureTrack &trackA, SignatureTrack &trackB,
+                             int progressBase, int progressSpan);
+    double compareSignaturesAt(const SignatureTrack &trackB, const FrameSignature &signatureA, qint64 timestampB);
+    // Sequential test on decoded frame pairs spread over [startA, endA).
+    // Returns false when neither verdict reached the target confidence.
+    // Quality metrics of the decoded pairs go to quality when they are enabled.
+    bool sequentialVerdict(const VideoPair &pair, qint64 startA, qint64 endA,
+                           bool &identical, QList<double> &similarities,
+                           QList<QualityMetrics::Scores> &quality);
     
-    // Sampling and offset detection
-    QList<qint64> generateSmartSampleTimestamps(qint64 duration);
-    QList<qint64> detectSceneChanges(const QString &videoPath, qint64 startMs, qint64 endMs);
-    QList<qint64> generateHierarchicalOffsetCandidates(qint64 maxOffsetMs);
-    double testOffsetWithCache(qint64 offset);
+    // Scene and offset detection
+    QList<qint64> detectSceneChanges(const SignatureTrack &track, qint64 startMs, qint64 endMs);
+    bool estimateOffset(const SignatureTrack &trackA, const SignatureTrack &trackB,
+                        qint64 &offsetMs, double &confidence);
+    double testOffsetWithSignatures(const SignatureTrack &trackA, const SignatureTrack &trackB, qint64 offset);
     
     // Statistical analysis
     double calculateOverallSimilarity(const QList<double> &similarities);
-    double calculateConfidenceScore(const QMap<qint64, double> &offsetSimilarityMap, qint64 bestOffset);
     bool determineIfIdentical(double overallSimilarity, const QList<double> &similarities);
     
     QList<ComparisonResult> m_results;
@@ -0,0 +1,283 @@
+#include "videofingerprint.h"
+#include "framedecoder.h"
+#include <QDebug>
+#include <QThread>
+#include <QThreadPool>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+// Signatures are computed from a tiny thumbnail; 32x32 still gives a stable
+// 8x8 hash (4x4 pixels per cell) and is cheap for swscale to produce
+static const int SIGNATURE_SIZE = 32;
+
+// Segments shorter than this are not worth an extra decoder and seek
+static const qint64 MIN_SEGMENT_MS = 60000;
+
+SignatureTrack::SignatureTrack()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_sampleRate(0.0)
+    , m_durationMs(0)
+{
+}
+
+SignatureTrack::SignatureTrack(const QVector<FrameSignature> &signatures, double sampleRate, qint64 durationMs)
+    : m_sampleRate(sampleRate)
+    , m_durationMs(durationMs)
+{
+    auto owned = std::make_shared<QVector<FrameSignature>>(signatures);
+    m_data = owned->constData();
+    m_size = owned->size();
+    m_storage = owned;
+}
+
+SignatureTrack::SignatureTrack(const std::shared_ptr<const void> &storage, const FrameSignature *signatures,
+                               int count, double sampleRate, qint64 durationMs)
+    : m_storage(storage)
+    , m_data(signatures)
+    , m_size(count)
+    , m_sampleRate(sampleRate)
+    , m_durationMs(durationMs)
+{
+}
+
+int SignatureTrack::lowerBound(qint64 timestampMs) const
+{
+    const FrameSignature *it = std::lower_bound(m_data, m_data + m_size, timestampMs,
+                                                [](const FrameSignature &signature, qint64 value) {
+        return signature.ptsMs < value;
+    });
+    return static_cast<int>(it - m_data);
+}
+
+int SignatureTrack::indexAt(qint64 timestampMs) const
+{
+    if (m_size == 0) {
+        return -1;
+    }
+    
+    int index = lowerBound(timestampMs);
+    if (index >= m_size) {
+        return m_size - 1;
+    }
+    if (index > 0 && timestampMs - m_data[index - 1].ptsMs < m_data[index].ptsMs - timestampMs) {
+        return index - 1;
+    }
+    return index;
+}
+
+VideoFingerprinter::VideoFingerprinter()
+    : m_cancelFlag(nullptr)
+{
+}
+
+SignatureTrack VideoFingerprinter::compute(const QString &filePath)
+{
+    FrameDecoder probe;
+    if (!probe.open(filePath)) {
+        qWarning() << "Cannot open" << filePath << "for fingerprinting";
+        return SignatureTrack();
+    }
+    qint64 durationMs = probe.durationMs();
+    probe.close();
+    
+    // Unknown duration: fall back to one segment covering the whole file
+    int segmentCount = 1;
+    if (durationMs > 0) {
+        segmentCount = static_cast<int>(qBound<qint64>(1, durationMs / MIN_SEGMENT_MS,
+                                                       QThread::idealThreadCount()));
+    }
+    qint64 segmentEnd = durationMs > 0 ? durationMs : std::numeric_limits<qint64>::max();
+    
+    QVector<QVector<FrameSignature>> segments(segmentCount);
+    std::atomic<qint64> processedMs(0);
+    
+    QThreadPool pool;
+    pool.setMaxThreadCount(segmentCount);
+    
+    for (int i = 0; i < segmentCount; ++i) {
+        qint64 startMs = (segmentCount == 1) ? 0 : durationMs * i / segmentCount;
+        qint64 endMs = (i == segmentCount - 1) ? segmentEnd : durationMs * (i + 1) / segmentCount;
+        QVector<FrameSignature> *segment = &segments[i];
+        
+        pool.start([this, &filePath, &processedMs, segment, startMs, endMs, durationMs]() {
+            computeSegment(filePath, startMs, endMs, *segment, processedMs, durationMs);
+        });
+    }
+    
+    pool.waitForDone();
+    
+    if (isCancelled()) {
+        return SignatureTrack();
+    }
+    
+    QVector<FrameSignature> signatures;
+    for (const QVector<FrameSignature> &segment : segments) {
+        signatures += segment;
+    }
+    
+    qDebug() << "Fingerprinted" << filePath << ":" << signatures.size() << "signatures from"
+             << segmentCount << "segment(s)";
+    
+    return SignatureTrack(signatures, m_options.sampleRate, durationMs);
+}
+
+void VideoFingerprinter::computeSegment(const QString &filePath, qint64 startMs, qint64 endMs,
+                                        QVector<FrameSignature> &signatures, std::atomic<qint64> &processedMs,
+                                        qint64 totalMs)
+{
+    FrameDecoder decoder;
+    decoder.setOutputSize(SIGNATURE_SIZE, SIGNATURE_SIZE);
+    decoder.setThreadCount(1);
+    if (m_options.keyframesOnly) {
+        decoder.setSkipFrames(AVDISCARD_NONKEY);
+    } else if (m_options.skipNonReference) {
+        decoder.setSkipFrames(AVDISCARD_NONREF);
+    }
+    
+    if (!decoder.open(filePath) || (startMs > 0 && !decoder.seekTo(startMs))) {
+        return;
+    }
+    
+    // Samples sit on a grid shared by all segments, so segment boundaries
+    // never produce duplicate or missing samples
+    const qint64 interval = qMax<qint64>(1, static_cast<qint64>(1000.0 / qMax(0.1, m_options.sampleRate)));
+    qint64 nextSampleMs = ((startMs + interval - 1) / interval) * interval;
+    qint64 reportedMs = startMs;
+    
+    while (!isCancelled() && decoder.decodeNextFrame()) {
+        if (!decoder.currentFrameHasTimestamp()) {
+            continue;
+        }
+        
+        qint64 ptsMs = decoder.lastFrameTimestamp();
+        if (ptsMs >= endMs) {
+            break;
+        }
+        if (ptsMs < nextSampleMs) {
+            continue;
+        }
+        
+        FrameSignature signature = computeSignature(decoder.convertCurrentFrame(), ptsMs);
+        if (decoder.currentFrameIsKeyframe()) {
+            signature.flags |= FrameSignature::Keyframe;
+        }
+        signatures.append(signature);
+        nextSampleMs = (ptsMs / interval + 1) * interval;
+        
+        // Report roughly once per second of decoded content
+        if (m_progressCallback && totalMs > 0 && ptsMs - reportedMs >= 1000) {
+            qint64 done = (processedMs += ptsMs - reportedMs);
+            reportedMs = ptsMs;
+            m_progressCallback(static_cast<int>(qMin<qint64>(100, done * 100 / totalMs)));
+        }
+    }
+}
+
+FrameSignature VideoFingerprinter::computeSignature(const QImage &image, qint64 ptsMs)
+{
+    FrameSignature signature;
+    signature.ptsMs = ptsMs;
+    signature.perceptualHash = 0;
+    signature.lumaMean = 0.0f;
+    signature.lumaStdDev = 0.0f;
+    std::fill(std::begin(signature.colorBins), std::end(signature.colorBins), quint8(0));
+    signature.flags = 0;
+    
+    if (image.isNull()) {
+        return signature;
+    }
+    
+    QImage rgb = image;
+    if (rgb.width() != SIGNATURE_SIZE || rgb.height() != SIGNATURE_SIZE) {
+        rgb = rgb.scaled(SIGNATURE_SIZE, SIGNATURE_SIZE, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    rgb = rgb.convertToFormat(QImage::Format_RGB888);
+    
+    const int cellSize = SIGNATURE_SIZE / 8;
+    double cells[64] = {};
+    int colorCounts[12] = {};
+    double lumaSum = 0.0;
+    double lumaSquareSum = 0.0;
+    
+    for (int y = 0; y < SIGNATURE_SIZE; ++y) {
+        const uchar *line = rgb.constScanLine(y);
+        for (int x = 0; x < SIGNATURE_SIZE; ++x) {
+            int r = line[x * 3];
+            int g = line[x * 3 + 1];
+            int b = line[x * 3 + 2];
+            
+            int luma = qGray(r, g, b);
+            lumaSum += luma;
+            lumaSquareSum += luma * luma;
+            cells[(y / cellSize) * 8 + (x / cellSize)] += luma;
+            
+            colorCounts[r >> 6]++;
+            colorCounts[4 + (g >> 6)]++;
+            colorCounts[8 + (b >> 6)]++;
+        }
+    }
+    
+    const double pixelCount = SIGNATURE_SIZE * SIGNATURE_SIZE;
+    double mean = lumaSum / pixelCount;
+    signature.lumaMean = static_cast<float>(mean);
+    signature.lumaStdDev = static_cast<float>(std::sqrt(qMax(0.0, lumaSquareSum / pixelCount - mean * mean)));
+    
+    // Same average hash as VideoComparator::computePerceptualHash, on the 8x8 cell means
+    double cellAverage = std::accumulate(std::begin(cells), std::end(cells), 0.0) / 64.0;
+    for (int bit = 0; bit < 64; ++bit) {
+        if (cells[bit] > cellAverage) {
+            signature.perceptualHash |= (1ULL << bit);
+        }
+    }
+    
+    for (int i = 0; i < 12; ++i) {
+        signature.colorBins[i] = static_cast<quint8>(qRound(colorCounts[i] * 255.0 / pixelCount));
+    }
+    
+    return signature;
+}
+
+int VideoFingerprinter::hammingDistance(quint64 hash1, quint64 hash2)
+{
+    return static_cast<int>(qPopulationCount(hash1 ^ hash2));
+}
+
+double VideoFingerprinter::similarity(const FrameSignature &a, const FrameSignature &b)
+{
+    // Same 70/30 weighting of hash and colour as VideoComparator::compareFrameInfo
+    double hashSimilarity = 1.0 - hammingDistance(a.perceptualHash, b.perceptualHash) / 64.0;
+    
+    // Only bins with significant presence count, to stay robust to compression noise
+    double totalDiff = 0.0;
+    int significantBins = 0;
+    for (int i = 0; i < 12; ++i) {
+        double avg = (a.colorBins[i] + b.colorBins[i]) / (2.0 * 255.0);
+        if (avg > 0.01) {
+            totalDiff += std::abs(a.colorBins[i] - b.colorBins[i]) / 255.0;
+            significantBins++;
+        }
+    }
+    
+    double colorSimilarity = hashSimilarity;
+    if (significantBins > 0) {
+        colorSimilarity = 1.0 - std::min(1.0, (totalDiff / significantBins) * 10);
+    }
+    
+    return hashSimilarity * 0.70 + colorSimilarity * 0.30;
+}
+
+bool VideoFingerprinter::isSceneChange(const FrameSignature &previous, const FrameSignature &current)
+{
+    double colorDiff = 0.0;
+    for (int i = 0; i < 12; ++i) {
+        colorDiff += std::abs(previous.colorBins[i] - current.colorBins[i]);
+    }
+    
+    // Same histogram threshold as VideoComparator::isSceneChange, or a large change of structure
+    return colorDiff / 255.0 > 0.3 ||
+           hammingDistance(previous.perceptualHash, current.perceptualHash) > 24;
+}
@@ -0,0 +1,99 @@
+#ifndef VIDEOFINGERPRINT_H
+#define VIDEOFINGERPRINT_H
+
+#include <QString>
+#include <QImage>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+// Compact per-frame descriptor. Kept as plain data with a fixed layout so a
+// whole track can be stored and compared as one contiguous array.
+struct FrameSignature {
+    enum Flag {
+        Keyframe = 0x1
+    };
+    
+    qint64 ptsMs;           // Presentation time relative to the start of the file
+    quint64 perceptualHash; // 8x8 average hash of the luma plane
+    float lumaMean;         // 0..255
+    float lumaStdDev;
+    quint8 colorBins[12];   // 4 bins per R, G, B channel, scaled to 0..255
+    quint32 flags;
+};
+
+static_assert(sizeof(FrameSignature) == 40 && std::is_trivially_copyable<FrameSignature>::value,
+              "FrameSignature is stored on disk as raw bytes");
+
+// All signatures of one video, sorted by timestamp. The array either lives
+// in the track itself or in a memory-mapped cache file kept open by the track.
+class SignatureTrack
+{
+public:
+    SignatureTrack();
+    SignatureTrack(const QVector<FrameSignature> &signatures, double sampleRate, qint64 durationMs);
+    SignatureTrack(const std::shared_ptr<const void> &storage, const FrameSignature *signatures, int count,
+                   double sampleRate, qint64 durationMs);
+    
+    bool isEmpty() const { return m_size == 0; }
+    int size() const { return m_size; }
+    const FrameSignature &at(int index) const { return m_data[index]; }
+    const FrameSignature *constData() const { return m_data; }
+    
+    double sampleRate() const { return m_sampleRate; }
+    qint64 durationMs() const { return m_durationMs; }
+    
+    // Index of the signature closest to timestampMs, or -1 for an empty track
+    int indexAt(qint64 timestampMs) const;
+    // Index of the first signature at or after timestampMs (size() if none)
+    int lowerBound(qint64 timestampMs) const;
+
+private:
+    std::shared_ptr<const void> m_storage;
+    const FrameSignature *m_data;
+    int m_size;
+    double m_sampleRate;
+    qint64 m_durationMs;
+};
+
+class VideoFingerprinter
+{
+public:
+    struct Options {
+        double sampleRate = 10.0;     // Signatures per second
+        bool keyframesOnly = false;   // Decode keyframes only (fastest, coarse timing)
+        bool skipNonReference = true; // Let the decoder drop non-reference frames
+    };
+    
+    VideoFingerprinter();
+    
+    void setOptions(const Options &options) { m_options = options; }
+    const Options &options() const { return m_options; }
+    
+    // Progress is reported as 0-100 from whichever worker thread made it
+    void setProgressCallback(const std::function<void(int)> &callback) { m_progressCallback = callback; }
+    void setCancelFlag(const std::atomic<bool> *cancelFlag) { m_cancelFlag = cancelFlag; }
+    
+    // Decodes the file once, front to back. Long files are split into a few
+    // contiguous segments that are decoded in parallel, each with one seek.
+    SignatureTrack compute(const QString &filePath);
+    
+    static FrameSignature computeSignature(const QImage &image, qint64 ptsMs);
+    static double similarity(const FrameSignature &a, const FrameSignature &b);
+    static bool isSceneChange(const FrameSignature &previous, const FrameSignature &current);
+    static int hammingDistance(quint64 hash1, quint64 hash2);
+
+private:
+    bool isCancelled() const { return m_cancelFlag && m_cancelFlag->load(); }
+    void computeSegment(const QString &filePath, qint64 startMs, qint64 endMs,
+                        QVector<FrameSignature> &signatures, std::atomic<qint64> &processedMs,
+                        qint64 totalMs);
+    
+    Options m_options;
+    std::function<void(int)> m_progressCallback;
+    const std::atomic<bool> *m_cancelFlag;
+};
+
+#endif // VIDEOFINGERPRINT_H
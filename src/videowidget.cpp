@@ -295,6 +295,14 @@ void VideoWidget::seek(qint64 position)
     m_mediaPlayer->setPosition(position);
 }
 
+void VideoWidget::setPlaybackRate(qreal rate)
+{
+    // Called on every position update during synced playback
+    if (!qFuzzyCompare(m_mediaPlayer->playbackRate(), rate)) {
+        m_mediaPlayer->setPlaybackRate(rate);
+    }
+}
+
 qint64 VideoWidget::position() const
 {
     return m_mediaPlayer->position();
@@ -56,6 +56,7 @@ public:
     void play();
     void pause();
     void seek(qint64 position);
+    void setPlaybackRate(qreal rate);
     qint64 position() const;
     qint64 duration() const;
     QString currentFilePath() const { return m_currentFilePath; }